@@ -0,0 +1,347 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <string.h>
+#include <algorithm>
+#include "AudioFile.h"
+
+enum {
+    WAVE_FORMAT_PCM = 1,
+    WAVE_FORMAT_IEEE_FLOAT = 3,
+    WAVE_FORMAT_EXTENSIBLE = 0xfffe,
+
+    WAV_HEADER_SIZE = 44,
+};
+
+// WAV files are little-endian
+static uint16_t getLE16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t getLE32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void putLE16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void putLE32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+AudioFileReader::AudioFileReader()
+    : fp{nullptr}, encoding{FLOAT_32}, channels{0}, sampleRate{0},
+      frameSize{0}, framesLeft{0}
+{
+}
+
+AudioFileReader::~AudioFileReader()
+{
+    close();
+}
+
+void AudioFileReader::close()
+{
+    if (fp) {
+        fclose(fp);
+        fp = nullptr;
+    }
+    framesLeft = 0;
+}
+
+int AudioFileReader::getChannels() const
+{
+    return channels;
+}
+
+int AudioFileReader::getSampleRate() const
+{
+    return sampleRate;
+}
+
+bool AudioFileReader::openWav(const char *path)
+{
+    close();
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    if (!parseWavHeader()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+// Parses chunks up to the start of the sample data
+bool AudioFileReader::parseWavHeader()
+{
+    uint8_t header[12];
+    if (fread(header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header, "RIFF", 4) != 0 ||
+        memcmp(header + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    bool haveFormat = false;
+    while (true) {
+        uint8_t chunk[8];
+        if (fread(chunk, sizeof(chunk), 1, fp) != 1) {
+            return false;
+        }
+        uint32_t size = getLE32(chunk + 4);
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[40] = {};
+            if (size < 16 ||
+                fread(fmt, std::min<size_t>(size, sizeof(fmt)), 1, fp) != 1) {
+                return false;
+            }
+
+            unsigned format = getLE16(fmt);
+            if (format == WAVE_FORMAT_EXTENSIBLE && size >= 40) {
+                format = getLE16(fmt + 24); // first bytes of SubFormat GUID
+            }
+            channels = getLE16(fmt + 2);
+            sampleRate = getLE32(fmt + 4);
+            frameSize = getLE16(fmt + 12);
+            unsigned bits = getLE16(fmt + 14);
+
+            if (format == WAVE_FORMAT_PCM && bits == 16) {
+                encoding = PCM_16;
+            } else if (format == WAVE_FORMAT_PCM && bits == 24) {
+                encoding = PCM_24;
+            } else if (format == WAVE_FORMAT_PCM && bits == 32) {
+                encoding = PCM_32;
+            } else if (format == WAVE_FORMAT_IEEE_FLOAT && bits == 32) {
+                encoding = FLOAT_32;
+            } else {
+                return false;
+            }
+            if (channels < 1 || sampleRate <= 0 ||
+                frameSize != channels * bits / 8) {
+                return false;
+            }
+
+            haveFormat = true;
+            size = size > sizeof(fmt) ? size - sizeof(fmt) : 0;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) {
+                return false;
+            }
+            framesLeft = size / frameSize;
+            return true;
+        }
+
+        // Skip the rest of the chunk including its pad byte
+        if (fseek(fp, size + (size & 1), SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+}
+
+bool AudioFileReader::openRaw(const char *path, int channels_, int sampleRate_)
+{
+    close();
+
+    if (channels_ < 1 || sampleRate_ <= 0) {
+        return false;
+    }
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    encoding = RAW_FLOAT_32;
+    channels = channels_;
+    sampleRate = sampleRate_;
+    frameSize = channels * sizeof(float);
+    framesLeft = UINT64_MAX; // until end of file
+    return true;
+}
+
+float AudioFileReader::toFloat(const uint8_t *p, Encoding encoding)
+{
+    switch (encoding) {
+    case PCM_16:
+        return (int16_t)getLE16(p) / 32768.f;
+    case PCM_24: {
+        int32_t value = p[0] | (p[1] << 8) | (p[2] << 16);
+        if (value & 0x800000) {
+            value -= 0x1000000; // sign extend
+        }
+        return value / 8388608.f;
+    }
+    case PCM_32:
+        return (int32_t)getLE32(p) / 2147483648.f;
+    case FLOAT_32: {
+        uint32_t bits = getLE32(p);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    case RAW_FLOAT_32:
+    default: {
+        float value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    }
+}
+
+size_t AudioFileReader::read(float *samples[CHANNELS_STEREO], size_t nsamples)
+{
+    if (!fp) {
+        return 0;
+    }
+
+    nsamples = std::min<uint64_t>(nsamples, framesLeft);
+    buf.resize(nsamples * frameSize);
+    nsamples = fread(buf.data(), frameSize, nsamples, fp);
+    framesLeft -= nsamples;
+
+    const size_t sampleSize = frameSize / channels;
+    for (size_t i = 0; i < nsamples; i++) {
+        const uint8_t *frame = &buf[i * frameSize];
+
+        for (int ch = 0; ch < CHANNELS_STEREO; ch++) {
+            const uint8_t *p = frame + std::min(ch, channels - 1) * sampleSize;
+
+            samples[ch][i] = toFloat(p, encoding);
+        }
+    }
+    return nsamples;
+}
+
+AudioFileWriter::AudioFileWriter()
+    : fp{nullptr}, wav{false}, failed{false}, sampleRate{0}, framesWritten{0}
+{
+}
+
+AudioFileWriter::~AudioFileWriter()
+{
+    close();
+}
+
+bool AudioFileWriter::writeWavHeader(uint32_t dataSize)
+{
+    const unsigned frameSize = CHANNELS_STEREO * sizeof(float);
+    uint8_t header[WAV_HEADER_SIZE];
+
+    memcpy(header, "RIFF", 4);
+    putLE32(header + 4, WAV_HEADER_SIZE - 8 + dataSize);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + 12, "fmt ", 4);
+    putLE32(header + 16, 16);
+    putLE16(header + 20, WAVE_FORMAT_IEEE_FLOAT);
+    putLE16(header + 22, CHANNELS_STEREO);
+    putLE32(header + 24, sampleRate);
+    putLE32(header + 28, sampleRate * frameSize);
+    putLE16(header + 32, frameSize);
+    putLE16(header + 34, 32);
+    memcpy(header + 36, "data", 4);
+    putLE32(header + 40, dataSize);
+
+    return fwrite(header, sizeof(header), 1, fp) == 1;
+}
+
+bool AudioFileWriter::openWav(const char *path, int sampleRate_)
+{
+    close();
+
+    fp = fopen(path, "wb");
+    if (!fp) {
+        return false;
+    }
+
+    wav = true;
+    failed = false;
+    sampleRate = sampleRate_;
+    framesWritten = 0;
+
+    // The sizes are filled in by close()
+    if (!writeWavHeader(0)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool AudioFileWriter::openRaw(const char *path)
+{
+    close();
+
+    fp = fopen(path, "wb");
+    if (!fp) {
+        return false;
+    }
+
+    wav = false;
+    failed = false;
+    framesWritten = 0;
+    return true;
+}
+
+bool AudioFileWriter::write(const float *const samples[CHANNELS_STEREO],
+                            size_t nsamples)
+{
+    if (!fp || failed) {
+        return false;
+    }
+
+    buf.resize(nsamples * CHANNELS_STEREO * sizeof(float));
+    uint8_t *p = buf.data();
+    for (size_t i = 0; i < nsamples; i++) {
+        for (int ch = 0; ch < CHANNELS_STEREO; ch++) {
+            if (wav) {
+                uint32_t bits;
+                memcpy(&bits, &samples[ch][i], sizeof(bits));
+                putLE32(p, bits);
+            } else {
+                memcpy(p, &samples[ch][i], sizeof(float));
+            }
+            p += sizeof(float);
+        }
+    }
+
+    if (fwrite(buf.data(), buf.size(), 1, fp) != 1 && nsamples > 0) {
+        failed = true;
+        return false;
+    }
+    framesWritten += nsamples;
+    return true;
+}
+
+bool AudioFileWriter::close()
+{
+    if (!fp) {
+        return true;
+    }
+
+    bool ok = !failed;
+
+    // Patch in the final data size
+    if (wav && ok) {
+        uint64_t dataSize = framesWritten * CHANNELS_STEREO * sizeof(float);
+        dataSize = std::min<uint64_t>(dataSize, UINT32_MAX - WAV_HEADER_SIZE);
+
+        ok = fseek(fp, 0, SEEK_SET) == 0 &&
+             writeWavHeader(dataSize);
+    }
+
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    fp = nullptr;
+    return ok;
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "AudioStream.h" // for CHANNELS_STEREO
+
+/*
+ * Minimal audio file I/O for offline rendering.  WAV files with 16-, 24-, or
+ * 32-bit integer or 32-bit float samples can be read and 32-bit float stereo
+ * WAV files are written.  Raw files contain interleaved native-endian 32-bit
+ * float samples without a header.
+ *
+ * Methods return false on I/O or format errors.  These classes are not
+ * real-time safe.
+ */
+class AudioFileReader
+{
+public:
+    AudioFileReader();
+    ~AudioFileReader();
+
+    bool openWav(const char *path);
+    bool openRaw(const char *path, int channels, int sampleRate);
+    void close();
+
+    int getChannels() const;
+    int getSampleRate() const;
+
+    // Reads up to nsamples frames into the stereo buffers and returns the
+    // number of frames read. Mono files are copied into both channels and
+    // channels beyond the first two are ignored.
+    size_t read(float *samples[CHANNELS_STEREO], size_t nsamples);
+
+private:
+    enum Encoding {
+        PCM_16,
+        PCM_24,
+        PCM_32,
+        FLOAT_32,
+        RAW_FLOAT_32, // native-endian
+    };
+
+    FILE *fp;
+    Encoding encoding;
+    int channels;
+    int sampleRate;
+    size_t frameSize; // bytes
+    uint64_t framesLeft;
+    std::vector<uint8_t> buf;
+
+    bool parseWavHeader();
+    static float toFloat(const uint8_t *p, Encoding encoding);
+};
+
+class AudioFileWriter
+{
+public:
+    AudioFileWriter();
+    ~AudioFileWriter();
+
+    bool openWav(const char *path, int sampleRate);
+    bool openRaw(const char *path);
+
+    // Finishes the WAV header, returns false if the file is incomplete
+    bool close();
+
+    bool write(const float *const samples[CHANNELS_STEREO], size_t nsamples);
+
+private:
+    FILE *fp;
+    bool wav;
+    bool failed;
+    int sampleRate;
+    uint64_t framesWritten;
+    std::vector<uint8_t> buf;
+
+    bool writeWavHeader(uint32_t dataSize);
+};
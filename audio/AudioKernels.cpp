@@ -0,0 +1,432 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <math.h>
+#include <stdint.h>
+#include "AudioKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNELS 1
+#endif
+
+/*
+ * Scalar implementations. These are the reference for the vectorized versions
+ * and also handle the tail samples that don't fill a whole vector.
+ */
+
+static void mixSamplesScalar(const float *in, float *out, size_t nsamples,
+                             float vol)
+{
+    for (size_t i = 0; i < nsamples; i++) {
+        out[i] += in[i] * vol;
+    }
+}
+
+static void mixSamplesStereoScalar(const float *in,
+                                   float *outLeft,
+                                   float *outRight,
+                                   size_t nsamples,
+                                   float volLeft,
+                                   float volRight)
+{
+    for (size_t i = 0; i < nsamples; i++) {
+        outLeft[i] += in[i] * volLeft;
+        outRight[i] += in[i] * volRight;
+    }
+}
+
+static void applyGainScalar(const float *in, float *out, size_t nsamples,
+                            float vol)
+{
+    for (size_t i = 0; i < nsamples; i++) {
+        out[i] = in[i] * vol;
+    }
+}
+
+static float updatePeakVolumeScalar(const float *in, size_t nsamples,
+                                    float decay, float peakVolume)
+{
+    for (size_t i = 0; i < nsamples; i++) {
+        const float val = fabsf(in[i]);
+        const float decayed = peakVolume * decay;
+        peakVolume = val > decayed ? val : decayed;
+    }
+
+    return peakVolume;
+}
+
+static const AudioKernels scalarKernels = {
+    "scalar",
+    mixSamplesScalar,
+    mixSamplesStereoScalar,
+    applyGainScalar,
+    updatePeakVolumeScalar,
+};
+
+/*
+ * The peak volume recurrence peak = max(|x[i]|, peak * decay) is serial but
+ * has a closed form. After n samples the peak is the maximum of
+ * |x[i]| * decay^(n - 1 - i) and the old peak * decay^n. Each vector lane keeps
+ * its own running maximum that is decayed by decay^width every iteration and
+ * the lanes are combined at the end. The old peak starts out in the last lane
+ * since it is one sample older than the first sample.
+ */
+
+#ifdef __SSE2__
+static void mixSamplesSSE2(const float *in, float *out, size_t nsamples,
+                           float vol)
+{
+    const __m128 v = _mm_set1_ps(vol);
+    size_t i = 0;
+
+    for (; i + 4 <= nsamples; i += 4) {
+        __m128 x = _mm_loadu_ps(&in[i]);
+        __m128 y = _mm_loadu_ps(&out[i]);
+        _mm_storeu_ps(&out[i], _mm_add_ps(y, _mm_mul_ps(x, v)));
+    }
+
+    mixSamplesScalar(&in[i], &out[i], nsamples - i, vol);
+}
+
+static void mixSamplesStereoSSE2(const float *in,
+                                 float *outLeft,
+                                 float *outRight,
+                                 size_t nsamples,
+                                 float volLeft,
+                                 float volRight)
+{
+    const __m128 vl = _mm_set1_ps(volLeft);
+    const __m128 vr = _mm_set1_ps(volRight);
+    size_t i = 0;
+
+    for (; i + 4 <= nsamples; i += 4) {
+        __m128 x = _mm_loadu_ps(&in[i]);
+        __m128 l = _mm_loadu_ps(&outLeft[i]);
+        __m128 r = _mm_loadu_ps(&outRight[i]);
+        _mm_storeu_ps(&outLeft[i], _mm_add_ps(l, _mm_mul_ps(x, vl)));
+        _mm_storeu_ps(&outRight[i], _mm_add_ps(r, _mm_mul_ps(x, vr)));
+    }
+
+    mixSamplesStereoScalar(&in[i], &outLeft[i], &outRight[i],
+                           nsamples - i, volLeft, volRight);
+}
+
+static void applyGainSSE2(const float *in, float *out, size_t nsamples,
+                          float vol)
+{
+    const __m128 v = _mm_set1_ps(vol);
+    size_t i = 0;
+
+    for (; i + 4 <= nsamples; i += 4) {
+        _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_loadu_ps(&in[i]), v));
+    }
+
+    applyGainScalar(&in[i], &out[i], nsamples - i, vol);
+}
+
+static float updatePeakVolumeSSE2(const float *in, size_t nsamples,
+                                  float decay, float peakVolume)
+{
+    if (nsamples < 4) {
+        return updatePeakVolumeScalar(in, nsamples, decay, peakVolume);
+    }
+
+    const float d2 = decay * decay;
+    const __m128 weights = _mm_set_ps(1.f, decay, d2, d2 * decay);
+    const __m128 decayWidth = _mm_set1_ps(d2 * d2);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 peak = _mm_set_ps(peakVolume, 0.f, 0.f, 0.f);
+    size_t i = 0;
+
+    for (; i + 4 <= nsamples; i += 4) {
+        __m128 x = _mm_and_ps(_mm_loadu_ps(&in[i]), absMask);
+        peak = _mm_max_ps(_mm_mul_ps(peak, decayWidth),
+                          _mm_mul_ps(x, weights));
+    }
+
+    peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(1, 0, 3, 2)));
+    peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(2, 3, 0, 1)));
+    peakVolume = _mm_cvtss_f32(peak);
+
+    return updatePeakVolumeScalar(&in[i], nsamples - i, decay, peakVolume);
+}
+
+static const AudioKernels sse2Kernels = {
+    "sse2",
+    mixSamplesSSE2,
+    mixSamplesStereoSSE2,
+    applyGainSSE2,
+    updatePeakVolumeSSE2,
+};
+#endif /* __SSE2__ */
+
+#ifdef HAVE_X86_KERNELS
+#define AVX2_FMA __attribute__((target("avx2,fma")))
+
+AVX2_FMA
+static void mixSamplesAVX2(const float *in, float *out, size_t nsamples,
+                           float vol)
+{
+    const __m256 v = _mm256_set1_ps(vol);
+    size_t i = 0;
+
+    for (; i + 8 <= nsamples; i += 8) {
+        __m256 x = _mm256_loadu_ps(&in[i]);
+        __m256 y = _mm256_loadu_ps(&out[i]);
+        _mm256_storeu_ps(&out[i], _mm256_fmadd_ps(x, v, y));
+    }
+
+    mixSamplesScalar(&in[i], &out[i], nsamples - i, vol);
+}
+
+AVX2_FMA
+static void mixSamplesStereoAVX2(const float *in,
+                                 float *outLeft,
+                                 float *outRight,
+                                 size_t nsamples,
+                                 float volLeft,
+                                 float volRight)
+{
+    const __m256 vl = _mm256_set1_ps(volLeft);
+    const __m256 vr = _mm256_set1_ps(volRight);
+    size_t i = 0;
+
+    for (; i + 8 <= nsamples; i += 8) {
+        __m256 x = _mm256_loadu_ps(&in[i]);
+        __m256 l = _mm256_loadu_ps(&outLeft[i]);
+        __m256 r = _mm256_loadu_ps(&outRight[i]);
+        _mm256_storeu_ps(&outLeft[i], _mm256_fmadd_ps(x, vl, l));
+        _mm256_storeu_ps(&outRight[i], _mm256_fmadd_ps(x, vr, r));
+    }
+
+    mixSamplesStereoScalar(&in[i], &outLeft[i], &outRight[i],
+                           nsamples - i, volLeft, volRight);
+}
+
+AVX2_FMA
+static void applyGainAVX2(const float *in, float *out, size_t nsamples,
+                          float vol)
+{
+    const __m256 v = _mm256_set1_ps(vol);
+    size_t i = 0;
+
+    for (; i + 8 <= nsamples; i += 8) {
+        _mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_loadu_ps(&in[i]), v));
+    }
+
+    applyGainScalar(&in[i], &out[i], nsamples - i, vol);
+}
+
+AVX2_FMA
+static float updatePeakVolumeAVX2(const float *in, size_t nsamples,
+                                  float decay, float peakVolume)
+{
+    if (nsamples < 8) {
+        return updatePeakVolumeScalar(in, nsamples, decay, peakVolume);
+    }
+
+    float w[8];
+    w[7] = 1.f;
+    for (int j = 6; j >= 0; j--) {
+        w[j] = w[j + 1] * decay;
+    }
+
+    const __m256 weights = _mm256_loadu_ps(w);
+    const __m256 decayWidth = _mm256_set1_ps(w[0] * decay);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 peak = _mm256_set_ps(peakVolume, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f);
+    size_t i = 0;
+
+    for (; i + 8 <= nsamples; i += 8) {
+        __m256 x = _mm256_and_ps(_mm256_loadu_ps(&in[i]), absMask);
+        peak = _mm256_max_ps(_mm256_mul_ps(peak, decayWidth),
+                             _mm256_mul_ps(x, weights));
+    }
+
+    __m128 half = _mm_max_ps(_mm256_castps256_ps128(peak),
+                             _mm256_extractf128_ps(peak, 1));
+    half = _mm_max_ps(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_max_ps(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(2, 3, 0, 1)));
+    peakVolume = _mm_cvtss_f32(half);
+
+    return updatePeakVolumeScalar(&in[i], nsamples - i, decay, peakVolume);
+}
+
+static const AudioKernels avx2Kernels = {
+    "avx2",
+    mixSamplesAVX2,
+    mixSamplesStereoAVX2,
+    applyGainAVX2,
+    updatePeakVolumeAVX2,
+};
+
+// Returns true if the CPU and OS support AVX2 and FMA
+static bool cpuHasAVX2FMA()
+{
+    unsigned eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+
+    const bool osxsave = ecx & (1u << 27);
+    const bool avx = ecx & (1u << 28);
+    const bool fma = ecx & (1u << 12);
+    if (!osxsave || !avx || !fma) {
+        return false;
+    }
+
+    // The OS must save the AVX registers on context switch
+    uint32_t xcr0Lo, xcr0Hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0Lo), "=d"(xcr0Hi) : "c"(0));
+    if ((xcr0Lo & 0x6) != 0x6) {
+        return false;
+    }
+
+    if (__get_cpuid_max(0, nullptr) < 7) {
+        return false;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return ebx & (1u << 5);
+}
+#endif /* HAVE_X86_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+// Multiply-accumulate a + b * c, fused where the architecture supports it
+static inline float32x4_t neonMulAdd(float32x4_t a, float32x4_t b,
+                                     float32x4_t c)
+{
+#ifdef __aarch64__
+    return vfmaq_f32(a, b, c);
+#else
+    return vmlaq_f32(a, b, c);
+#endif
+}
+
+static void mixSamplesNEON(const float *in, float *out, size_t nsamples,
+                           float vol)
+{
+    const float32x4_t v = vdupq_n_f32(vol);
+    size_t i = 0;
+
+    for (; i + 4 <= nsamples; i += 4) {
+        float32x4_t x = vld1q_f32(&in[i]);
+        float32x4_t y = vld1q_f32(&out[i]);
+        vst1q_f32(&out[i], neonMulAdd(y, x, v));
+    }
+
+    mixSamplesScalar(&in[i], &out[i], nsamples - i, vol);
+}
+
+static void mixSamplesStereoNEON(const float *in,
+                                 float *outLeft,
+                                 float *outRight,
+                                 size_t nsamples,
+                                 float volLeft,
+                                 float volRight)
+{
+    const float32x4_t vl = vdupq_n_f32(volLeft);
+    const float32x4_t vr = vdupq_n_f32(volRight);
+    size_t i = 0;
+
+    for (; i + 4 <= nsamples; i += 4) {
+        float32x4_t x = vld1q_f32(&in[i]);
+        float32x4_t l = vld1q_f32(&outLeft[i]);
+        float32x4_t r = vld1q_f32(&outRight[i]);
+        vst1q_f32(&outLeft[i], neonMulAdd(l, x, vl));
+        vst1q_f32(&outRight[i], neonMulAdd(r, x, vr));
+    }
+
+    mixSamplesStereoScalar(&in[i], &outLeft[i], &outRight[i],
+                           nsamples - i, volLeft, volRight);
+}
+
+static void applyGainNEON(const float *in, float *out, size_t nsamples,
+                          float vol)
+{
+    const float32x4_t v = vdupq_n_f32(vol);
+    size_t i = 0;
+
+    for (; i + 4 <= nsamples; i += 4) {
+        vst1q_f32(&out[i], vmulq_f32(vld1q_f32(&in[i]), v));
+    }
+
+    applyGainScalar(&in[i], &out[i], nsamples - i, vol);
+}
+
+static float updatePeakVolumeNEON(const float *in, size_t nsamples,
+                                  float decay, float peakVolume)
+{
+    if (nsamples < 4) {
+        return updatePeakVolumeScalar(in, nsamples, decay, peakVolume);
+    }
+
+    const float d2 = decay * decay;
+    const float w[4] = {d2 * decay, d2, decay, 1.f};
+    const float p[4] = {0.f, 0.f, 0.f, peakVolume};
+    const float32x4_t weights = vld1q_f32(w);
+    const float32x4_t decayWidth = vdupq_n_f32(d2 * d2);
+    float32x4_t peak = vld1q_f32(p);
+    size_t i = 0;
+
+    for (; i + 4 <= nsamples; i += 4) {
+        float32x4_t x = vabsq_f32(vld1q_f32(&in[i]));
+        peak = vmaxq_f32(vmulq_f32(peak, decayWidth), vmulq_f32(x, weights));
+    }
+
+#ifdef __aarch64__
+    peakVolume = vmaxvq_f32(peak);
+#else
+    float32x2_t half = vpmax_f32(vget_low_f32(peak), vget_high_f32(peak));
+    half = vpmax_f32(half, half);
+    peakVolume = vget_lane_f32(half, 0);
+#endif
+
+    return updatePeakVolumeScalar(&in[i], nsamples - i, decay, peakVolume);
+}
+
+static const AudioKernels neonKernels = {
+    "neon",
+    mixSamplesNEON,
+    mixSamplesStereoNEON,
+    applyGainNEON,
+    updatePeakVolumeNEON,
+};
+#endif /* HAVE_NEON_KERNELS */
+
+std::vector<const AudioKernels *> supportedAudioKernels()
+{
+    std::vector<const AudioKernels *> kernels;
+
+#ifdef HAVE_X86_KERNELS
+    if (cpuHasAVX2FMA()) {
+        kernels.push_back(&avx2Kernels);
+    }
+#endif
+#ifdef __SSE2__
+    kernels.push_back(&sse2Kernels);
+#endif
+#ifdef HAVE_NEON_KERNELS
+    kernels.push_back(&neonKernels);
+#endif
+    kernels.push_back(&scalarKernels);
+    return kernels;
+}
+
+// Constant initialized so kernels can be used before dynamic initialization
+const AudioKernels *audioKernels = &scalarKernels;
+
+namespace {
+struct AudioKernelsSelector
+{
+    AudioKernelsSelector()
+    {
+        audioKernels = supportedAudioKernels().front();
+    }
+} audioKernelsSelector;
+}
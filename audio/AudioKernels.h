@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Mark a method safe to call from real-time code
+#define realtime
+
+/*
+ * Sample processing kernels used by the mixer.  There are portable scalar
+ * implementations plus vectorized SSE2, AVX2+FMA, and NEON implementations.
+ * The best implementation supported by the CPU is selected once at startup
+ * and is available through audioKernels.
+ *
+ * Peak volume is a peak hold with exponential decay: each sample either raises
+ * the peak or the peak is multiplied by the decay factor, whichever is larger.
+ */
+struct AudioKernels
+{
+    const char *name;
+
+    // out[i] += in[i] * vol
+    realtime void (*mixSamples)(const float *in, float *out, size_t nsamples,
+                                float vol);
+
+    // Mix a mono input into both stereo channels in a single pass
+    realtime void (*mixSamplesStereo)(const float *in,
+                                      float *outLeft,
+                                      float *outRight,
+                                      size_t nsamples,
+                                      float volLeft,
+                                      float volRight);
+
+    // out[i] = in[i] * vol, in and out may be the same buffer
+    realtime void (*applyGain)(const float *in, float *out, size_t nsamples,
+                               float vol);
+
+    // Returns the new peak volume
+    realtime float (*updatePeakVolume)(const float *in, size_t nsamples,
+                                       float decay, float peakVolume);
+};
+
+// The kernels selected for this CPU
+extern const AudioKernels *audioKernels;
+
+// Returns all kernel implementations supported by this CPU, best first. The
+// portable scalar implementation is always last. Useful for testing.
+std::vector<const AudioKernels *> supportedAudioKernels();
+
+#undef realtime
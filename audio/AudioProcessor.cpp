@@ -1,11 +1,16 @@
 // SPDX-License-Identifier: Apache-2.0
 #include <assert.h>
 #include <string.h>
+#include <algorithm>
+#include <chrono>
 #include "AudioProcessor.h"
 
 AudioProcessor::AudioProcessor()
     : rcu{},
-      playbackStreams{&rcu, new PlaybackStreams},
+      playbackTable{&rcu, new PlaybackTable{{}, 0}},
+      pendingTable{nullptr},
+      tableVersion{0},
+      transactionDepth{0},
       captureStreams{
           {AudioStream::CAPTURE, false},
           {AudioStream::CAPTURE, false}
@@ -15,7 +20,11 @@ AudioProcessor::AudioProcessor()
       nextSampleTime{0},
       masterGain{1.f},
       masterPeakVolume{{0.f}, {0.f}},
-      peakVolumeDecay{1.f}
+      peakVolumeDecay{1.f},
+      bufferMsec{GENEROUS_BUFFER_MSEC},
+      lowWaterMsec{0},
+      lowWaterSamples{0},
+      serviceRequested{false}
 {
 }
 
@@ -23,37 +32,149 @@ AudioProcessor::~AudioProcessor()
 {
     // No streams should be left. Their owner has a pointer so we cannot delete
     // them here.
-    assert(playbackStreams.load()->empty());
+    assert(playbackTable.load()->size == 0);
+    assert(transactionDepth == 0);
 
-    // Delete the playback streams vector itself
-    playbackStreams.store(nullptr);
+    // Delete the playback table itself
+    playbackTable.store(nullptr);
+}
+
+AudioProcessor::PlaybackChunk::PlaybackChunk(uint64_t version_)
+    : version{version_}, size{0}
+{
+}
+
+AudioProcessor::PlaybackChunk::PlaybackChunk(const PlaybackChunk &other,
+                                             uint64_t version_)
+    : version{version_}, size{other.size}
+{
+    for (size_t i = 0; i < size; i++) {
+        streams[i] = other.streams[i];
+        volLeft[i].store(other.volLeft[i].load());
+        volRight[i].store(other.volRight[i].load());
+        monitor[i].store(other.monitor[i].load());
+    }
+}
+
+void AudioProcessor::PlaybackChunk::setStream(size_t i, AudioStream *stream)
+{
+    float left, right;
+    stream->getStereoVolume(&left, &right);
+
+    streams[i] = stream;
+    volLeft[i].store(left);
+    volRight[i].store(right);
+    monitor[i].store(stream->monitorEnabled());
+}
+
+// Load mix parameters from the streams, called from the non-real-time thread
+void AudioProcessor::PlaybackChunk::refreshParams()
+{
+    for (size_t i = 0; i < size; i++) {
+        setStream(i, streams[i]);
+    }
+}
+
+// Returns the unpublished table that the current transaction modifies
+AudioProcessor::PlaybackTable *AudioProcessor::editPlaybackTable()
+{
+    if (!pendingTable) {
+        pendingTable = new PlaybackTable{*playbackTable.load()};
+        tableVersion++;
+    }
+    return pendingTable;
+}
+
+// Copy-on-write a chunk of the pending table
+AudioProcessor::PlaybackChunk *AudioProcessor::editPlaybackChunk(size_t index)
+{
+    std::shared_ptr<PlaybackChunk> &chunk = pendingTable->chunks[index];
+    if (chunk->version != tableVersion) {
+        chunk = std::make_shared<PlaybackChunk>(*chunk, tableVersion);
+    }
+    return chunk.get();
+}
+
+void AudioProcessor::beginPlaybackStreamTransaction()
+{
+    transactionDepth++;
+}
+
+void AudioProcessor::commitPlaybackStreamTransaction()
+{
+    assert(transactionDepth > 0);
+    if (--transactionDepth > 0) {
+        return;
+    }
+
+    if (pendingTable) {
+        playbackTable.store(pendingTable); // RCU delete the old table
+        pendingTable = nullptr;
+    }
+
+    // RCU delete removed streams after the mixer stops seeing them
+    if (!removedStreams.empty()) {
+        std::vector<AudioStream *> streams;
+        streams.swap(removedStreams);
+        rcu.addReclaimItem([streams]() {
+            for (AudioStream *stream : streams) {
+                delete stream;
+            }
+        });
+    }
 }
 
 void AudioProcessor::addPlaybackStream(AudioStream *stream)
 {
     size_t nsamples = running.load() ?
-        msecToSamples(getSampleRate(), GENEROUS_BUFFER_MSEC) : 0;
+        msecToSamples(getSampleRate(), bufferMsec) : 0;
     stream->setSampleBufferSize(nsamples);
     stream->setPeakVolumeDecay(peakVolumeDecay);
 
-    auto newStreams = new PlaybackStreams{*playbackStreams.load()};
-    newStreams->push_back(RCUPointer<AudioStream>{&rcu, stream});
-    playbackStreams.store(newStreams);
+    PlaybackStreamTransaction transaction{this};
+    PlaybackTable *table = editPlaybackTable();
+
+    const size_t pos = table->size++;
+    const size_t index = pos / PLAYBACK_CHUNK_SIZE;
+    if (index == table->chunks.size()) {
+        table->chunks.push_back(std::make_shared<PlaybackChunk>(tableVersion));
+    }
+
+    PlaybackChunk *chunk = editPlaybackChunk(index);
+    chunk->setStream(chunk->size++, stream);
+    playbackStreamIndex[stream] = pos;
 }
 
 void AudioProcessor::removePlaybackStream(AudioStream *stream)
 {
-    auto newStreams = new PlaybackStreams{*playbackStreams.load()};
+    auto found = playbackStreamIndex.find(stream);
+    if (found == playbackStreamIndex.end()) {
+        return;
+    }
 
-    for (auto i = newStreams->begin(); i != newStreams->end(); ++i) {
-        if ((*i).load() == stream) {
-            (*i).store(nullptr);    // RCU delete the stream itself
-            newStreams->erase(i);
-            break;
-        }
+    const size_t pos = found->second;
+    playbackStreamIndex.erase(found);
+
+    PlaybackStreamTransaction transaction{this};
+    PlaybackTable *table = editPlaybackTable();
+
+    // Move the last stream into the hole so that chunks stay packed
+    const size_t last = --table->size;
+    PlaybackChunk *lastChunk = editPlaybackChunk(last / PLAYBACK_CHUNK_SIZE);
+    AudioStream *lastStream = lastChunk->streams[last % PLAYBACK_CHUNK_SIZE];
+    lastChunk->size--;
+
+    if (pos != last) {
+        PlaybackChunk *chunk = editPlaybackChunk(pos / PLAYBACK_CHUNK_SIZE);
+        chunk->setStream(pos % PLAYBACK_CHUNK_SIZE, lastStream);
+        playbackStreamIndex[lastStream] = pos;
+    }
+
+    if (lastChunk->size == 0) {
+        table->chunks.pop_back();
     }
 
-    playbackStreams.store(newStreams);
+    removedStreams.push_back(stream);
 }
 
 AudioStream &AudioProcessor::captureStream(int channel)
@@ -63,7 +184,44 @@ AudioStream &AudioProcessor::captureStream(int channel)
 
 void AudioProcessor::tick()
 {
+    for (auto &chunk : playbackTable.load()->chunks) {
+        chunk->refreshParams();
+    }
     rcu.reclaim();
+
+    serviceRequested.store(false);
+}
+
+void AudioProcessor::setWatermarks(int bufferMsec_, int lowWaterMsec_)
+{
+    assert(!isRunning());
+    assert(lowWaterMsec_ < bufferMsec_);
+
+    bufferMsec = bufferMsec_;
+    lowWaterMsec = lowWaterMsec_;
+    lowWaterSamples.store(0); // set by setRunning() once the rate is known
+}
+
+bool AudioProcessor::waitForServiceRequest(std::chrono::milliseconds timeout)
+{
+    return serviceWakeup.wait(timeout) && serviceRequested.load();
+}
+
+void AudioProcessor::interruptServiceWait()
+{
+    serviceWakeup.post();
+}
+
+// Request service when a stream crosses the low-water mark. before and after
+// are the samples queued (playback) or free space (capture).
+void AudioProcessor::checkLowWater(size_t before, size_t after)
+{
+    const size_t lowWater = lowWaterSamples.load(std::memory_order_relaxed);
+
+    if (after < lowWater && before >= lowWater &&
+        !serviceRequested.exchange(true)) {
+        serviceWakeup.post();
+    }
 }
 
 SampleTime AudioProcessor::getNextSampleTime() const
@@ -76,7 +234,9 @@ void AudioProcessor::processInputs(float *inOutSamples[CHANNELS_STEREO], size_t
     for (int ch = 0; ch < CHANNELS_STEREO; ch++) {
         AudioStream &input = captureStream(ch);
 
-        input.write(now, inOutSamples[ch], nsamples);
+        size_t nwritten = input.write(now, inOutSamples[ch], nsamples);
+        size_t space = input.numSamplesWritable();
+        checkLowWater(space + nwritten, space);
 
         // Apply gain to monitor signal
         if (input.monitorEnabled()) {
@@ -87,22 +247,128 @@ void AudioProcessor::processInputs(float *inOutSamples[CHANNELS_STEREO], size_t
     }
 }
 
+// Mix streams at table positions begin up to end into out
+void AudioProcessor::mixStreamRange(PlaybackTable *table,
+                                    size_t begin, size_t end,
+                                    float *out[CHANNELS_STEREO],
+                                    size_t nsamples, SampleTime now)
+{
+    while (begin < end) {
+        PlaybackChunk *chunk = table->chunks[begin / PLAYBACK_CHUNK_SIZE].get();
+        const size_t first = begin % PLAYBACK_CHUNK_SIZE;
+        const size_t last = std::min<size_t>(first + (end - begin), chunk->size);
+
+        for (size_t i = first; i < last; i++) {
+            AudioStream *stream = chunk->streams[i];
+            const uint32_t underruns = stream->getUnderruns();
+            size_t nread;
+
+            if (chunk->monitor[i].load()) {
+                nread = stream->readMixStereo(now, out, nsamples,
+                                              chunk->volLeft[i].load(),
+                                              chunk->volRight[i].load());
+            } else {
+                nread = stream->readDiscard(now, nsamples);
+            }
+
+            // AudioStream decides what counts as an underrun
+            if (stream->getUnderruns() != underruns) {
+                audioStats.addStreamUnderrun();
+            }
+
+            size_t queued = stream->numSamplesReadable();
+            checkLowWater(queued + nread, queued);
+        }
+
+        begin += last - first;
+    }
+}
+
+// Runs on each parallel mix thread. Threads claim batches of streams until
+// there are none left.
+void AudioProcessor::mixJobFn(void *opaque, unsigned int participant)
+{
+    AudioProcessor *processor = static_cast<AudioProcessor *>(opaque);
+    MixJob &job = processor->mixJob;
+    float *bus[CHANNELS_STEREO];
+
+    // The audio thread mixes straight into the output
+    if (participant == 0) {
+        bus[CHANNEL_LEFT] = job.out[CHANNEL_LEFT];
+        bus[CHANNEL_RIGHT] = job.out[CHANNEL_RIGHT];
+    } else {
+        for (int ch = 0; ch < CHANNELS_STEREO; ch++) {
+            size_t busIndex = (participant - 1) * CHANNELS_STEREO + ch;
+            bus[ch] = &processor->mixBuses[busIndex * MAX_PARALLEL_MIX_SAMPLES];
+            memset(bus[ch], 0, job.nsamples * sizeof(float));
+        }
+    }
+
+    const size_t nstreams = job.table->size;
+    while (true) {
+        size_t begin = job.nextStream.fetch_add(MIX_BATCH_SIZE,
+                                                std::memory_order_relaxed);
+        if (begin >= nstreams) {
+            break;
+        }
+
+        size_t end = std::min<size_t>(begin + MIX_BATCH_SIZE, nstreams);
+        processor->mixStreamRange(job.table, begin, end, bus,
+                                  job.nsamples, job.now);
+    }
+}
+
 void AudioProcessor::mixPlaybackStreams(float *inOutSamples[CHANNELS_STEREO], size_t nsamples, SampleTime now)
 {
-    PlaybackStreams *streams = playbackStreams.load();
+    PlaybackTable *table = playbackTable.load();
 
-    for (auto streamPointer : *streams) {
-        AudioStream *stream = streamPointer.load();
+    if (!mixWorkers ||
+        nsamples > MAX_PARALLEL_MIX_SAMPLES ||
+        table->size <= MIX_BATCH_SIZE) {
+        mixStreamRange(table, 0, table->size, inOutSamples, nsamples, now);
+        return;
+    }
 
-        if (!stream->monitorEnabled()) {
-            stream->readDiscard(now, nsamples);
-            continue;
+    // Workers only use the table while we wait for them, so our RCU read
+    // lock covers them
+    mixJob.table = table;
+    mixJob.out = inOutSamples;
+    mixJob.nsamples = nsamples;
+    mixJob.now = now;
+    mixJob.nextStream.store(0, std::memory_order_relaxed);
+
+    mixWorkers->run(mixJobFn, this);
+
+    // Sum the partial buses
+    const unsigned int nworkers = mixWorkers->numWorkers();
+    for (unsigned int w = 0; w < nworkers; w++) {
+        for (int ch = 0; ch < CHANNELS_STEREO; ch++) {
+            size_t busIndex = w * CHANNELS_STEREO + ch;
+            mixSamples(&mixBuses[busIndex * MAX_PARALLEL_MIX_SAMPLES],
+                       inOutSamples[ch], nsamples, 1.f);
         }
+    }
+}
+
+void AudioProcessor::setMixThreads(unsigned int nthreads)
+{
+    assert(!isRunning());
+
+    mixWorkers.reset();
+    mixBuses.clear();
 
-        stream->readMixStereo(now, inOutSamples, nsamples);
+    if (nthreads > 1) {
+        mixWorkers.reset(new MixWorkerPool{nthreads - 1});
+        mixBuses.resize((nthreads - 1) * CHANNELS_STEREO *
+                        MAX_PARALLEL_MIX_SAMPLES);
     }
 }
 
+unsigned int AudioProcessor::getMixThreads() const
+{
+    return mixWorkers ? mixWorkers->numWorkers() + 1 : 1;
+}
+
 void AudioProcessor::process(float *inOutSamples[CHANNELS_STEREO],
                              size_t nsamples,
                              SampleTime now)
@@ -118,6 +384,8 @@ void AudioProcessor::process(float *inOutSamples[CHANNELS_STEREO],
         return;
     }
 
+    const auto startTime = std::chrono::steady_clock::now();
+
     processInputs(inOutSamples, nsamples, now);
     mixPlaybackStreams(inOutSamples, nsamples, now);
 
@@ -130,6 +398,16 @@ void AudioProcessor::process(float *inOutSamples[CHANNELS_STEREO],
                                 peakVolumeDecay, peak);
         masterPeakVolume[ch].store(peak);
     }
+
+    const auto duration = std::chrono::steady_clock::now() - startTime;
+    audioStats.addCallback(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(),
+            nsamples * UINT64_C(1000000000) / getSampleRate());
+}
+
+AudioStats *AudioProcessor::stats()
+{
+    return &audioStats;
 }
 
 int AudioProcessor::getSampleRate() const
@@ -165,10 +443,10 @@ void AudioProcessor::setSampleBufferSize(size_t nsamples)
         captureStreams[ch].setSampleBufferSize(nsamples);
     }
 
-    for (auto streamPointer : *playbackStreams.load()) {
-        AudioStream *stream = streamPointer.load();
-
-        stream->setSampleBufferSize(nsamples);
+    for (auto &chunk : playbackTable.load()->chunks) {
+        for (size_t i = 0; i < chunk->size; i++) {
+            chunk->streams[i]->setSampleBufferSize(nsamples);
+        }
     }
 }
 
@@ -178,10 +456,10 @@ void AudioProcessor::setPeakVolumeDecay()
         captureStreams[ch].setPeakVolumeDecay(peakVolumeDecay);
     }
 
-    for (auto streamPointer : *playbackStreams.load()) {
-        AudioStream *stream = streamPointer.load();
-
-        stream->setPeakVolumeDecay(peakVolumeDecay);
+    for (auto &chunk : playbackTable.load()->chunks) {
+        for (size_t i = 0; i < chunk->size; i++) {
+            chunk->streams[i]->setPeakVolumeDecay(peakVolumeDecay);
+        }
     }
 }
 
@@ -192,9 +470,15 @@ void AudioProcessor::setRunning(bool enabled)
     }
 
     if (enabled) {
-        size_t nsamples = msecToSamples(getSampleRate(), GENEROUS_BUFFER_MSEC);
+        size_t nsamples = msecToSamples(getSampleRate(), bufferMsec);
         setSampleBufferSize(nsamples);
+        if (lowWaterMsec) {
+            lowWaterSamples.store(msecToSamples(getSampleRate(), lowWaterMsec));
+        }
         setPeakVolumeDecay();
+        for (auto &chunk : playbackTable.load()->chunks) {
+            chunk->refreshParams();
+        }
     }
 
     running.store(enabled);
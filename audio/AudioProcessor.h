@@ -1,8 +1,14 @@
 // SPDX-License-Identifier: Apache-2.0
 #pragma once
 
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include "rcu.h"
+#include "AudioStats.h"
 #include "AudioStream.h"
+#include "MixWorkerPool.h"
+#include "Semaphore.h"
 
 // Mark a method safe to call from real-time code
 #define realtime
@@ -17,6 +23,17 @@
  * The non-realtime thread owns the AudioProcessor.  It calls setRunning() to
  * enable/disable stream processing.  It calls tick() periodically.  It reads
  * audio from capture streams and writes audio to playback streams.
+ *
+ * Playback stream gain, pan, and monitor changes take effect at the next
+ * tick().  Adding and removing playback streams can be batched with
+ * PlaybackStreamTransaction so the real-time thread sees all changes at once.
+ *
+ * Playback streams can optionally be mixed in parallel by a pool of worker
+ * threads, see setMixThreads().
+ *
+ * Instead of relying on the periodic tick alone, the non-real-time thread
+ * can wait for service requests from the real-time thread, see
+ * setWatermarks().  This allows smaller stream buffers.
  */
 class AudioProcessor
 {
@@ -30,8 +47,35 @@ public:
     // Takes ownership of stream
     void removePlaybackStream(AudioStream *stream);
 
+    // Defer publishing playback stream additions and removals until the
+    // matching commit. Transactions may be nested. See also
+    // PlaybackStreamTransaction.
+    void beginPlaybackStreamTransaction();
+    void commitPlaybackStreamTransaction();
+
     AudioStream &captureStream(int channel);
 
+    // Mix playback streams on nthreads threads, including the real-time audio
+    // thread. Each worker thread mixes into its own partial bus and the buses
+    // are summed at the end. 1 disables parallel mixing. Call while not
+    // running.
+    void setMixThreads(unsigned int nthreads);
+    unsigned int getMixThreads() const;
+
+    // Size stream buffers for bufferMsec of audio and request service when a
+    // playback stream drops below lowWaterMsec of queued audio or a capture
+    // stream has less than lowWaterMsec of space left. Requests are edge
+    // triggered so streams nobody services do not cause repeated requests.
+    // lowWaterMsec 0 disables service requests. Call while not running.
+    void setWatermarks(int bufferMsec, int lowWaterMsec);
+
+    // Wait until the real-time thread requests service, returns false on
+    // timeout. Call tick() after servicing streams to allow the next request.
+    bool waitForServiceRequest(std::chrono::milliseconds timeout);
+
+    // Wake up waitForServiceRequest() without a request, e.g. to shut down
+    void interruptServiceWait();
+
     // Call this periodically from the non-real-time thread
     void tick();
 
@@ -49,14 +93,78 @@ public:
     // Get next expected sample time, may be called from any thread
     realtime SampleTime getNextSampleTime() const;
 
+    // DSP load, xrun, and underrun counters, may be used from any thread
+    AudioStats *stats();
+
     // The heart of the real-time audio processing
     realtime void process(float *inOutSamples[CHANNELS_STEREO], size_t nsamples, SampleTime now);
 
 private:
     RCUContext rcu;
 
-    typedef std::vector<RCUPointer<AudioStream>> PlaybackStreams;
-    RCUPointer<PlaybackStreams> playbackStreams;
+    enum { PLAYBACK_CHUNK_SIZE = 16 };
+
+    /*
+     * The mixer's view of the playback streams.  Per-stream mix parameters are
+     * kept in parallel arrays so the mix loop walks linear memory instead of
+     * loading gain, pan, and monitor from each AudioStream.  Parameters are
+     * refreshed in place by tick().
+     *
+     * Streams are stored in fixed-size chunks that are shared between table
+     * versions.  Adding or removing a stream copies the chunk directory and at
+     * most two chunks, the rest of the table is untouched.  All chunks are
+     * full except the last one.
+     */
+    struct PlaybackChunk
+    {
+        PlaybackChunk(uint64_t version_);
+        PlaybackChunk(const PlaybackChunk &other, uint64_t version_);
+
+        void setStream(size_t i, AudioStream *stream);
+        void refreshParams();
+
+        uint64_t version; // table version that created this chunk
+        size_t size;
+        AudioStream *streams[PLAYBACK_CHUNK_SIZE];
+        std::atomic<float> volLeft[PLAYBACK_CHUNK_SIZE];
+        std::atomic<float> volRight[PLAYBACK_CHUNK_SIZE];
+        std::atomic<bool> monitor[PLAYBACK_CHUNK_SIZE];
+    };
+
+    struct PlaybackTable
+    {
+        std::vector<std::shared_ptr<PlaybackChunk>> chunks;
+        size_t size; // number of streams
+    };
+    RCUPointer<PlaybackTable> playbackTable;
+
+    enum {
+        // Streams claimed at a time by a parallel mix thread
+        MIX_BATCH_SIZE = 4,
+
+        // Larger blocks are mixed on the real-time audio thread only
+        MAX_PARALLEL_MIX_SAMPLES = 4096,
+    };
+
+    // The parallel mix job for the current audio callback
+    struct MixJob
+    {
+        PlaybackTable *table;
+        float **out;
+        size_t nsamples;
+        SampleTime now;
+        std::atomic<size_t> nextStream; // next unclaimed stream position
+    };
+    MixJob mixJob;
+    std::unique_ptr<MixWorkerPool> mixWorkers;
+    std::vector<float> mixBuses; // partial stereo bus per worker
+
+    // Writer state for building the next table version
+    PlaybackTable *pendingTable; // not yet visible to the mixer
+    uint64_t tableVersion;
+    unsigned int transactionDepth;
+    std::unordered_map<AudioStream *, size_t> playbackStreamIndex;
+    std::vector<AudioStream *> removedStreams; // deleted after publishing
 
     AudioStream captureStreams[CHANNELS_STEREO];
 
@@ -66,13 +174,47 @@ private:
     std::atomic<float> masterGain;
     std::atomic<float> masterPeakVolume[CHANNELS_STEREO];
     float peakVolumeDecay;
+    AudioStats audioStats;
 
+    // Watermark service requests
+    int bufferMsec;
+    int lowWaterMsec; // 0 if disabled
+    std::atomic<size_t> lowWaterSamples;
+    std::atomic<bool> serviceRequested;
+    Semaphore serviceWakeup;
+
+    PlaybackTable *editPlaybackTable();
+    PlaybackChunk *editPlaybackChunk(size_t index);
     void setSampleBufferSize(size_t nsamples);
     void setPeakVolumeDecay();
+    realtime void checkLowWater(size_t before, size_t after);
     void processInputs(float *inOutSamples[CHANNELS_STEREO],
                        size_t nsamples, SampleTime now);
     void mixPlaybackStreams(float *inOutSamples[CHANNELS_STEREO],
                             size_t nsamples, SampleTime now);
+    void mixStreamRange(PlaybackTable *table, size_t begin, size_t end,
+                        float *out[CHANNELS_STEREO],
+                        size_t nsamples, SampleTime now);
+    static void mixJobFn(void *opaque, unsigned int participant);
+};
+
+// Batches playback stream additions and removals in a scope
+class PlaybackStreamTransaction
+{
+public:
+    PlaybackStreamTransaction(AudioProcessor *processor_)
+        : processor{processor_}
+    {
+        processor->beginPlaybackStreamTransaction();
+    }
+
+    ~PlaybackStreamTransaction()
+    {
+        processor->commitPlaybackStreamTransaction();
+    }
+
+private:
+    AudioProcessor *processor;
 };
 
 #undef realtime
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "AudioStats.h"
+
+// Raise an atomic maximum
+template<typename T>
+static void storeMax(std::atomic<T> &max, T value)
+{
+    T old = max.load(std::memory_order_relaxed);
+    while (value > old &&
+           !max.compare_exchange_weak(old, value, std::memory_order_relaxed)) {
+        // Try again
+    }
+}
+
+AudioStats::AudioStats()
+{
+    reset();
+}
+
+void AudioStats::addCallback(uint64_t durationNsec, uint64_t blockNsec)
+{
+    if (blockNsec == 0) {
+        return;
+    }
+
+    const float load = static_cast<float>(durationNsec) / blockNsec;
+    size_t bucket = static_cast<size_t>(load * (LOAD_BUCKETS - 1));
+    if (bucket >= LOAD_BUCKETS) {
+        bucket = LOAD_BUCKETS - 1;
+    }
+
+    callbacks.fetch_add(1, std::memory_order_relaxed);
+    loadHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    storeMax(maxLoad, load);
+    storeMax(peakLoad, load);
+}
+
+void AudioStats::addXrun(Xrun type)
+{
+    xruns[type].fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioStats::addStreamUnderrun()
+{
+    streamUnderruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioStats::addTick(int64_t jitterNsec)
+{
+    const uint64_t jitter = jitterNsec < 0 ? -jitterNsec : jitterNsec;
+
+    size_t bucket = 0;
+    for (uint64_t msec = jitter / 1000000; msec > 0; msec >>= 1) {
+        bucket++;
+    }
+    if (bucket >= JITTER_BUCKETS) {
+        bucket = JITTER_BUCKETS - 1;
+    }
+
+    ticks.fetch_add(1, std::memory_order_relaxed);
+    jitterHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    storeMax(maxTickJitterNsec, jitter);
+}
+
+float AudioStats::takePeakLoad()
+{
+    return peakLoad.exchange(0.f, std::memory_order_relaxed);
+}
+
+AudioStats::Snapshot AudioStats::snapshot() const
+{
+    Snapshot snap;
+
+    snap.callbacks = callbacks.load(std::memory_order_relaxed);
+    snap.maxLoad = maxLoad.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < LOAD_BUCKETS; i++) {
+        snap.loadHistogram[i] = loadHistogram[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < NUM_XRUN_TYPES; i++) {
+        snap.xruns[i] = xruns[i].load(std::memory_order_relaxed);
+    }
+    snap.streamUnderruns = streamUnderruns.load(std::memory_order_relaxed);
+    snap.ticks = ticks.load(std::memory_order_relaxed);
+    snap.maxTickJitterNsec = maxTickJitterNsec.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < JITTER_BUCKETS; i++) {
+        snap.jitterHistogram[i] = jitterHistogram[i].load(std::memory_order_relaxed);
+    }
+    return snap;
+}
+
+void AudioStats::reset()
+{
+    callbacks.store(0);
+    maxLoad.store(0.f);
+    peakLoad.store(0.f);
+    for (auto &count : loadHistogram) {
+        count.store(0);
+    }
+    for (auto &count : xruns) {
+        count.store(0);
+    }
+    streamUnderruns.store(0);
+    ticks.store(0);
+    maxTickJitterNsec.store(0);
+    for (auto &count : jitterHistogram) {
+        count.store(0);
+    }
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Mark a method safe to call from real-time code
+#define realtime
+
+/*
+ * Performance counters for diagnosing audio glitches and choosing buffer
+ * sizes.  The real-time audio thread records events with lock-free atomic
+ * operations and non-real-time code reads a snapshot.  Counters are
+ * cumulative since the last reset().
+ *
+ * DSP load is the time spent in an audio callback divided by the duration of
+ * the audio block it produced.  A load of 1 or more means the callback missed
+ * its deadline.
+ */
+class AudioStats
+{
+public:
+    enum Xrun {
+        INPUT_UNDERFLOW,
+        INPUT_OVERFLOW,
+        OUTPUT_UNDERFLOW,
+        OUTPUT_OVERFLOW,
+        NUM_XRUN_TYPES,
+    };
+
+    enum {
+        // DSP load buckets of 10% each, the last bucket counts callbacks that
+        // took longer than the block duration
+        LOAD_BUCKETS = 11,
+
+        // Tick jitter buckets of [0, 1) ms, [1, 2) ms, [2, 4) ms, and so on,
+        // the last bucket counts 512 ms or more
+        JITTER_BUCKETS = 11,
+    };
+
+    struct Snapshot
+    {
+        uint64_t callbacks;
+        float maxLoad;
+        uint64_t loadHistogram[LOAD_BUCKETS];
+        uint64_t xruns[NUM_XRUN_TYPES];
+        uint64_t streamUnderruns; // total of all playback streams
+        uint64_t ticks;
+        uint64_t maxTickJitterNsec;
+        uint64_t jitterHistogram[JITTER_BUCKETS];
+    };
+
+    AudioStats();
+
+    realtime void addCallback(uint64_t durationNsec, uint64_t blockNsec);
+    realtime void addXrun(Xrun type);
+    realtime void addStreamUnderrun();
+
+    // Record how far a periodic non-real-time tick was from its schedule
+    void addTick(int64_t jitterNsec);
+
+    // Returns the highest DSP load since the last call, for load meters
+    realtime float takePeakLoad();
+
+    Snapshot snapshot() const;
+    void reset();
+
+private:
+    std::atomic<uint64_t> callbacks;
+    std::atomic<float> maxLoad;
+    std::atomic<float> peakLoad;
+    std::atomic<uint64_t> loadHistogram[LOAD_BUCKETS];
+    std::atomic<uint64_t> xruns[NUM_XRUN_TYPES];
+    std::atomic<uint64_t> streamUnderruns;
+    std::atomic<uint64_t> ticks;
+    std::atomic<uint64_t> maxTickJitterNsec;
+    std::atomic<uint64_t> jitterHistogram[JITTER_BUCKETS];
+};
+
+#undef realtime
@@ -4,7 +4,8 @@
 #include "AudioStream.h"
 
 AudioStream::AudioStream(AudioStream::Type type_, size_t sampleBufferSize_)
-    : type{type_}, sampleBuffer{nullptr}, gain{1.f}, peakVolume{0.f},
+    : type{type_}, silenceRead{0}, silenceWritten{0}, underruns{0},
+      gain{1.f}, peakVolume{0.f},
       peakVolumeDecay{0.f}, pan{0.f}, monitor{true}
 {
     setSampleBufferSize(sampleBufferSize_);
@@ -12,18 +13,20 @@ AudioStream::AudioStream(AudioStream::Type type_, size_t sampleBufferSize_)
 
 AudioStream::~AudioStream()
 {
-    delete [] sampleBuffer;
 }
 
 void AudioStream::setSampleBufferSize(size_t nsamples)
 {
     wasReset = true;
-    ring.setSize(nsamples);
-    delete [] sampleBuffer;
-    sampleBuffer = new float[nsamples];
-    sampleBufferSize = nsamples;
-    writeIndex = 0;
-    samplesQueued.store(0);
+    ring.setSize(nsamples ? MAX_QUEUED_WRITE_BLOCKS : 0);
+    sampleRing.setSize(nsamples);
+    readPos = 0;
+    writePos = 0;
+    writeTime = 0;
+    writeSilent = false;
+    silenceRead.store(0);
+    silenceWritten.store(0);
+    dry = true;
 }
 
 void AudioStream::setPeakVolumeDecay(float decay)
@@ -38,25 +41,86 @@ bool AudioStream::checkResetAndClear()
     return reset;
 }
 
+// Find the descriptor containing the next sample to read. *skip is set to the
+// number of fully consumed descriptors before it, *navail to the number of
+// samples it has available, and *time to the time of the next sample. Returns
+// false if there are no descriptors.
+bool AudioStream::findReadDescriptor(size_t *skip, size_t *navail,
+                                     SampleTime *time) const
+{
+    // Load the sample and silence counts before the descriptors because
+    // writers enqueue descriptors before their samples
+    const size_t end = readPos + sampleRing.numReadable();
+    const size_t silenceEnd = silenceWritten.load();
+    const size_t ndesc = ring.numReadable();
+
+    for (size_t i = 0; i < ndesc; i++) {
+        const AudioDescriptor &desc = ring.readPeek(i);
+        size_t avail;
+
+        if (desc.silent) {
+            // Only the current descriptor can be partially consumed
+            const size_t consumed = i == 0 ? silenceRead.load() - desc.silenceStart : 0;
+            const size_t descEnd = i + 1 < ndesc ? ring.readPeek(i + 1).silenceStart : silenceEnd;
+            avail = descEnd - desc.silenceStart - consumed;
+            *time = desc.time + consumed;
+        } else {
+            const size_t descEnd = i + 1 < ndesc ? ring.readPeek(i + 1).start : end;
+            avail = descEnd - readPos;
+            *time = desc.time + (readPos - desc.start);
+        }
+
+        if (avail > 0 || i + 1 == ndesc) {
+            *skip = i;
+            *navail = avail;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Release fully consumed descriptors
+void AudioStream::dequeueDescriptors(size_t n)
+{
+    if (n > 0) {
+        ring.readAdvance(n);
+    }
+}
+
+// Consume n samples from the current descriptor
+void AudioStream::consume(const AudioDescriptor &desc, size_t n)
+{
+    if (desc.silent) {
+        silenceRead.store(silenceRead.load() + n);
+    } else {
+        sampleRing.readAdvance(n);
+        readPos += n;
+    }
+}
+
 bool AudioStream::peekReadSampleTime(SampleTime *sampleTime) const
 {
-    if (!ring.canRead()) {
+    size_t skip, navail;
+    SampleTime time;
+    if (!findReadDescriptor(&skip, &navail, &time) || navail == 0) {
         return false;
     }
 
-    auto desc = ring.readCurrent();
-    *sampleTime = desc.time;
+    *sampleTime = time;
     return true;
 }
 
 size_t AudioStream::numSamplesWritable() const
 {
-    return sampleBufferSize - samplesQueued.load();
+    const size_t silence = silenceWritten.load() - silenceRead.load();
+    const size_t n = sampleRing.numWritable();
+    return n > silence ? n - silence : 0;
 }
 
 size_t AudioStream::numSamplesReadable() const
 {
-    return samplesQueued.load();
+    const size_t silence = silenceWritten.load() - silenceRead.load();
+    return sampleRing.numReadable() + silence;
 }
 
 void AudioStream::updatePeakVolume(const float *samples, size_t nsamples)
@@ -66,110 +130,203 @@ void AudioStream::updatePeakVolume(const float *samples, size_t nsamples)
     peakVolume.store(peak);
 }
 
+// Silence decays the peak volume without touching any samples
+void AudioStream::decayPeakVolume(size_t nsamples)
+{
+    float peak = peakVolume.load();
+    if (peak > 0.f) {
+        peakVolume.store(peak * powf(peakVolumeDecay, nsamples));
+    }
+}
+
 float AudioStream::getPeakVolume() const
 {
     return peakVolume.load();
 }
 
-size_t AudioStream::write(SampleTime now, const float *samples, size_t nsamples)
+uint32_t AudioStream::getUnderruns() const
 {
-    size_t nwritten = 0;
+    return underruns.load(std::memory_order_relaxed);
+}
+
+// Only start a new descriptor if there is a gap in time or a switch between
+// audio data and silence
+bool AudioStream::needsDescriptor(SampleTime now, bool silence) const
+{
+    if (silence) {
+        return !writeSilent || now != writeTime;
+    }
+    return writePos == 0 || now != writeTime || writeSilent;
+}
+
+bool AudioStream::canQueueWrite(SampleTime now, bool silence) const
+{
+    return !needsDescriptor(now, silence) || ring.canWrite();
+}
+
+AudioStream::WriteRegion AudioStream::writeAcquire(size_t nsamples)
+{
+    auto span = sampleRing.writeSpan(std::min(nsamples, numSamplesWritable()));
+    return WriteRegion{span.data, span.size};
+}
 
+size_t AudioStream::writeCommit(SampleTime now, size_t nsamples)
+{
+    if (nsamples == 0) {
+        return 0;
+    }
+
+    if (needsDescriptor(now, false)) {
+        if (!ring.canWrite()) {
+            return 0;
+        }
+
+        ring.writeCurrent() = AudioDescriptor{now, writePos,
+                                              silenceWritten.load(), false};
+        ring.writeNext();
+        writeSilent = false;
+    }
+
+    // The committed samples start at the current write position
     if (type == CAPTURE) {
-        updatePeakVolume(samples, nsamples);
+        updatePeakVolume(sampleRing.writeSpan(nsamples).data, nsamples);
+    }
+
+    sampleRing.writeAdvance(nsamples);
+    writePos += nsamples;
+    writeTime = now + nsamples;
+    return nsamples;
+}
+
+size_t AudioStream::writeSilence(SampleTime now, size_t nsamples)
+{
+    nsamples = std::min(nsamples, numSamplesWritable());
+    if (nsamples == 0) {
+        return 0;
+    }
+
+    if (needsDescriptor(now, true)) {
+        if (!ring.canWrite()) {
+            return 0;
+        }
+
+        ring.writeCurrent() = AudioDescriptor{now, writePos,
+                                              silenceWritten.load(), true};
+        ring.writeNext();
+        writeSilent = true;
     }
 
+    silenceWritten.store(silenceWritten.load() + nsamples);
+    writeTime = now + nsamples;
+    return nsamples;
+}
+
+size_t AudioStream::write(SampleTime now, const float *samples, size_t nsamples)
+{
+    size_t nwritten = 0;
+
     // Writes may cross the end of the sample buffer...
     while (nsamples > 0) {
-        if (!ring.canWrite()) {
+        WriteRegion region = writeAcquire(nsamples);
+        if (region.nsamples == 0) {
             return nwritten;
         }
 
-        size_t n = std::min(sampleBufferSize - writeIndex, nsamples);
-        if (samplesQueued.load() + n > sampleBufferSize) {
+        size_t n = region.nsamples;
+        memcpy(region.samples, samples, n * sizeof(float));
+        if (writeCommit(now, n) != n) {
             return nwritten;
         }
 
-        AudioDescriptor desc{&sampleBuffer[writeIndex], n, now};
-
-        memcpy(desc.samples, samples, n * sizeof(float));
-
-        samplesQueued.fetch_add(n);
-
-        writeIndex = (writeIndex + n) % sampleBufferSize;
         now += n;
         samples += n;
         nsamples -= n;
-
-        ring.writeCurrent() = desc;
-        ring.writeNext();
-
         nwritten += n;
     }
     return nwritten;
 }
 
-size_t AudioStream::readInternal(SampleTime now,
-                                 std::function<ReadFn> fn,
-                                 size_t nsamples)
+template<typename ReadFn>
+size_t AudioStream::readInternal(SampleTime now, ReadFn fn, size_t nsamples,
+                                 bool audible)
 {
     size_t nread = 0;
+    bool ranOut = false;
 
-    // Reads may seek ahead or cross the end of the sample buffer...
+    // Reads may seek ahead or cross descriptors or the end of the sample
+    // buffer...
     while (nsamples > 0) {
-        while (!ring.canRead()) {
-            return nread;
+        size_t skip, navail;
+        SampleTime descTime;
+        if (!findReadDescriptor(&skip, &navail, &descTime)) {
+            ranOut = true;
+            break;
         }
 
-        AudioDescriptor &desc = ring.readCurrent();
+        dequeueDescriptors(skip);
+        const AudioDescriptor &desc = ring.readCurrent();
 
-        // Stop if the audio data is in the future. Don't bother handling
-        // partial overlap, we'll drop the overlapping audio samples and seek
-        // into the descriptor next time.
-        if (now < desc.time) {
-            return nread;
+        // Stop if there is nothing left or the audio data is in the future.
+        // Don't bother handling partial overlap, we'll drop the overlapping
+        // audio samples and seek into the descriptor next time.
+        if (navail == 0) {
+            ranOut = true;
+            break;
+        }
+        if (now < descTime) {
+            break;
         }
 
         // Seek if necessary
-        size_t seek = now - desc.time;
-        if (seek >= desc.nsamples) {
-            size_t dequeued = desc.nsamples;
-            ring.readNext();
-            samplesQueued.fetch_sub(dequeued);
+        size_t seek = std::min<SampleTime>(now - descTime, navail);
+        if (seek > 0) {
+            consume(desc, seek);
             continue;
         }
 
-        size_t n = std::min(desc.nsamples - seek, nsamples);
+        size_t n;
+        if (desc.silent) {
+            n = std::min(navail, nsamples);
 
-        if (type == PLAYBACK) {
-            updatePeakVolume(&desc.samples[seek], n);
-        }
-
-        fn(nread, &desc.samples[seek], n);
+            if (type == PLAYBACK) {
+                decayPeakVolume(n);
+            }
 
-        // Complete a descriptor
-        size_t end = seek + n;
-        if (end == desc.nsamples) {
-            ring.readNext();
+            fn(nread, nullptr, n);
         } else {
-            desc.nsamples -= end;
-            desc.samples += end;
-            desc.time += end;
+            auto span = sampleRing.readSpan(std::min(navail, nsamples));
+            n = span.size;
+
+            if (type == PLAYBACK) {
+                updatePeakVolume(span.data, n);
+            }
+
+            fn(nread, span.data, n);
         }
 
-        samplesQueued.fetch_sub(end);
+        consume(desc, n);
 
         now += n;
         nsamples -= n;
         nread += n;
     }
 
+    // Count running dry once, not every read while a stream is idle
+    if (ranOut && nsamples > 0) {
+        if ((!dry || nread > 0) && audible && type == PLAYBACK) {
+            underruns.fetch_add(1, std::memory_order_relaxed);
+        }
+        dry = true;
+    } else if (nread > 0) {
+        dry = false;
+    }
     return nread;
 }
 
 size_t AudioStream::readDiscard(SampleTime now, size_t nsamples)
 {
-    return readInternal(now, [](size_t, const float*, size_t) {}, nsamples);
+    return readInternal(now, [](size_t, const float*, size_t) {}, nsamples,
+                        false);
 }
 
 size_t AudioStream::read(SampleTime now, float *samples, size_t nsamples)
@@ -178,37 +335,56 @@ size_t AudioStream::read(SampleTime now, float *samples, size_t nsamples)
 
     return readInternal(now,
         [samples, vol](size_t offset, const float *input, size_t n) {
-            applyGain(input, &samples[offset], n, vol);
+            if (input) {
+                applyGain(input, &samples[offset], n, vol);
+            } else {
+                memset(&samples[offset], 0, n * sizeof(float));
+            }
         },
-        nsamples);
+        nsamples, true);
 }
 
 size_t AudioStream::readMixStereo(SampleTime now,
                                   float *samples[CHANNELS_STEREO],
                                   size_t nsamples)
 {
-    // TODO use -4.5 dB pan law instead of linear panning?
-    const float pan = getPan();
-    const float vol = getGain();
-    const float volLeft = vol * (1.f - pan) / 2;
-    const float volRight = vol * (pan + 1.f) / 2;
+    float volLeft, volRight;
+    getStereoVolume(&volLeft, &volRight);
+    return readMixStereo(now, samples, nsamples, volLeft, volRight);
+}
 
+size_t AudioStream::readMixStereo(SampleTime now,
+                                  float *samples[CHANNELS_STEREO],
+                                  size_t nsamples,
+                                  float volLeft, float volRight)
+{
     return readInternal(now,
         [samples, volLeft, volRight](size_t offset, const float *input, size_t n) {
-            mixSamples(input, &samples[CHANNEL_LEFT][offset], n, volLeft);
-            mixSamples(input, &samples[CHANNEL_RIGHT][offset], n, volRight);
+            if (!input) {
+                return; // nothing to mix for silence
+            }
+            mixSamplesStereo(input,
+                             &samples[CHANNEL_LEFT][offset],
+                             &samples[CHANNEL_RIGHT][offset],
+                             n, volLeft, volRight);
         },
-        nsamples);
+        nsamples, true);
 }
 
 void AudioStream::readDiscardAll()
 {
-    while (ring.canRead()) {
-        AudioDescriptor &desc = ring.readCurrent();
-        size_t dequeued = desc.nsamples;
-        ring.readNext();
-        samplesQueued.fetch_sub(dequeued);
+    size_t skip, navail;
+    SampleTime time;
+
+    while (findReadDescriptor(&skip, &navail, &time)) {
+        dequeueDescriptors(skip);
+        if (navail == 0) {
+            break;
+        }
+
+        consume(ring.readCurrent(), navail);
     }
+    dry = true;
 }
 
 float AudioStream::getGain() const
@@ -231,6 +407,15 @@ void AudioStream::setPan(float pan_)
     pan.store(pan_);
 }
 
+void AudioStream::getStereoVolume(float *volLeft, float *volRight) const
+{
+    // TODO use -4.5 dB pan law instead of linear panning?
+    const float pan = getPan();
+    const float vol = getGain();
+    *volLeft = vol * (1.f - pan) / 2;
+    *volRight = vol * (pan + 1.f) / 2;
+}
+
 bool AudioStream::monitorEnabled() const
 {
     return monitor.load();
@@ -4,7 +4,7 @@
 #include <math.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <functional>
+#include "AudioKernels.h"
 #include "RingBuffer.h"
 
 // A time value, counted in audio samples
@@ -23,6 +23,17 @@ enum
 
     // Periodic non-real-time buffer processing interval
     SAFE_PERIODIC_TICK_MSEC = 50,
+
+    // Buffer space and low-water mark when the non-real-time thread is also
+    // woken up by watermark service requests, see
+    // AudioProcessor::setWatermarks()
+    WATERMARK_BUFFER_MSEC = 100,
+    WATERMARK_LOW_MSEC = 60,
+
+    // Maximum number of discontinuous writes queued in an AudioStream.
+    // Writes that continue where the last write ended do not count, unless
+    // they switch between silence and audio data.
+    MAX_QUEUED_WRITE_BLOCKS = 4 * GENEROUS_BUFFER_MSEC / SAFE_PERIODIC_TICK_MSEC,
 };
 
 // Number of samples for a given duration
@@ -39,33 +50,26 @@ inline constexpr int samplesToMsec(int sampleRate, int nsamples)
 
 inline void mixSamples(const float *in, float *out, size_t nsamples, float vol)
 {
-    while (nsamples > 0) {
-        *out++ += *in++ * vol;
-        nsamples--;
-    }
+    audioKernels->mixSamples(in, out, nsamples, vol);
+}
+
+// Mix a mono input into left and right outputs in one pass
+inline void mixSamplesStereo(const float *in, float *outLeft, float *outRight,
+                             size_t nsamples, float volLeft, float volRight)
+{
+    audioKernels->mixSamplesStereo(in, outLeft, outRight, nsamples,
+                                   volLeft, volRight);
 }
 
 inline void applyGain(const float *in, float *out, size_t nsamples, float vol)
 {
-    while (nsamples > 0) {
-        *out++ = *in++ * vol;
-        nsamples--;
-    }
+    audioKernels->applyGain(in, out, nsamples, vol);
 }
 
 inline float updatePeakVolume(const float *in, size_t nsamples, float decay,
                               float peakVolume)
 {
-    for (size_t i = 0; i < nsamples; i++) {
-        const float val = fabs(in[i]);
-        if (val >= peakVolume) {
-            peakVolume = val;
-        } else {
-            peakVolume *= decay;
-        }
-    }
-
-    return peakVolume;
+    return audioKernels->updatePeakVolume(in, nsamples, decay, peakVolume);
 }
 
 // Mark a method safe to call from real-time code
@@ -102,21 +106,57 @@ public:
     // sample time.
     realtime bool peekReadSampleTime(SampleTime *sampleTime) const;
 
-    // Returns the number of samples that there is space for
+    // Returns the number of samples that there is space for. Queued silence
+    // takes no buffer space but still counts towards the buffer size.
     realtime size_t numSamplesWritable() const;
 
-    // Returns the number of samples available for reading
+    // Returns the number of samples available for reading, including silence
     realtime size_t numSamplesReadable() const;
 
+    // Returns true if a write of audio data or silence at time now can be
+    // queued, either because it continues the last write or because there is
+    // room for another gap in time. Only buffer space limits it then.
+    realtime bool canQueueWrite(SampleTime now, bool silence) const;
+
     // Returns number of samples written (e.g. before buffer was full)
     realtime size_t write(SampleTime now, const float *samples,
                           size_t nsamples);
 
+    // A writable region of the stream's sample buffer
+    struct WriteRegion
+    {
+        float *samples;
+        size_t nsamples;
+    };
+
+    // Zero-copy alternative to write(). Returns a contiguous region of up to
+    // nsamples that the caller fills in before calling writeCommit(). The
+    // region may be smaller than requested (e.g. at the end of the sample
+    // buffer) and is empty when the buffer is full.
+    realtime WriteRegion writeAcquire(size_t nsamples);
+
+    // Queue the first nsamples of the region returned by writeAcquire() at
+    // time now. Returns the number of samples committed, which is 0 if there
+    // are too many gaps in time queued already.
+    realtime size_t writeCommit(SampleTime now, size_t nsamples);
+
+    // Queue nsamples of silence at time now without storing any samples.
+    // Readers produce zeros and the mixer skips silence entirely. Returns the
+    // number of samples of silence queued.
+    realtime size_t writeSilence(SampleTime now, size_t nsamples);
+
     // Returns number of samples read (e.g. before buffer was empty)
     realtime size_t read(SampleTime now, float *samples, size_t nsamples);
     realtime size_t readMixStereo(SampleTime now,
                                   float *samples[CHANNELS_STEREO],
                                   size_t nsamples);
+
+    // Like readMixStereo() but with volumes from getStereoVolume() that the
+    // caller has already loaded
+    realtime size_t readMixStereo(SampleTime now,
+                                  float *samples[CHANNELS_STEREO],
+                                  size_t nsamples,
+                                  float volLeft, float volRight);
     realtime size_t readDiscard(SampleTime now, size_t nsamples);
 
     // Throw away all available samples
@@ -126,31 +166,62 @@ public:
     realtime void setGain(float gain_);
     realtime float getPan() const;
     realtime void setPan(float pan_);
+
+    // Left and right channel volume from gain and pan
+    realtime void getStereoVolume(float *volLeft, float *volRight) const;
     realtime bool monitorEnabled() const;
     realtime void setMonitorEnabled(bool enabled);
 
     // Peak volume for VU meters
     realtime float getPeakVolume() const;
 
+    // Number of times queued playback samples ran out during a read() or
+    // readMixStereo(). A stream that stays empty counts once and
+    // readDiscard() never counts.
+    realtime uint32_t getUnderruns() const;
+
 private:
     /*
      * Audio is transferred in a packet called AudioDescriptor.  Each descriptor
      * includes a timestamp for time synchronization.  Timestamps make it
      * possible to represent gaps in audio data.
+     *
+     * A descriptor covers the samples from its start position up to the start
+     * of the next descriptor, or up to the last written sample if it is the
+     * newest descriptor.  Writes that continue where the previous write ended
+     * simply extend the newest descriptor, so descriptors are only needed when
+     * there is a discontinuity in time.  The newest descriptor is never
+     * dequeued by the reader because the writer may still extend it.
+     *
+     * A silence descriptor covers no samples in the sample buffer.  It works
+     * the same way with silence positions instead of sample positions, so
+     * contiguous silence writes extend it too.
      */
     struct AudioDescriptor
     {
-        float *samples;
-        size_t nsamples;
         SampleTime time;
+        size_t start; // sample position, see readPos and writePos
+        size_t silenceStart; // see silenceRead and silenceWritten
+        bool silent;
     };
 
     Type type;
     RingBuffer<AudioDescriptor> ring;
-    float *sampleBuffer;
-    size_t sampleBufferSize;
-    size_t writeIndex;
-    std::atomic<size_t> samplesQueued;
+
+    // Sample storage. Space is released in the order samples are written.
+    RingBuffer<float> sampleRing;
+
+    size_t readPos; // reader's count of samples consumed
+    size_t writePos; // writer's count of samples written
+    SampleTime writeTime; // time of the next sample if writes are contiguous
+    bool writeSilent; // was the newest descriptor a silence descriptor?
+
+    // Silence accounting, each counter is only modified by one side
+    std::atomic<size_t> silenceRead; // reader's count of silence consumed
+    std::atomic<size_t> silenceWritten; // writer's count of silence queued
+    std::atomic<uint32_t> underruns;
+    bool dry; // reader ran out of samples and none have arrived since
+
     std::atomic<float> gain; // out / in ratio
     std::atomic<float> peakVolume;
     float peakVolumeDecay;
@@ -158,14 +229,24 @@ private:
     std::atomic<bool> monitor; // mix into output?
     bool wasReset;
 
-    // Read n samples from input[] with offset from beginning of the read operation
-    typedef void ReadFn(size_t offset, const float *input, size_t n);
-
-    realtime size_t readInternal(SampleTime now,
-                                 std::function<ReadFn> fn,
-                                 size_t nsamples);
+    realtime bool needsDescriptor(SampleTime now, bool silence) const;
+    realtime bool findReadDescriptor(size_t *skip, size_t *navail,
+                                     SampleTime *time) const;
+    realtime void dequeueDescriptors(size_t n);
+    realtime void consume(const AudioDescriptor &desc, size_t n);
+
+    // The read loop shared by read(), readMixStereo(), and readDiscard(). The
+    // fn policy is called as fn(offset, input, n) to consume n samples from
+    // input[] at offset from the beginning of the read operation. It is a
+    // template parameter so each read mode is inlined into its own loop.
+    // Silence is passed as a null input pointer. Underruns are only counted
+    // for audible reads.
+    template<typename ReadFn>
+    realtime size_t readInternal(SampleTime now, ReadFn fn, size_t nsamples,
+                                 bool audible);
 
     void updatePeakVolume(const float *samples, size_t nsamples);
+    void decayPeakVolume(size_t nsamples);
 };
 
 #undef realtime
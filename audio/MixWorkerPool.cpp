@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "MixWorkerPool.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Tell the CPU we are busy-waiting
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+// Workers run on the audio callback's critical path so ask for real-time
+// scheduling. This is best effort and failure is not fatal.
+static void setRealtimePriority()
+{
+#if defined(_WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+    struct sched_param param = {};
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+}
+
+MixWorkerPool::MixWorkerPool(unsigned int nworkers)
+    : jobFn{nullptr}, jobOpaque{nullptr}, quit{false}, spinCount{SPIN_COUNT},
+      jobSeq{0}, pending{0}
+{
+    // The calling thread takes part in jobs too
+    if (std::thread::hardware_concurrency() <= nworkers) {
+        spinCount = 0;
+    }
+
+    for (unsigned int i = 0; i < nworkers; i++) {
+        workers.emplace_back(new Worker);
+        workers.back()->sleeping.store(false);
+    }
+
+    // Start threads after all workers exist because startJob() visits them
+    for (unsigned int i = 0; i < nworkers; i++) {
+        workers[i]->thread = std::thread{&MixWorkerPool::workerLoop, this, i};
+    }
+}
+
+MixWorkerPool::~MixWorkerPool()
+{
+    quit = true;
+    startJob();
+
+    for (auto &worker : workers) {
+        worker->thread.join();
+    }
+}
+
+unsigned int MixWorkerPool::numWorkers() const
+{
+    return workers.size();
+}
+
+// Publish the job and wake up parked workers
+void MixWorkerPool::startJob()
+{
+    jobSeq.fetch_add(1);
+
+    for (auto &worker : workers) {
+        if (worker->sleeping.exchange(false)) {
+            worker->wakeup.post();
+        }
+    }
+}
+
+void MixWorkerPool::run(JobFn fn, void *opaque)
+{
+    jobFn = fn;
+    jobOpaque = opaque;
+    pending.store(workers.size(), std::memory_order_relaxed);
+    startJob();
+
+    fn(opaque, 0);
+
+    while (pending.load(std::memory_order_acquire) != 0) {
+        if (spinCount) {
+            cpuRelax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// Returns the next job sequence number after lastSeq
+uint64_t MixWorkerPool::waitForJob(Worker *worker, uint64_t lastSeq)
+{
+    for (int i = 0; i < spinCount; i++) {
+        uint64_t seq = jobSeq.load(std::memory_order_acquire);
+        if (seq != lastSeq) {
+            return seq;
+        }
+        cpuRelax();
+    }
+
+    /*
+     * Park.  Either startJob() sees sleeping set and posts the semaphore or we
+     * see the new job sequence number.  Whoever clears sleeping is responsible
+     * for the wakeup so the semaphore count stays balanced.
+     *
+     * A worker can pick up a job without parking and park again before
+     * startJob() has visited it.  The post is then for the job we already ran
+     * and we must park again.
+     */
+    while (true) {
+        worker->sleeping.store(true);
+
+        uint64_t seq = jobSeq.load();
+        if (seq != lastSeq && worker->sleeping.exchange(false)) {
+            return seq;
+        }
+
+        worker->wakeup.wait();
+
+        seq = jobSeq.load(std::memory_order_acquire);
+        if (seq != lastSeq) {
+            return seq;
+        }
+    }
+}
+
+void MixWorkerPool::workerLoop(unsigned int index)
+{
+    Worker *worker = workers[index].get();
+    uint64_t seq = 0;
+
+    setRealtimePriority();
+
+    while (true) {
+        seq = waitForJob(worker, seq);
+        if (quit) {
+            return;
+        }
+
+        jobFn(jobOpaque, index + 1);
+        pending.fetch_sub(1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "Semaphore.h"
+
+// Mark a method safe to call from real-time code
+#define realtime
+
+/*
+ * A fixed pool of pre-spawned worker threads for splitting real-time work
+ * across CPU cores.  The real-time thread calls run() to fork a job onto all
+ * workers, takes part in the job itself, and then waits for the workers to
+ * join.
+ *
+ * Idle workers spin for a short while so that back-to-back audio callbacks
+ * hand off work without system calls.  After that they park on a semaphore
+ * and run() only posts the semaphores of parked workers.  When there are not
+ * enough CPUs for every thread to have its own, spinning would only steal
+ * time from the thread being waited for, so workers park immediately.
+ */
+class MixWorkerPool
+{
+public:
+    // Called as fn(opaque, participant) where participant 0 is the thread that
+    // called run() and 1..numWorkers() are the worker threads
+    typedef void (*JobFn)(void *opaque, unsigned int participant);
+
+    // Call from non-real-time thread
+    explicit MixWorkerPool(unsigned int nworkers);
+    ~MixWorkerPool();
+
+    unsigned int numWorkers() const;
+
+    // Run fn on the calling thread and all workers and wait for them to finish
+    realtime void run(JobFn fn, void *opaque);
+
+private:
+    enum {
+        CACHE_LINE_SIZE = 64,
+
+        // Number of times an idle worker polls for a job before parking
+        SPIN_COUNT = 20000,
+    };
+
+    struct Worker
+    {
+        std::thread thread;
+        Semaphore wakeup;
+        std::atomic<bool> sleeping;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // Written by run() before publishing a new job sequence number
+    JobFn jobFn;
+    void *jobOpaque;
+    bool quit;
+    int spinCount; // SPIN_COUNT or 0 if there are too few CPUs
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> jobSeq;
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> pending; // workers still running
+
+    void startJob();
+    uint64_t waitForJob(Worker *worker, uint64_t lastSeq);
+    void workerLoop(unsigned int index);
+};
+
+#undef realtime
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "OfflineAudioEngine.h"
+
+OfflineAudioEngine::OfflineAudioEngine()
+    : processFn{nullptr}, input{nullptr}, output{nullptr}, sampleRate{44100},
+      bufferSize{512}, paced{false}, stopRequested{false}, running{false},
+      now{0}
+{
+}
+
+OfflineAudioEngine::~OfflineAudioEngine()
+{
+    stop();
+}
+
+void OfflineAudioEngine::setProcessFn(std::function<ProcessFn> processFn_)
+{
+    assert(!isRunning());
+    processFn = processFn_;
+}
+
+void OfflineAudioEngine::setSampleRate(int sampleRate_)
+{
+    assert(!isRunning());
+    assert(sampleRate_ > 0);
+    sampleRate = sampleRate_;
+}
+
+void OfflineAudioEngine::setBufferSize(size_t bufferSize_)
+{
+    assert(!isRunning());
+    assert(bufferSize_ > 0);
+    bufferSize = bufferSize_;
+}
+
+void OfflineAudioEngine::setInput(AudioFileReader *input_)
+{
+    assert(!isRunning());
+    input = input_;
+}
+
+void OfflineAudioEngine::setOutput(AudioFileWriter *output_)
+{
+    assert(!isRunning());
+    output = output_;
+}
+
+void OfflineAudioEngine::setPaced(bool paced_)
+{
+    assert(!isRunning());
+    paced = paced_;
+}
+
+int OfflineAudioEngine::getSampleRate() const
+{
+    return sampleRate;
+}
+
+SampleTime OfflineAudioEngine::getSampleTime() const
+{
+    return now.load();
+}
+
+SampleTime OfflineAudioEngine::render(SampleTime nsamples)
+{
+    assert(processFn);
+
+    // Without an input file there is nothing to end processing
+    assert(nsamples > 0 || input);
+
+    for (int ch = 0; ch < CHANNELS_STEREO; ch++) {
+        sampleBuf[ch].resize(bufferSize);
+    }
+    float *inOutSamples[] = {
+        sampleBuf[CHANNEL_LEFT].data(),
+        sampleBuf[CHANNEL_RIGHT].data(),
+    };
+
+    const auto startTime = std::chrono::steady_clock::now();
+    SampleTime nprocessed = 0;
+
+    while (!stopRequested.load() && (nsamples == 0 || nprocessed < nsamples)) {
+        size_t n = bufferSize;
+        if (nsamples) {
+            n = std::min<SampleTime>(n, nsamples - nprocessed);
+        }
+
+        size_t nread = 0;
+        if (input) {
+            nread = input->read(inOutSamples, n);
+            if (nsamples == 0) {
+                if (nread == 0) {
+                    break;
+                }
+                n = nread;
+            }
+        }
+        for (int ch = 0; ch < CHANNELS_STEREO; ch++) {
+            memset(inOutSamples[ch] + nread, 0, (n - nread) * sizeof(float));
+        }
+
+        const SampleTime t = now.load();
+        processFn(inOutSamples, n, t);
+
+        if (output) {
+            output->write(inOutSamples, n);
+        }
+
+        now.store(t + n);
+        nprocessed += n;
+
+        if (paced) {
+            std::this_thread::sleep_until(startTime +
+                    std::chrono::microseconds(nprocessed * 1000000 / sampleRate));
+        }
+    }
+    return nprocessed;
+}
+
+void OfflineAudioEngine::start(SampleTime nsamples)
+{
+    assert(!isRunning());
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    stopRequested.store(false);
+    running.store(true);
+    thread = std::thread{[this, nsamples]() {
+        render(nsamples);
+        running.store(false);
+    }};
+}
+
+void OfflineAudioEngine::stop()
+{
+    stopRequested.store(true);
+    wait();
+    stopRequested.store(false);
+}
+
+void OfflineAudioEngine::wait()
+{
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool OfflineAudioEngine::isRunning() const
+{
+    return running.load();
+}
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "AudioFile.h"
+#include "AudioStream.h" // for types and constants
+
+/*
+ * An audio backend without audio hardware.  A plain thread drives the process
+ * function with a virtual sample clock, either as fast as possible or paced
+ * at the sample rate like a sound card would.  Input comes from an
+ * AudioFileReader (or silence) and output goes to an AudioFileWriter (or is
+ * discarded).
+ *
+ * This is useful for benchmarks, regression tests, and soak tests on machines
+ * without a sound card.  The standalone app runs whole sessions with it when
+ * started with --offline.
+ */
+class OfflineAudioEngine
+{
+public:
+    typedef void ProcessFn(float *inOutSamples[CHANNELS_STEREO],
+                           size_t nsamples,
+                           SampleTime now);
+
+    OfflineAudioEngine();
+    ~OfflineAudioEngine();
+
+    // The following setters must be called while not running
+    void setProcessFn(std::function<ProcessFn> processFn_);
+    void setSampleRate(int sampleRate_);
+    void setBufferSize(size_t bufferSize_);
+    void setInput(AudioFileReader *input_);
+    void setOutput(AudioFileWriter *output_);
+
+    // Sleep between blocks so processing runs in real-time
+    void setPaced(bool paced_);
+
+    int getSampleRate() const;
+
+    // Sample time of the next block, may be called from any thread
+    SampleTime getSampleTime() const;
+
+    // Process nsamples on the calling thread, or until the input file ends if
+    // nsamples is 0. Returns the number of samples processed.
+    SampleTime render(SampleTime nsamples);
+
+    // Run render() on a new thread
+    void start(SampleTime nsamples = 0);
+
+    // Ask the render thread to finish and wait for it
+    void stop();
+
+    // Wait for the render thread to finish on its own
+    void wait();
+
+    bool isRunning() const;
+
+private:
+    std::function<ProcessFn> processFn;
+    AudioFileReader *input;
+    AudioFileWriter *output;
+    int sampleRate;
+    size_t bufferSize;
+    bool paced;
+    std::vector<float> sampleBuf[CHANNELS_STEREO];
+    std::thread thread;
+    std::atomic<bool> stopRequested;
+    std::atomic<bool> running;
+    std::atomic<SampleTime> now;
+};
@@ -2,13 +2,37 @@
 #pragma once
 
 #include <assert.h>
+#include <stddef.h>
+#include <algorithm>
 #include <atomic>
 
+/*
+ * Single-producer single-consumer lock-free ring buffer.  One thread reads and
+ * one thread writes.
+ *
+ * The reader and writer indices live on separate cache lines and each side
+ * keeps a cached copy of the other side's index, so the threads only touch
+ * each other's cache line when the ring looks empty or full.  Storage is
+ * rounded up to a power of two so indices are masked instead of using modulo,
+ * but no more than the requested number of elements are ever queued.
+ *
+ * Elements are accessed one at a time with readCurrent()/readNext() and
+ * writeCurrent()/writeNext(), or in bulk with readSpan()/readAdvance() and
+ * writeSpan()/writeAdvance().
+ */
 template<typename T> class RingBuffer
 {
 public:
+    // A contiguous region of elements
+    struct Span
+    {
+        T *data;
+        size_t size;
+    };
+
     RingBuffer(size_t nelems_ = 0)
-        : ring{nullptr}
+        : reader{0}, cachedWriter{0}, writer{0}, cachedReader{0},
+          ring{nullptr}, nelems{0}, mask{0}
     {
         setSize(nelems_);
     }
@@ -21,57 +45,146 @@ public:
     // Resets ring, not atomic!
     void setSize(size_t nelems_)
     {
-        // Need to distinguish full and empty ring
-        assert(nelems_ < ~(size_t)0);
+        size_t storage = 0;
+        if (nelems_ > 0) {
+            storage = 1;
+            while (storage < nelems_) {
+                storage <<= 1;
+            }
+        }
 
         delete [] ring;
 
-        ring = new T[nelems_];
+        ring = storage ? new T[storage] : nullptr;
         nelems = nelems_;
-        reader = 0;
-        writer = 0;
+        mask = storage ? storage - 1 : 0;
+        reader.store(0, std::memory_order_relaxed);
+        writer.store(0, std::memory_order_relaxed);
+        cachedReader = 0;
+        cachedWriter = 0;
+    }
+
+    // Maximum number of queued elements
+    size_t capacity() const
+    {
+        return nelems;
     }
 
+    /* Reader side */
+
     bool canRead() const
     {
-//        qDebug("%s ring %p reader %zu writer %zu", __func__, this, reader.load(), writer.load());
-        return reader.load() != writer.load();
+        const size_t r = reader.load(std::memory_order_relaxed);
+        if (r != cachedWriter) {
+            return true;
+        }
+        cachedWriter = writer.load(std::memory_order_acquire);
+        return r != cachedWriter;
+    }
+
+    size_t numReadable() const
+    {
+        cachedWriter = writer.load(std::memory_order_acquire);
+        return cachedWriter - reader.load(std::memory_order_relaxed);
     }
 
     T &readCurrent()
     {
-        return ring[reader.load() % nelems];
+        return ring[reader.load(std::memory_order_relaxed) & mask];
     }
 
     const T &readCurrent() const
     {
-        return ring[reader.load() % nelems];
+        return ring[reader.load(std::memory_order_relaxed) & mask];
+    }
+
+    // Element that is offset positions after readCurrent()
+    const T &readPeek(size_t offset) const
+    {
+        assert(offset < numReadable());
+        return ring[(reader.load(std::memory_order_relaxed) + offset) & mask];
     }
 
     void readNext()
     {
-        reader.fetch_add(1);
+        readAdvance(1);
     }
 
+    // Returns up to max contiguous readable elements
+    Span readSpan(size_t max = ~(size_t)0)
+    {
+        const size_t r = reader.load(std::memory_order_relaxed);
+        const size_t idx = r & mask;
+        size_t n = std::min(numReadable(), max);
+        n = std::min(n, mask + 1 - idx);
+        return Span{ring + idx, n};
+    }
+
+    // Release n elements back to the writer
+    void readAdvance(size_t n)
+    {
+        const size_t r = reader.load(std::memory_order_relaxed);
+        reader.store(r + n, std::memory_order_release);
+    }
+
+    /* Writer side */
+
     bool canWrite() const
     {
-//        qDebug("%s ring %p reader %zu writer %zu", __func__, this, reader.load(), writer.load());
-        return (writer.load() - reader.load()) < nelems;
+        const size_t w = writer.load(std::memory_order_relaxed);
+        if (w - cachedReader < nelems) {
+            return true;
+        }
+        cachedReader = reader.load(std::memory_order_acquire);
+        return w - cachedReader < nelems;
+    }
+
+    size_t numWritable() const
+    {
+        cachedReader = reader.load(std::memory_order_acquire);
+        return nelems - (writer.load(std::memory_order_relaxed) - cachedReader);
     }
 
     T &writeCurrent()
     {
-        return ring[writer.load() % nelems];
+        return ring[writer.load(std::memory_order_relaxed) & mask];
     }
 
     void writeNext()
     {
-        writer.fetch_add(1);
+        writeAdvance(1);
+    }
+
+    // Returns up to max contiguous writable elements
+    Span writeSpan(size_t max = ~(size_t)0)
+    {
+        const size_t w = writer.load(std::memory_order_relaxed);
+        const size_t idx = w & mask;
+        size_t n = std::min(numWritable(), max);
+        n = std::min(n, mask + 1 - idx);
+        return Span{ring + idx, n};
+    }
+
+    // Publish n elements to the reader
+    void writeAdvance(size_t n)
+    {
+        const size_t w = writer.load(std::memory_order_relaxed);
+        writer.store(w + n, std::memory_order_release);
     }
 
 private:
-    T *ring;
-    std::atomic<size_t> reader; // free-running index
-    std::atomic<size_t> writer; // free-running index
+    enum { CACHE_LINE_SIZE = 64 };
+
+    // Owned by the reader
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> reader; // free-running index
+    mutable size_t cachedWriter;
+
+    // Owned by the writer
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> writer; // free-running index
+    mutable size_t cachedReader;
+
+    // Only changed by setSize()
+    alignas(CACHE_LINE_SIZE) T *ring;
     size_t nelems;
+    size_t mask;
 };
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include "Semaphore.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+
+Semaphore::Semaphore()
+    : handle{CreateSemaphore(nullptr, 0, LONG_MAX, nullptr)}
+{
+}
+
+Semaphore::~Semaphore()
+{
+    CloseHandle(handle);
+}
+
+void Semaphore::post()
+{
+    ReleaseSemaphore(handle, 1, nullptr);
+}
+
+void Semaphore::wait()
+{
+    WaitForSingleObject(handle, INFINITE);
+}
+
+bool Semaphore::wait(std::chrono::milliseconds timeout)
+{
+    return WaitForSingleObject(handle, timeout.count()) == WAIT_OBJECT_0;
+}
+
+#elif defined(__APPLE__)
+
+Semaphore::Semaphore()
+    : handle{dispatch_semaphore_create(0)}
+{
+}
+
+Semaphore::~Semaphore()
+{
+    dispatch_release(handle);
+}
+
+void Semaphore::post()
+{
+    dispatch_semaphore_signal(handle);
+}
+
+void Semaphore::wait()
+{
+    dispatch_semaphore_wait(handle, DISPATCH_TIME_FOREVER);
+}
+
+bool Semaphore::wait(std::chrono::milliseconds timeout)
+{
+    dispatch_time_t deadline = dispatch_time(DISPATCH_TIME_NOW,
+            std::chrono::nanoseconds(timeout).count());
+    return dispatch_semaphore_wait(handle, deadline) == 0;
+}
+
+#else
+
+Semaphore::Semaphore()
+{
+    sem_init(&handle, 0, 0);
+}
+
+Semaphore::~Semaphore()
+{
+    sem_destroy(&handle);
+}
+
+void Semaphore::post()
+{
+    sem_post(&handle);
+}
+
+void Semaphore::wait()
+{
+    while (sem_wait(&handle) != 0 && errno == EINTR) {
+        // Try again
+    }
+}
+
+bool Semaphore::wait(std::chrono::milliseconds timeout)
+{
+    // sem_timedwait() takes an absolute CLOCK_REALTIME deadline
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout.count() / 1000;
+    deadline.tv_nsec += (timeout.count() % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    int ret;
+    while ((ret = sem_timedwait(&handle, &deadline)) != 0 && errno == EINTR) {
+        // Try again
+    }
+    return ret == 0;
+}
+
+#endif
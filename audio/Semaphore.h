@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <chrono>
+
+#if defined(_WIN32)
+// HANDLE without including windows.h
+typedef void *SemaphoreHandle;
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+typedef dispatch_semaphore_t SemaphoreHandle;
+#else
+#include <semaphore.h>
+typedef sem_t SemaphoreHandle;
+#endif
+
+// Mark a method safe to call from real-time code
+#define realtime
+
+/*
+ * A counting semaphore built on the platform's native semaphore.  Posting
+ * does not take locks so real-time code can use it to wake up other threads.
+ */
+class Semaphore
+{
+public:
+    Semaphore();
+    ~Semaphore();
+
+    realtime void post();
+    void wait();
+
+    // Returns false if the timeout expired before the semaphore was posted
+    bool wait(std::chrono::milliseconds timeout);
+
+private:
+    SemaphoreHandle handle;
+
+    Semaphore(const Semaphore &) = delete;
+    Semaphore &operator=(const Semaphore &) = delete;
+};
+
+#undef realtime
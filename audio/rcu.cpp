@@ -1,47 +1,135 @@
 // SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <thread>
 #include "rcu.h"
 
 RCUContext::RCUContext()
-    : gracePeriod{0}
+    : epoch{1}, freeItems{nullptr}, pendingHead{nullptr}, pendingTail{nullptr}
 {
+    for (ReaderSlot &slot : readers) {
+        slot.epoch.store(0);
+    }
+
+    allocReclaimBlock();
 }
 
 RCUContext::~RCUContext()
 {
-    // Just in case reclaim items were added after last readUnlock()
-    gracePeriod.fetch_add(1);
+    // Readers are gone, reclaim everything
+    reclaimBefore(UINT64_MAX);
+}
+
+void RCUContext::readLock(unsigned int reader)
+{
+    assert(reader < MAX_READERS);
 
-    reclaim();
+    /*
+     * The sequentially consistent store orders the slot update before the
+     * reader's loads of shared pointers.  Either reclaim() sees this slot or
+     * this reader sees pointers updated before the epoch was advanced.
+     */
+    readers[reader].epoch.store(epoch.load());
 }
 
-void RCUContext::readLock()
+void RCUContext::readUnlock(unsigned int reader)
 {
+    readers[reader].epoch.store(0, std::memory_order_release);
+}
+
+// Add a block of items to the free list
+void RCUContext::allocReclaimBlock()
+{
+    std::unique_ptr<ReclaimItem[]> block{new ReclaimItem[RECLAIM_BLOCK_SIZE]};
+
+    for (size_t i = 0; i < RECLAIM_BLOCK_SIZE; i++) {
+        block[i].next = i + 1 < RECLAIM_BLOCK_SIZE ? &block[i + 1] : freeItems;
+    }
+
+    freeItems = &block[0];
+    itemBlocks.push_back(std::move(block));
 }
 
-void RCUContext::readUnlock()
+// Returns a free reclaim item. Only allocates when all items are in use.
+RCUContext::ReclaimItem *RCUContext::allocReclaimItem()
 {
-    gracePeriod.fetch_add(1);
+    if (!freeItems) {
+        allocReclaimBlock();
+    }
+
+    ReclaimItem *item = freeItems;
+    freeItems = item->next;
+    return item;
 }
 
-void RCUContext::addReclaimItem(std::function<void ()> f)
+void RCUContext::queueReclaimItem(ReclaimItem *item)
 {
-    uint64_t after = gracePeriod.load();
-    reclaimItems.push(std::make_pair(after, f));
+    item->next = nullptr;
+    item->epoch = epoch.load();
+
+    if (pendingTail) {
+        pendingTail->next = item;
+    } else {
+        pendingHead = item;
+    }
+    pendingTail = item;
 }
 
-void RCUContext::reclaim()
+// Returns the oldest epoch observed by a reader inside a critical section
+uint64_t RCUContext::oldestReaderEpoch() const
 {
-    uint64_t now = gracePeriod.load();
+    uint64_t oldest = UINT64_MAX;
+
+    for (const ReaderSlot &slot : readers) {
+        uint64_t e = slot.epoch.load();
+        if (e != 0 && e < oldest) {
+            oldest = e;
+        }
+    }
+    return oldest;
+}
 
-    while (!reclaimItems.empty()) {
-        const auto &item{reclaimItems.front()};
+// Invoke reclaim items added before the given epoch
+void RCUContext::reclaimBefore(uint64_t before)
+{
+    while (pendingHead && pendingHead->epoch < before) {
+        ReclaimItem *item = pendingHead;
 
-        // Only reclaim items whose grace period has expired
-        if (item.first == now) {
-            return;
+        pendingHead = item->next;
+        if (!pendingHead) {
+            pendingTail = nullptr;
         }
 
-        item.second();
-        reclaimItems.pop();
+        item->invoke(item);
+
+        item->next = freeItems;
+        freeItems = item;
+    }
+}
+
+void RCUContext::reclaim()
+{
+    if (!pendingHead) {
+        return;
+    }
+
+    // Readers entering from now on cannot see items already queued
+    epoch.fetch_add(1);
+
+    reclaimBefore(oldestReaderEpoch());
+}
+
+bool RCUContext::synchronize(std::chrono::milliseconds timeout)
+{
+    const uint64_t target = epoch.fetch_add(1) + 1;
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (oldestReaderEpoch() < target) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
     }
+
+    reclaimBefore(target);
+    return true;
 }
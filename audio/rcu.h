@@ -1,28 +1,37 @@
 // SPDX-License-Identifier: Apache-2.0
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <atomic>
-#include <queue>
+#include <chrono>
 #include <memory>
+#include <new>
 #include <utility>
-#include <functional>
+#include <vector>
 
 /*
- * RCUContext is a simplified Read-Copy-Update (RCU) implementation.  It only
- * supports a single reader and a single writer.  The writer also performs
- * reclamation.
+ * RCUContext is a simplified Read-Copy-Update (RCU) implementation.  It
+ * supports up to MAX_READERS concurrent readers and a single writer.  The
+ * writer also performs reclamation.
  *
  * Readers do not take locks, making RCU relevant for real-time programming
  * tasks where code is not allowed to block.
  *
+ * Grace periods are tracked with epochs.  Each reader thread uses its own
+ * reader slot and publishes the epoch it observed when entering a read-side
+ * critical section.  Reclaim items are tagged with the epoch in which they
+ * were added and are reclaimed once every reader is either outside a critical
+ * section or has entered one in a later epoch.  Readers that are not running
+ * do not hold up reclamation.
+ *
  * Reader example:
  *
  *   while (true) {
- *       rcu.readLock();
+ *       rcu.readLock(readerIndex);
  *       Object *shared = sharedPointer.load();
  *       ...safe to access shared until...
- *       rcu.readUnlock();
+ *       rcu.readUnlock(readerIndex);
  *   }
  *
  * Writer example:
@@ -30,46 +39,106 @@
  *   // Make readers see a new object
  *   sharedPointer.store(new Object{ ... });
  *   ...
- *   // Periodically delete old objects no longer accessible after reader
+ *   // Periodically delete old objects no longer accessible after readers
  *   // called rcu.readUnlock()
  *   rcu.reclaim();
  */
 class RCUContext
 {
 public:
+    enum {
+        MAX_READERS = 16,
+
+        // Number of reclaim items allocated at a time
+        RECLAIM_BLOCK_SIZE = 256,
+    };
+
     RCUContext();
     ~RCUContext();
 
-    void readLock();
-    void readUnlock();
+    // Each concurrent reader must use a different reader index. Read-side
+    // critical sections cannot be nested.
+    void readLock(unsigned int reader = 0);
+    void readUnlock(unsigned int reader = 0);
+
+    // Call f() once all current readers have left their critical sections.
+    // f is stored inline in a preallocated reclaim item so this does not
+    // allocate unless all items are in use.
+    template<typename F>
+    void addReclaimItem(F f)
+    {
+        static_assert(sizeof(F) <= sizeof(ReclaimItem::storage),
+                      "reclaim function object too large");
+        static_assert(alignof(F) <= alignof(max_align_t),
+                      "reclaim function object alignment too large");
+
+        ReclaimItem *item = allocReclaimItem();
+        new (item->storage) F{std::move(f)};
+        item->invoke = [](ReclaimItem *item_) {
+            F *fn = reinterpret_cast<F *>(item_->storage);
+            (*fn)();
+            fn->~F();
+        };
+        queueReclaimItem(item);
+    }
 
-    void addReclaimItem(std::function<void ()> f);
     void reclaim();
 
-private:
-    // Incremented by reader, fetched by updater and reclaimer
-    std::atomic<uint64_t> gracePeriod;
+    // Wait until all readers have left the critical sections they were in
+    // when this was called. Returns false on timeout.
+    bool synchronize(std::chrono::milliseconds timeout);
 
-    // Appended to by updater, emptied by reclaimer
-    std::queue<std::pair<uint64_t, std::function<void ()>>> reclaimItems;
+private:
+    struct ReclaimItem
+    {
+        ReclaimItem *next;
+        uint64_t epoch;
+        void (*invoke)(ReclaimItem *item);
+        alignas(max_align_t) unsigned char storage[48];
+    };
+
+    // Each reader slot has its own cache line
+    struct alignas(64) ReaderSlot
+    {
+        // Epoch observed by readLock(), 0 outside critical sections
+        std::atomic<uint64_t> epoch;
+    };
+
+    // Incremented by reclaimer, fetched by readers and updater
+    std::atomic<uint64_t> epoch;
+
+    ReaderSlot readers[MAX_READERS];
+
+    // Owned by the updater and reclaimer
+    std::vector<std::unique_ptr<ReclaimItem[]>> itemBlocks;
+    ReclaimItem *freeItems;
+    ReclaimItem *pendingHead; // oldest first
+    ReclaimItem *pendingTail;
+
+    void allocReclaimBlock();
+    ReclaimItem *allocReclaimItem();
+    void queueReclaimItem(ReclaimItem *item);
+    uint64_t oldestReaderEpoch() const;
+    void reclaimBefore(uint64_t before);
 };
 
 class RCUReadLocker
 {
 public:
-    RCUReadLocker(RCUContext *rcu_)
-        : rcu{rcu_}
+    RCUReadLocker(RCUContext *rcu_, unsigned int reader_ = 0)
+        : rcu{rcu_}, reader{reader_}
     {
-        rcu->readLock();
+        rcu->readLock(reader);
     }
 
     ~RCUReadLocker()
     {
-        rcu->readUnlock();
+        rcu->readUnlock(reader);
     }
 
 private:
     RCUContext *rcu;
+    unsigned int reader;
 };
 
 template<
@@ -1,7 +1,7 @@
 // SPDX-License-Identifier: Apache-2.0
-#include <inttypes.h>
 #include <QQmlError>
 #include <QSettings>
+#include <QThread>
 #include "config.h"
 #include "AppView.h"
 #include "QmlGlobals.h"
@@ -29,11 +29,62 @@ void AppView::setupSSLVerification()
     QSslConfiguration::setDefaultConfiguration(sslConfig);
 }
 
+// Parallel mixing helps large sessions with small audio buffer sizes
+void AppView::setupMixThreads()
+{
+    QSettings settings;
+
+    settings.beginGroup("audio");
+
+    // Workers spin while waiting for each other so never use more threads
+    // than there are CPUs
+    int nthreads = qMin(settings.value("mixThreads", 1).toInt(),
+                        QThread::idealThreadCount());
+    if (nthreads > 1) {
+        qDebug("Mixing playback streams on %d threads", nthreads);
+        processor.setMixThreads(nthreads);
+    }
+}
+
+// Decoding and resampling remote channels is spread across threads so large
+// sessions are not limited by one CPU core
+void AppView::setupStreamThreads()
+{
+    QSettings settings;
+
+    settings.beginGroup("audio");
+
+    int nthreads = qMin(settings.value("streamThreads", 4).toInt(),
+                        QThread::idealThreadCount());
+    if (nthreads > 1) {
+        qDebug("Processing audio streams on %d threads", nthreads);
+        streamService.setThreads(nthreads);
+    }
+}
+
+// Service streams as soon as they run low instead of only every
+// SAFE_PERIODIC_TICK_MSEC so that stream buffers can be smaller
+void AppView::setupWatermarkWakeup()
+{
+    QSettings settings;
+
+    settings.beginGroup("audio");
+
+    if (!settings.value("watermarkWakeup", false).toBool()) {
+        return;
+    }
+
+    qDebug("Using watermark wakeups with %d ms stream buffers",
+           WATERMARK_BUFFER_MSEC);
+    processor.setWatermarks(WATERMARK_BUFFER_MSEC, WATERMARK_LOW_MSEC);
+}
+
 AppView::AppView(const QString &format, const QUrl &url, QWindow *parent)
-    : QQuickView{parent}, transportResetPending{false}
+    : QQuickView{parent}, streamService{&processor},
+      transportResetPending{false}
 {
-    // Minimize timer skew because we need to process audio samples regularly
-    processAudioStreamsTimer.setTimerType(Qt::PreciseTimer);
+    connect(&refreshAudioPropertiesTimer, &QTimer::timeout,
+            this, &AppView::refreshAudioProperties);
 
     qmlGlobals_ = new QmlGlobals{this, format};
 
@@ -45,6 +96,11 @@ AppView::AppView(const QString &format, const QUrl &url, QWindow *parent)
     setMinimumSize(QSize{800, 600});
 
     setupSSLVerification();
+    setupMixThreads();
+    setupStreamThreads();
+    setupWatermarkWakeup();
+
+    streamService.start();
 
     // Now load the QML
     setSource(url);
@@ -52,65 +108,30 @@ AppView::AppView(const QString &format, const QUrl &url, QWindow *parent)
 
 AppView::~AppView()
 {
+    streamService.stop();
+
     // Delete qmlGlobals now so audio streams are destroyed before processor
     delete qmlGlobals_;
 }
 
-void AppView::processAudioStreamsTick()
-{
-    // Warn if timer jitter might cause performance problems
-    qint64 now = audioRunningTimer.nsecsElapsed();
-    if (lastProcessAudioStreamsTick != 0) {
-        int64_t duration = now - lastProcessAudioStreamsTick;
-        if (duration > 2 * SAFE_PERIODIC_TICK_MSEC * 1000 * 1000) {
-            qWarning("%s called %" PRId64 " ns after last time", __func__, duration);
-        }
-    }
-    lastProcessAudioStreamsTick = now;
-
-    if (!processor.isRunning()) {
-        return;
-    }
-
-    // So that set setRunning can be called from another thread
-    QMutexLocker locker{&processorWriteLock};
-
-    emit processAudioStreams();
-
-    processor.tick();
-}
-
-void AppView::startProcessAudioStreamsTimer()
+void AppView::startRefreshAudioPropertiesTimer()
 {
-    if (processAudioStreamsTimer.isActive()) {
-        return;
-    }
-
     // setRunning(false) may have been called before our slot was invoked
     if (!processor.isRunning()) {
         return;
     }
 
-    // Emit processAudioStreams() immediately to minimize latency
-    {
-        QMutexLocker locker{&processorWriteLock};
-        emit processAudioStreams();
-    }
-
-    lastProcessAudioStreamsTick = 0;
-    connect(&processAudioStreamsTimer, &QTimer::timeout,
-            this, &AppView::processAudioStreamsTick);
-    processAudioStreamsTimer.start(SAFE_PERIODIC_TICK_MSEC);
+    refreshAudioPropertiesTimer.start(SAFE_PERIODIC_TICK_MSEC);
 }
 
-void AppView::stopProcessAudioStreamsTimer()
+void AppView::stopRefreshAudioPropertiesTimer()
 {
     // setRunning(true) may have been called before our slot was invoked
     if (processor.isRunning()) {
         return;
     }
 
-    processAudioStreamsTimer.stop();
+    refreshAudioPropertiesTimer.stop();
 }
 
 SampleTime AppView::currentSampleTime() const
@@ -121,26 +142,31 @@ SampleTime AppView::currentSampleTime() const
 // May be called from another thread
 void AppView::setAudioRunning(bool enabled)
 {
-    QMutexLocker locker{&processorWriteLock};
+    QMutexLocker locker{streamService.lock()};
 
     audioRunningTimer.start();
     processor.setRunning(enabled);
 
+    // Fill playback streams immediately to minimize latency
+    if (enabled) {
+        streamService.requestService();
+    }
+
     QMetaObject::invokeMethod(this,
-            enabled ? "startProcessAudioStreamsTimer" :
-                      "stopProcessAudioStreamsTimer",
+            enabled ? "startRefreshAudioPropertiesTimer" :
+                      "stopRefreshAudioPropertiesTimer",
             Qt::QueuedConnection);
 }
 
 // The part of transport reset that runs in the Qt thread
 void AppView::transportReset()
 {
-    QMutexLocker locker{&processorWriteLock};
+    QMutexLocker locker{streamService.lock()};
 
     processor.setRunning(false);
     audioRunningTimer.start();
     processor.setRunning(true);
-    emit processAudioStreams();
+    streamService.requestService();
     transportResetPending.store(false);
 }
 
@@ -1,11 +1,12 @@
 // SPDX-License-Identifier: Apache-2.0
 #pragma once
 
-#include <QMutex>
 #include <QQuickView>
 #include <QTimer>
 #include <QElapsedTimer>
+#include <atomic>
 #include "audio/AudioProcessor.h"
+#include "AudioStreamService.h"
 
 // Don't #include it because of the circular dependency on AppView
 class QmlGlobals;
@@ -30,6 +31,11 @@ public:
         return &processor;
     }
 
+    AudioStreamService *audioStreamService()
+    {
+        return &streamService;
+    }
+
     // Can be called from any thread
     void setSampleRate(int sampleRate) {
         processor.setSampleRate(sampleRate);
@@ -48,30 +54,30 @@ public slots:
     void setAudioRunning(bool enabled);
 
 signals:
-    // Emitted periodically to allow draining capture streams and refilling
-    // playback streams.
-    void processAudioStreams();
+    // Emitted periodically in the Qt thread while audio is running to update
+    // properties that are always changing, like peak volume. Audio streams
+    // are processed by AudioStreamService in its own thread.
+    void refreshAudioProperties();
 
 private slots:
-    void processAudioStreamsTick();
-    void startProcessAudioStreamsTimer();
-    void stopProcessAudioStreamsTimer();
+    void startRefreshAudioPropertiesTimer();
+    void stopRefreshAudioPropertiesTimer();
     void transportReset();
 
 private:
     AudioProcessor processor;
+    AudioStreamService streamService;
     std::atomic<bool> transportResetPending;
 
     // For currentSampleTime()
     QElapsedTimer audioRunningTimer;
 
-    // Protects setAudioRunning() vs processAudioStreamsTick()
-    QMutex processorWriteLock;
-
-    QTimer processAudioStreamsTimer;
-    qint64 lastProcessAudioStreamsTick;
+    QTimer refreshAudioPropertiesTimer;
 
     QmlGlobals *qmlGlobals_;
 
     void setupSSLVerification();
+    void setupMixThreads();
+    void setupStreamThreads();
+    void setupWatermarkWakeup();
 };
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <chrono>
+#include <QMutexLocker>
+#include "AudioStreamService.h"
+
+AudioStreamService::AudioStreamService(AudioProcessor *processor_)
+    : processor{processor_}, thread{nullptr}, quit{false},
+      serviceRequested{false}
+{
+}
+
+AudioStreamService::~AudioStreamService()
+{
+    stop();
+}
+
+void AudioStreamService::start()
+{
+    if (thread) {
+        return;
+    }
+
+    quit.store(false);
+    thread = QThread::create([this]() { run(); });
+    thread->setObjectName("AudioStreamService");
+    thread->start(QThread::HighPriority);
+}
+
+void AudioStreamService::stop()
+{
+    if (!thread) {
+        return;
+    }
+
+    quit.store(true);
+    processor->interruptServiceWait();
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+}
+
+void AudioStreamService::setThreads(unsigned int nthreads)
+{
+    assert(!thread);
+    workerPool.setThreads(nthreads);
+}
+
+QRecursiveMutex *AudioStreamService::lock()
+{
+    return &lock_;
+}
+
+void AudioStreamService::addClient(IAudioStreamClient *client,
+                                   Priority priority)
+{
+    QMutexLocker locker{&lock_};
+
+    auto pos = std::upper_bound(clients.begin(), clients.end(), priority,
+        [](Priority p, const Client &c) { return p < c.priority; });
+    clients.insert(pos, {priority, client});
+}
+
+void AudioStreamService::removeClient(IAudioStreamClient *client)
+{
+    QMutexLocker locker{&lock_};
+
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+        [client](const Client &c) { return c.client == client; }),
+        clients.end());
+}
+
+void AudioStreamService::requestService()
+{
+    serviceRequested.store(true);
+    processor->interruptServiceWait();
+}
+
+void AudioStreamService::run()
+{
+    using namespace std::chrono;
+    const milliseconds period{SAFE_PERIODIC_TICK_MSEC};
+    auto deadline = steady_clock::now();
+
+    while (true) {
+        auto timeout = ceil<milliseconds>(deadline - steady_clock::now());
+        bool lowWater = timeout.count() > 0 &&
+                        processor->waitForServiceRequest(timeout);
+        if (quit.load()) {
+            break;
+        }
+
+        bool requested = serviceRequested.exchange(false);
+        auto now = steady_clock::now();
+
+        if (now >= deadline) {
+            // Warn if scheduling jitter might cause performance problems
+            int64_t late = duration_cast<nanoseconds>(now - deadline).count();
+            processor->stats()->addTick(late);
+            if (late > duration_cast<nanoseconds>(period).count()) {
+                qWarning("Audio stream servicing %" PRId64 " ns late", late);
+            }
+            deadline = now + period;
+        } else if (!lowWater && !requested) {
+            continue; // woken up without a reason, e.g. stale requestService()
+        }
+
+        serviceClients();
+    }
+}
+
+void AudioStreamService::serviceClients()
+{
+    QMutexLocker locker{&lock_};
+
+    if (!processor->isRunning()) {
+        return;
+    }
+
+    // Clients are sorted by priority already, order them by deadline within
+    // each priority
+    schedule.clear();
+    for (auto first = clients.begin(); first != clients.end(); ) {
+        auto last = std::find_if(first, clients.end(), [first](const Client &c) {
+            return c.priority != first->priority;
+        });
+
+        const size_t start = schedule.size();
+        for (auto it = first; it != last; ++it) {
+            schedule.push_back(it->client);
+        }
+        std::stable_sort(schedule.begin() + start, schedule.end(),
+            [](IAudioStreamClient *a, IAudioStreamClient *b) {
+                return a->serviceDeadline() < b->serviceDeadline();
+            });
+
+        first = last;
+    }
+
+    workerPool.run(schedule.data(), schedule.size());
+
+    processor->tick();
+}
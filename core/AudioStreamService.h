@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <QRecursiveMutex>
+#include <QThread>
+#include <atomic>
+#include <vector>
+#include "audio/AudioProcessor.h"
+#include "AudioStreamWorkerPool.h"
+#include "IAudioStreamClient.h"
+
+/*
+ * AudioStreamService drains capture streams and refills playback streams on a
+ * dedicated thread so that Vorbis decoding, resampling, and encoding keep up
+ * even while the Qt thread is busy repainting or blocked.
+ *
+ * Clients are serviced every SAFE_PERIODIC_TICK_MSEC, when the real-time
+ * thread requests service because a stream crossed its low-water mark (see
+ * AudioProcessor::setWatermarks()), and when requestService() is called.
+ * Each pass services clients in priority order, and by deadline within the
+ * same priority, and then calls AudioProcessor::tick(). Clients can be
+ * spread across several threads, see setThreads().
+ *
+ * lock() is held for a whole pass. Code in other threads must hold it while
+ * adding or removing clients, modifying the AudioProcessor's playback streams,
+ * or starting and stopping the AudioProcessor, and may have to wait for a pass
+ * to finish. Everything else that clients share with other threads, such as
+ * properties and received data, is handed over with atomics or the client's
+ * own short-lived locks instead. The lock is recursive so it can be held
+ * across calls that take it again. Do not emit signals while holding it.
+ * Clients must not emit signals to objects in the Qt thread with direct
+ * connections.
+ */
+class AudioStreamService
+{
+public:
+    // Playback streams are refilled before capture streams are drained since
+    // playback underruns are audible locally right away
+    enum Priority {
+        PLAYBACK,
+        CAPTURE,
+    };
+
+    AudioStreamService(AudioProcessor *processor);
+    ~AudioStreamService();
+
+    void start();
+    void stop();
+
+    // Process clients on nthreads threads including the service thread. Call
+    // while stopped.
+    void setThreads(unsigned int nthreads);
+
+    QRecursiveMutex *lock();
+
+    // Does not take ownership of client
+    void addClient(IAudioStreamClient *client, Priority priority);
+    void removeClient(IAudioStreamClient *client);
+
+    // Service clients as soon as possible, may be called from any thread
+    void requestService();
+
+private:
+    struct Client
+    {
+        Priority priority;
+        IAudioStreamClient *client;
+    };
+
+    AudioProcessor *processor;
+    QRecursiveMutex lock_;
+    std::vector<Client> clients; // sorted by priority
+    std::vector<IAudioStreamClient *> schedule; // for serviceClients()
+    AudioStreamWorkerPool workerPool;
+    QThread *thread;
+    std::atomic<bool> quit;
+    std::atomic<bool> serviceRequested;
+
+    void run();
+    void serviceClients();
+};
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "AudioStreamWorkerPool.h"
+
+AudioStreamWorkerPool::AudioStreamWorkerPool()
+    : tasks{nullptr}, ntasks{0}, nextTask{0}, generation{0}, busyWorkers{0},
+      quit{false}
+{
+}
+
+AudioStreamWorkerPool::~AudioStreamWorkerPool()
+{
+    stopThreads();
+}
+
+void AudioStreamWorkerPool::setThreads(unsigned int nthreads)
+{
+    stopThreads();
+
+    // Workers may start after the next run() so tell them where to begin
+    quit = false;
+    const uint64_t startGeneration = generation;
+    for (unsigned int i = 1; i < nthreads; i++) {
+        QThread *thread = QThread::create([this, startGeneration]() {
+            workerLoop(startGeneration);
+        });
+        thread->setObjectName("AudioStreamWorker");
+        thread->start(QThread::HighPriority);
+        threads.push_back(thread);
+    }
+}
+
+unsigned int AudioStreamWorkerPool::getThreads() const
+{
+    return threads.size() + 1;
+}
+
+void AudioStreamWorkerPool::stopThreads()
+{
+    {
+        QMutexLocker locker{&mutex};
+        quit = true;
+        workAvailable.wakeAll();
+    }
+
+    for (QThread *thread : threads) {
+        thread->wait();
+        delete thread;
+    }
+    threads.clear();
+}
+
+void AudioStreamWorkerPool::run(IAudioStreamClient *const *clients,
+                                size_t nclients)
+{
+    tasks = clients;
+    ntasks = nclients;
+    nextTask.store(0);
+
+    // Not worth waking up workers for a single client
+    if (threads.empty() || nclients < 2) {
+        runTasks();
+        return;
+    }
+
+    {
+        QMutexLocker locker{&mutex};
+        busyWorkers = threads.size();
+        generation++;
+        workAvailable.wakeAll();
+    }
+
+    runTasks();
+
+    // Wait for all workers, even idle ones, so none still looks at the task
+    // queue when the next run() resets it
+    QMutexLocker locker{&mutex};
+    while (busyWorkers > 0) {
+        workDone.wait(&mutex);
+    }
+}
+
+void AudioStreamWorkerPool::runTasks()
+{
+    size_t i;
+    while ((i = nextTask.fetch_add(1)) < ntasks) {
+        tasks[i]->processAudioStreams();
+    }
+}
+
+// Runs in worker threads
+void AudioStreamWorkerPool::workerLoop(uint64_t lastGeneration)
+{
+    QMutexLocker locker{&mutex};
+
+    while (true) {
+        while (!quit && generation == lastGeneration) {
+            workAvailable.wait(&mutex);
+        }
+        if (quit) {
+            break;
+        }
+        lastGeneration = generation;
+
+        locker.unlock();
+        runTasks();
+        locker.relock();
+
+        if (--busyWorkers == 0) {
+            workDone.wakeOne();
+        }
+    }
+}
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <vector>
+#include "IAudioStreamClient.h"
+
+/*
+ * Worker threads that process independent audio stream clients in parallel
+ * so that decoding and resampling for many remote channels is not limited to
+ * one CPU core.
+ *
+ * run() hands out clients in the given order from a shared queue. Every
+ * thread, including the one that called run(), takes the next client as soon
+ * as it finishes the previous one, so a few expensive clients do not hold up
+ * the rest. Sort clients by deadline so the most urgent ones start first.
+ */
+class AudioStreamWorkerPool
+{
+public:
+    AudioStreamWorkerPool();
+    ~AudioStreamWorkerPool();
+
+    // Use nthreads threads including the thread that calls run(). 1 processes
+    // clients on the calling thread only. Do not call while run() is active.
+    void setThreads(unsigned int nthreads);
+    unsigned int getThreads() const;
+
+    // Call processAudioStreams() on each client and wait until all are done
+    void run(IAudioStreamClient *const *clients, size_t nclients);
+
+private:
+    QMutex mutex;
+    QWaitCondition workAvailable;
+    QWaitCondition workDone;
+    std::vector<QThread *> threads;
+    IAudioStreamClient *const *tasks;
+    size_t ntasks;
+    std::atomic<size_t> nextTask;
+    uint64_t generation; // incremented by run()
+    unsigned int busyWorkers;
+    bool quit;
+
+    void stopThreads();
+    void workerLoop(uint64_t lastGeneration);
+    void runTasks();
+};
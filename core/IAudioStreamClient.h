@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include "audio/AudioStream.h" // for SampleTime
+
+/*
+ * IAudioStreamClient is implemented by objects that drain capture streams or
+ * refill playback streams. AudioStreamService calls processAudioStreams() from
+ * its own thread or a worker thread while holding AudioStreamService::lock().
+ * Clients may be processed in parallel with each other, so they must only
+ * modify their own state. State shared with the Qt thread should be guarded
+ * by the client itself so that the Qt thread does not wait for a whole pass.
+ */
+class IAudioStreamClient
+{
+public:
+    virtual ~IAudioStreamClient() {}
+
+    // Drain capture streams and/or refill playback streams
+    virtual void processAudioStreams() = 0;
+
+    // Returns the sample time when the client's streams run dry. Clients with
+    // earlier deadlines are processed first.
+    virtual SampleTime serviceDeadline() const
+    {
+        return 0;
+    }
+};
@@ -27,9 +27,10 @@ struct MessageHeader
     quint8 type;
     quint32 length; // bytes, not including this header
 } Q_PACKED;
+static_assert(sizeof(MessageHeader) == MessageParser::HEADER_SIZE);
 
 JamConnection::JamConnection(QObject *parent)
-    : QObject{parent}, payloadSize{0}, maxChannels{0}
+    : QObject{parent}, bytesSent_{0}, maxChannels{0}
 {
     sendKeepaliveTimer.setSingleShot(true);
     receiveKeepaliveTimer.setSingleShot(true);
@@ -51,6 +52,8 @@ JamConnection::JamConnection(QObject *parent)
 #endif
     connect(&socket, &QTcpSocket::readyRead,
             this, &JamConnection::socketReadyRead);
+    connect(&socket, &QTcpSocket::bytesWritten,
+            this, &JamConnection::socketBytesWritten);
 }
 
 JamConnection::~JamConnection()
@@ -84,10 +87,38 @@ void JamConnection::connectToServer(const QString &server,
     username_ = username;
     hexToken_ = hexToken;
     error_ = QString{};
-    payloadSize = 0;
+    receiveParser.clear();
+    bytesSent_ = 0;
+    uploadScheduler.clear();
     socket.connectToHost(fields.at(0), port);
 }
 
+qint64 JamConnection::uploadBacklog() const
+{
+    return socket.bytesToWrite() + uploadScheduler.pendingBytes();
+}
+
+void JamConnection::setUploadBudget(qint64 bytes)
+{
+    uploadScheduler.setBudget(bytes);
+}
+
+qint64 JamConnection::uploadDroppedBytes() const
+{
+    return uploadScheduler.droppedBytes();
+}
+
+qint64 JamConnection::bytesSent() const
+{
+    return bytesSent_;
+}
+
+void JamConnection::socketBytesWritten(qint64 bytes)
+{
+    bytesSent_ += bytes;
+    sendQueuedUploads();
+}
+
 void JamConnection::socketConnected()
 {
     // Wait for server to send us the auth challenge.  We don't emit connect()
@@ -116,6 +147,7 @@ void JamConnection::socketDisconnected()
 {
     qDebug("Socket disconnected");
     stopKeepaliveTimers();
+    uploadScheduler.clear();
     emit disconnected();
 }
 
@@ -146,7 +178,7 @@ void JamConnection::fail(const QString &errorString)
     error_ = errorString;
     emit error(error_);
 
-    payloadSize = 0;
+    receiveParser.clear();
     stopKeepaliveTimers();
     socket.abort();
 }
@@ -157,24 +189,7 @@ void JamConnection::socketError(QAbstractSocket::SocketError)
     fail(socket.errorString());
 }
 
-bool JamConnection::parseMessageHeader()
-{
-    MessageHeader header;
-    if (socket.peek(reinterpret_cast<char*>(&header),
-                    sizeof(header)) != sizeof(header)) {
-        fail(tr("Unexpected short peek of message header"));
-        return false;
-    }
-
-    payloadSize = qFromLittleEndian(header.length);
-    if (payloadSize > 1 * 1024 * 1024) {
-        fail(tr("Payload size %1 is too large").arg(payloadSize));
-        return false;
-    }
-    return true;
-}
-
-bool JamConnection::parseAuthChallenge()
+bool JamConnection::parseAuthChallenge(const QByteArray &payload)
 {
     struct AuthChallenge
     {
@@ -185,16 +200,12 @@ bool JamConnection::parseAuthChallenge()
 
     AuthChallenge msg;
 
-    if (payloadSize != sizeof(msg)) {
-        fail(tr("Unexpected auth challenge payload size %1").arg(payloadSize));
-        return false;
-    }
-
-    if (socket.read(reinterpret_cast<char*>(&msg), sizeof(msg)) != sizeof(msg)) {
-        fail(tr("Unexpected short read of auth challenge"));
+    if (payload.size() != sizeof(msg)) {
+        fail(tr("Unexpected auth challenge payload size %1").arg(payload.size()));
         return false;
     }
 
+    memcpy(&msg, payload.constData(), sizeof(msg));
     msg.serverCapabilities = qFromLittleEndian(msg.serverCapabilities);
     msg.protocolVersion = qFromLittleEndian(msg.protocolVersion);
 
@@ -218,45 +229,31 @@ bool JamConnection::parseAuthChallenge()
     return sendAuthUser(msg.protocolVersion, msg.challenge);
 }
 
-bool JamConnection::parseAuthReply()
+bool JamConnection::parseAuthReply(const QByteArray &payload)
 {
     quint8 flag;
     quint8 errorMsgNul;
     quint8 maxChannels_;
     const qint64 minSize = sizeof(flag) + sizeof(errorMsgNul) + sizeof(maxChannels_);
 
-    if (payloadSize < minSize) {
-        fail(tr("Auth reply payload size %1 too small").arg(payloadSize));
-        return false;
-    }
-
-    if (socket.read(reinterpret_cast<char*>(&flag),
-                    sizeof(flag)) != sizeof(flag)) {
-        fail(tr("Short read of auth reply flag field"));
+    if (payload.size() < minSize) {
+        fail(tr("Auth reply payload size %1 too small").arg(payload.size()));
         return false;
     }
 
-    flag = noEndian8Bit(flag);
+    const char *p = payload.constData();
+    flag = noEndian8Bit(static_cast<quint8>(*p++));
     const bool authSuccess = flag & 0x1;
 
     QString errorMsg;
-    const qint64 errorSize = payloadSize - minSize;
+    const qint64 errorSize = payload.size() - minSize;
     if (errorSize > 0) {
-        const QByteArray errorBytes{socket.read(errorSize)};
-        if (errorBytes.size() != errorSize) {
-            fail(tr("Unexpected auth reply error size %1 (expected %2)").arg(errorBytes.size()).arg(errorSize));
-            return false;
-        }
-
-        errorMsg = QString::fromUtf8(errorBytes);
+        errorMsg = QString::fromUtf8(p, errorSize);
+        p += errorSize;
     }
 
-    if (socket.read(reinterpret_cast<char *>(&errorMsgNul),
-                    sizeof(errorMsgNul)) != sizeof(errorMsgNul)) {
-        fail(tr("Short read of auth reply error message NUL byte"));
-        return false;
-    }
-    if (noEndian8Bit(errorMsgNul) != '\0') {
+    errorMsgNul = noEndian8Bit(static_cast<quint8>(*p++));
+    if (errorMsgNul != '\0') {
         fail(tr("Expected error message NUL byte, got %1").arg(errorMsgNul));
         return false;
     }
@@ -267,18 +264,14 @@ bool JamConnection::parseAuthReply()
     }
     // On success errorMsg may contain an updated username, but we discard it.
 
-    if (socket.read(reinterpret_cast<char*>(&maxChannels_),
-                    sizeof(maxChannels_)) != sizeof(maxChannels_)) {
-        fail(tr("Short read of auth reply max channels field"));
-        return false;
-    }
-    maxChannels = noEndian8Bit(maxChannels_);
+    maxChannels_ = noEndian8Bit(static_cast<quint8>(*p));
+    maxChannels = maxChannels_;
 
     emit connected();
     return true;
 }
 
-bool JamConnection::parseConfigChangeNotify()
+bool JamConnection::parseConfigChangeNotify(const QByteArray &payload)
 {
     struct ConfigChangeNotify
     {
@@ -286,24 +279,20 @@ bool JamConnection::parseConfigChangeNotify()
         quint16 bpi;
     } Q_PACKED;
 
-    if (payloadSize != sizeof(ConfigChangeNotify)) {
-        fail(tr("Invalid config change notify payload size %1").arg(payloadSize));
+    if (payload.size() != sizeof(ConfigChangeNotify)) {
+        fail(tr("Invalid config change notify payload size %1").arg(payload.size()));
         return false;
     }
 
     ConfigChangeNotify msg;
-    if (socket.read(reinterpret_cast<char*>(&msg),
-                    sizeof(msg)) != sizeof(msg)) {
-        fail(tr("Short read of config change notify"));
-        return false;
-    }
+    memcpy(&msg, payload.constData(), sizeof(msg));
 
     emit configChanged(qFromLittleEndian(msg.bpm),
                        qFromLittleEndian(msg.bpi));
     return true;
 }
 
-bool JamConnection::parseUserInfoChangeNotify()
+bool JamConnection::parseUserInfoChangeNotify(const QByteArray &payload)
 {
     struct UserInfoChangeNotify
     {
@@ -315,16 +304,11 @@ bool JamConnection::parseUserInfoChangeNotify()
     } Q_PACKED;
 
     QList<UserInfo> list;
-    QByteArray bytes = socket.read(payloadSize);
-    if (bytes.size() != payloadSize) {
-        fail(tr("Short read of user info change notify"));
-        return false;
-    }
 
     // Looping over a variable length list of variable length structures.
     // Let's go old-school for this.
-    const char *p = bytes.constData();
-    const char *end = bytes.constData() + bytes.size();
+    const char *p = payload.constData();
+    const char *end = payload.constData() + payload.size();
     while (p < end) {
         if (p + sizeof(UserInfoChangeNotify) > end) {
             fail(tr("Short user info change notify structure"));
@@ -381,7 +365,7 @@ bool JamConnection::parseUserInfoChangeNotify()
     return true;
 }
 
-bool JamConnection::parseDownloadIntervalBegin()
+bool JamConnection::parseDownloadIntervalBegin(const QByteArray &payload)
 {
     struct DownloadIntervalBegin
     {
@@ -392,34 +376,29 @@ bool JamConnection::parseDownloadIntervalBegin()
     } Q_PACKED;
     const qint64 minSize = sizeof(DownloadIntervalBegin);
 
-    if (payloadSize < minSize) {
-        fail(tr("Payload size for download interval begin too small %1").arg(payloadSize));
-        return false;
-    }
-
-    QByteArray bytes = socket.read(payloadSize);
-    if (bytes.size() != payloadSize) {
-        fail(tr("Short read in download interval begin"));
+    if (payload.size() < minSize) {
+        fail(tr("Payload size for download interval begin too small %1").arg(payload.size()));
         return false;
     }
 
     DownloadIntervalBegin msg;
-    memcpy(&msg, bytes.constData(), sizeof(msg));
+    memcpy(&msg, payload.constData(), sizeof(msg));
     msg.estimatedSize = qFromLittleEndian(msg.estimatedSize);
     msg.channelIndex = noEndian8Bit(msg.channelIndex);
-    bytes.remove(0, sizeof(msg));
 
-    if (bytes.size() < 1) {
+    const char *usernamePtr = payload.constData() + sizeof(msg);
+    const qint64 usernameSize = payload.size() - sizeof(msg);
+
+    if (usernameSize < 1) {
         fail(tr("Missing username field in download interval begin"));
         return false;
     }
-    if (!bytes.endsWith('\0')) {
-        fail(tr("Expected username NUL terminator in download interval begin, got %1").arg(bytes.back()));
+    if (!payload.endsWith('\0')) {
+        fail(tr("Expected username NUL terminator in download interval begin, got %1").arg(payload.back()));
         return false;
     }
-    bytes.remove(bytes.size() - 1, 1);
 
-    const QString username = QString::fromUtf8(bytes);
+    const QString username = QString::fromUtf8(usernamePtr, usernameSize - 1);
 
     if (msg.channelIndex >= maxChannels) {
         fail(tr("Download interval begin channel index %1 invalid with max channels %2 for user \"%3\"").arg(msg.channelIndex).arg(maxChannels).arg(username));
@@ -427,8 +406,8 @@ bool JamConnection::parseDownloadIntervalBegin()
     }
 
     QUuid guid = QUuid::fromRfc4122(
-            QByteArray(reinterpret_cast<const char*>(msg.guid),
-                       sizeof(msg.guid)));
+            QByteArray::fromRawData(reinterpret_cast<const char*>(msg.guid),
+                                    sizeof(msg.guid)));
     emit downloadIntervalBegan(guid,
                                msg.estimatedSize,
                                msg.fourCC,
@@ -437,38 +416,29 @@ bool JamConnection::parseDownloadIntervalBegin()
     return true;
 }
 
-bool JamConnection::parseDownloadIntervalWrite()
+bool JamConnection::parseDownloadIntervalWrite(const MessageParser::Message &msg)
 {
+    const QByteArrayView payload = msg.payload();
     const size_t guidSize = sizeof(quint8[16]);
     const qint64 fieldSize = guidSize + sizeof(quint8);
 
-    if (payloadSize < fieldSize) {
-        fail(tr("Payload size for download interval write too small %1").arg(payloadSize));
-        return false;
-    }
-
-    QByteArray bytes = socket.read(payloadSize);
-    if (bytes.size() != payloadSize) {
-        fail(tr("Short read in download interval write"));
+    if (payload.size() < fieldSize) {
+        fail(tr("Payload size for download interval write too small %1").arg(payload.size()));
         return false;
     }
 
-    QUuid guid{QUuid::fromRfc4122(bytes.left(guidSize))};
-    quint8 flags = noEndian8Bit(bytes.at(guidSize));
-    QByteArray audioData{bytes.right(payloadSize - fieldSize)};
+    QUuid guid{QUuid::fromRfc4122(
+            QByteArray::fromRawData(payload.constData(), guidSize))};
+    quint8 flags = noEndian8Bit(payload.at(guidSize));
 
-    emit downloadIntervalReceived(guid, audioData, flags & 0x1);
+    // Pass on the receive buffer, the audio data is not copied
+    emit downloadIntervalReceived(guid, msg.chunk, msg.offset + fieldSize,
+                                  payload.size() - fieldSize, flags & 0x1);
     return true;
 }
 
-bool JamConnection::parseChatMessage()
+bool JamConnection::parseChatMessage(const QByteArray &payload)
 {
-    QByteArray payload = socket.read(payloadSize);
-    if (payload.size() != payloadSize) {
-        fail(tr("Short read in chat message"));
-        return false;
-    }
-
     QList<QByteArray> fields = payload.split('\0');
     if (fields.size() != 6) {
         fail(tr("Invalid chat message fields received"));
@@ -483,42 +453,37 @@ bool JamConnection::parseChatMessage()
     return true;
 }
 
-bool JamConnection::parseKeepalive()
+bool JamConnection::parseKeepalive(const QByteArray &payload)
 {
-    if (payloadSize != 0) {
+    if (!payload.isEmpty()) {
         fail(tr("Expected empty keepalive payload"));
         return false;
     }
     return true;
 }
 
-bool JamConnection::parseMessage()
+bool JamConnection::parseMessage(const MessageParser::Message &msg)
 {
-    MessageHeader header;
-    if (socket.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)) {
-        fail(tr("Unexpected short read of message header"));
-        return false;
-    }
-
-    switch (noEndian8Bit(header.type)) {
+    // Control messages are small so they are copied out of the receive buffer
+    switch (noEndian8Bit(msg.type)) {
     case MSG_TYPE_SERVER_AUTH_CHALLENGE:
-        return parseAuthChallenge();
+        return parseAuthChallenge(msg.payload().toByteArray());
     case MSG_TYPE_SERVER_AUTH_REPLY:
-        return parseAuthReply();
+        return parseAuthReply(msg.payload().toByteArray());
     case MSG_TYPE_SERVER_CONFIG_CHANGE_NOTIFY:
-        return parseConfigChangeNotify();
+        return parseConfigChangeNotify(msg.payload().toByteArray());
     case MSG_TYPE_SERVER_USERINFO_CHANGE_NOTIFY:
-        return parseUserInfoChangeNotify();
+        return parseUserInfoChangeNotify(msg.payload().toByteArray());
     case MSG_TYPE_SERVER_DOWNLOAD_INTERVAL_BEGIN:
-        return parseDownloadIntervalBegin();
+        return parseDownloadIntervalBegin(msg.payload().toByteArray());
     case MSG_TYPE_SERVER_DOWNLOAD_INTERVAL_WRITE:
-        return parseDownloadIntervalWrite();
+        return parseDownloadIntervalWrite(msg);
     case MSG_TYPE_CHAT_MESSAGE:
-        return parseChatMessage();
+        return parseChatMessage(msg.payload().toByteArray());
     case MSG_TYPE_KEEPALIVE:
-        return parseKeepalive();
+        return parseKeepalive(msg.payload().toByteArray());
     default:
-        fail(tr("Invalid message type %#x").arg(noEndian8Bit(header.type)));
+        fail(tr("Invalid message type %#x").arg(noEndian8Bit(msg.type)));
         return false;
     }
 }
@@ -529,29 +494,23 @@ void JamConnection::socketReadyRead()
         receiveKeepaliveTimer.start();
     }
 
-    // Consume all messages available right now but don't fetch
-    // bytesAvailable() again (the next readyRead() signal will do that)
-    qint64 available = socket.bytesAvailable();
-    const qint64 messageHeaderSize = sizeof(MessageHeader);
+    // Read everything in one go so that messages share a single buffer
+    receiveParser.append(socket.readAll());
 
-    while (available >= messageHeaderSize + payloadSize) {
-        if (payloadSize == 0) {
-            if (!parseMessageHeader()) {
-                return;
-            }
-        }
-
-        if (available < messageHeaderSize + payloadSize) {
+    MessageParser::Message msg;
+    for (;;) {
+        switch (receiveParser.next(&msg)) {
+        case MessageParser::NEED_MORE_DATA:
             return;
-        }
-
-        bool ok = parseMessage();
-        if (!ok) {
+        case MessageParser::PAYLOAD_TOO_LARGE:
+            fail(tr("Payload size %1 is too large").arg(msg.length));
             return;
+        case MessageParser::MESSAGE:
+            if (!parseMessage(msg)) {
+                return;
+            }
+            break;
         }
-
-        available -= messageHeaderSize + payloadSize;
-        payloadSize = 0;
     }
 }
 
@@ -666,6 +625,56 @@ bool JamConnection::sendUploadIntervalBegin(const QUuid &guid,
                                             quint32 estimatedSize,
                                             const FourCC fourCC,
                                             quint8 channelIndex)
+{
+    if (socket.state() != QAbstractSocket::ConnectedState) {
+        return false;
+    }
+
+    const quint64 droppedIntervals = uploadScheduler.droppedIntervals();
+
+    UploadScheduler::FourCC schedulerFourCC;
+    memcpy(schedulerFourCC.data(), fourCC.val, sizeof(fourCC.val));
+    uploadScheduler.beginInterval(guid, estimatedSize, schedulerFourCC,
+                                  channelIndex);
+
+    if (uploadScheduler.droppedIntervals() != droppedIntervals) {
+        qWarning("Upload fell behind, dropped %llu intervals and %lld bytes "
+                 "so far",
+                 static_cast<unsigned long long>(uploadScheduler.droppedIntervals()),
+                 static_cast<long long>(uploadScheduler.droppedBytes()));
+    }
+
+    sendQueuedUploads();
+    return true;
+}
+
+bool JamConnection::sendUploadIntervalWrite(const QUuid &guid,
+                                            quint8 flags,
+                                            const QByteArray &data)
+{
+    if (socket.state() != QAbstractSocket::ConnectedState) {
+        return false;
+    }
+
+    uploadScheduler.writeInterval(guid, flags, data);
+    sendQueuedUploads();
+    return true;
+}
+
+// Move upload messages into the socket while within the budget
+void JamConnection::sendQueuedUploads()
+{
+    UploadScheduler::Message msg;
+    while (uploadScheduler.next(socket.bytesToWrite(), &msg)) {
+        bool ok = msg.begin ? writeUploadIntervalBegin(msg) :
+                              writeUploadIntervalWrite(msg);
+        if (!ok) {
+            return;
+        }
+    }
+}
+
+bool JamConnection::writeUploadIntervalBegin(const UploadScheduler::Message &msg_)
 {
     struct UploadIntervalBegin
     {
@@ -676,20 +685,17 @@ bool JamConnection::sendUploadIntervalBegin(const QUuid &guid,
     } Q_PACKED;
 
     UploadIntervalBegin msg;
-    memcpy(msg.guid, guid.toRfc4122().constData(), sizeof(msg.guid));
-    msg.estimatedSize = qToLittleEndian(estimatedSize);
-    msg.fourCC = fourCC;
-    msg.channelIndex = noEndian8Bit(channelIndex);
+    memcpy(msg.guid, msg_.guid.toRfc4122().constData(), sizeof(msg.guid));
+    msg.estimatedSize = qToLittleEndian(msg_.estimatedSize);
+    memcpy(msg.fourCC.val, msg_.fourCC.data(), sizeof(msg.fourCC.val));
+    msg.channelIndex = noEndian8Bit(msg_.channelIndex);
 
     return send(MSG_TYPE_CLIENT_UPLOAD_INTERVAL_BEGIN,
                 reinterpret_cast<const char*>(&msg),
                 sizeof(msg));
 }
 
-bool JamConnection::sendUploadIntervalWrite(const QUuid &guid,
-                                            quint8 flags,
-                                            const quint8 *data,
-                                            qint64 len)
+bool JamConnection::writeUploadIntervalWrite(const UploadScheduler::Message &msg_)
 {
     struct UploadIntervalWrite
     {
@@ -698,9 +704,10 @@ bool JamConnection::sendUploadIntervalWrite(const QUuid &guid,
     } Q_PACKED;
 
     UploadIntervalWrite msg;
-    memcpy(msg.guid, guid.toRfc4122().constData(), sizeof(msg.guid));
-    msg.flags = noEndian8Bit(flags);
+    memcpy(msg.guid, msg_.guid.toRfc4122().constData(), sizeof(msg.guid));
+    msg.flags = noEndian8Bit(msg_.flags);
 
+    const qint64 len = msg_.data.size();
     if (!send(MSG_TYPE_CLIENT_UPLOAD_INTERVAL_WRITE,
               reinterpret_cast<const char*>(&msg),
               sizeof(msg),
@@ -709,7 +716,7 @@ bool JamConnection::sendUploadIntervalWrite(const QUuid &guid,
     }
 
     // Plain socket.write() here to avoid copying audio data
-    if (socket.write(reinterpret_cast<const char*>(data), len) != len) {
+    if (socket.write(msg_.data.constData(), len) != len) {
         fail(tr("Short write of %1 bytes of audio data").arg(len));
         return false;
     }
@@ -4,6 +4,8 @@
 #include <QTcpSocket>
 #include <QTimer>
 #include <QUuid>
+#include "MessageParser.h"
+#include "UploadScheduler.h"
 
 /*
  * JamConnection implements the network protocol for online jamming.  It
@@ -52,11 +54,25 @@ public:
     // Fetch a human-readable error string after unexpected disconnect
     QString errorString() const;
 
+    // Bytes queued for upload but not yet sent
+    qint64 uploadBacklog() const;
+
+    // Maximum bytes of upload messages in the socket at once
+    void setUploadBudget(qint64 bytes);
+
+    // Bytes of audio data discarded because uploads fell behind
+    qint64 uploadDroppedBytes() const;
+
+    // Total bytes handed to the operating system since connectToServer()
+    qint64 bytesSent() const;
+
     // Mute/unmute another user's channels
     bool sendSetUsermask(const QString &username, quint32 mask);
 
     bool sendChannelInfo(const QList<ChannelInfo> &channels);
 
+    // Upload messages are queued and sent as the socket drains, see
+    // UploadScheduler
     bool sendUploadIntervalBegin(const QUuid &guid,
                                  quint32 estimatedSize,
                                  const FourCC fourCC,
@@ -64,8 +80,7 @@ public:
 
     bool sendUploadIntervalWrite(const QUuid &guid,
                                  quint8 flags,
-                                 const quint8 *data,
-                                 qint64 len);
+                                 const QByteArray &data);
 
     bool sendChatMessage(const QString &command,
                          const QString &arg1 = QString(),
@@ -98,8 +113,12 @@ signals:
                                quint8 channelIndex,
                                const QString &username);
 
+    // The audio data is size bytes at offset in chunk. chunk is the shared
+    // receive buffer so the data is not copied.
     void downloadIntervalReceived(const QUuid &guid,
-                                  const QByteArray &data,
+                                  const QByteArray &chunk,
+                                  qsizetype offset,
+                                  qsizetype size,
                                   bool last);
 
     void chatMessageReceived(const QString &command,
@@ -113,6 +132,7 @@ private slots:
     void socketDisconnected();
     void socketError(QAbstractSocket::SocketError);
     void socketReadyRead();
+    void socketBytesWritten(qint64 bytes);
     void sendKeepalive();
     void keepaliveExpired();
 
@@ -123,24 +143,28 @@ private:
     QTimer receiveKeepaliveTimer;   // when the other side didn't send keepalives
     QTcpSocket socket;
     QString error_;
-    qint64 payloadSize;
+    MessageParser receiveParser;
+    qint64 bytesSent_;
     quint8 maxChannels;
+    UploadScheduler uploadScheduler;
 
     void fail(const QString &errorString);
     void stopKeepaliveTimers();
 
-    bool parseMessageHeader();
-    bool parseAuthChallenge();
-    bool parseAuthReply();
-    bool parseConfigChangeNotify();
-    bool parseUserInfoChangeNotify();
-    bool parseDownloadIntervalBegin();
-    bool parseDownloadIntervalWrite();
-    bool parseChatMessage();
-    bool parseKeepalive();
-    bool parseMessage();
+    bool parseAuthChallenge(const QByteArray &payload);
+    bool parseAuthReply(const QByteArray &payload);
+    bool parseConfigChangeNotify(const QByteArray &payload);
+    bool parseUserInfoChangeNotify(const QByteArray &payload);
+    bool parseDownloadIntervalBegin(const QByteArray &payload);
+    bool parseDownloadIntervalWrite(const MessageParser::Message &msg);
+    bool parseChatMessage(const QByteArray &payload);
+    bool parseKeepalive(const QByteArray &payload);
+    bool parseMessage(const MessageParser::Message &msg);
 
     bool send(quint8 type, const char *data, size_t len, size_t extraDataLen = 0);
     bool send(quint8 type, const QByteArray &bytes, size_t extraDataLen = 0);
     bool sendAuthUser(quint32 protocolVersion, const quint8 challenge[8]);
+    void sendQueuedUploads();
+    bool writeUploadIntervalBegin(const UploadScheduler::Message &msg);
+    bool writeUploadIntervalWrite(const UploadScheduler::Message &msg);
 };
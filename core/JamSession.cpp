@@ -1,10 +1,40 @@
 // SPDX-License-Identifier: Apache-2.0
+#include <QSettings>
+#include <algorithm>
 #include "JamSession.h"
 #include "screensleep.h"
 
+// Vorbis qualities to choose from when uploading, e.g. "0.2,0,-0.1"
+static std::vector<float> uploadQualityLadder()
+{
+    QSettings settings;
+    const QStringList tiers =
+        settings.value("upload/qualityLadder").toStringList();
+
+    std::vector<float> ladder;
+    for (const QString &tier : tiers) {
+        bool ok = false;
+        float quality = tier.toFloat(&ok);
+        if (!ok || quality < -0.1f || quality > 1.f) {
+            qWarning("Ignoring invalid upload quality \"%s\"",
+                     tier.toLatin1().constData());
+            continue;
+        }
+        ladder.push_back(quality);
+    }
+
+    if (ladder.empty()) {
+        return UploadQualityController::defaultLadder();
+    }
+    std::sort(ladder.begin(), ladder.end(), std::greater<float>());
+    return ladder;
+}
+
 JamSession::JamSession(AppView *appView_, QObject *parent)
     : QObject{parent}, appView{appView_}, state_{JamSession::Unconnected},
-      metronome_{appView}, started{false}
+      metronome_{appView}, started{false},
+      uploadQualityController{uploadQualityLadder()}, uploadQueuedBytes{0},
+      lastBytesSent{0}
 {
     connect(&conn, &JamConnection::connected,
             this, &JamSession::connConnected);
@@ -23,8 +53,8 @@ JamSession::JamSession(AppView *appView_, QObject *parent)
     connect(&conn, &JamConnection::chatMessageReceived,
             this, &JamSession::connChatMessageReceived);
 
-    connect(appView, &AppView::processAudioStreams,
-            &metronome_, &Metronome::processAudioStreams);
+    connect(appView, &AppView::refreshAudioProperties,
+            &metronome_, &Metronome::refreshAudioProperties);
 
     createLocalChannels();
 }
@@ -40,11 +70,15 @@ void JamSession::createLocalChannels()
         processor,
         this
     };
-    connect(appView, &AppView::processAudioStreams,
-            chan, &LocalChannel::processAudioStreams);
+    connect(appView, &AppView::refreshAudioProperties,
+            chan, &LocalChannel::refreshAudioProperties);
+
+    // Emitted from the encoder thread
     connect(chan, &LocalChannel::uploadData,
-            this, &JamSession::uploadData);
+            this, &JamSession::uploadData, Qt::QueuedConnection);
+    chan->startEncoderThread();
     localChannels_.push_back(chan);
+    appView->audioStreamService()->addClient(chan, AudioStreamService::CAPTURE);
 
     emit localChannelsChanged();
 }
@@ -72,6 +106,10 @@ void JamSession::deleteRemoteUsers()
     auto tmp = remoteUsers_;
     remoteUsers_.clear();
     emit remoteUsersChanged();
+
+    // Publish all playback stream removals to the audio thread at once
+    QMutexLocker locker{appView->audioStreamService()->lock()};
+    PlaybackStreamTransaction transaction{appView->audioProcessor()};
     for (auto remoteUser : std::as_const(tmp)) {
         delete remoteUser;
     }
@@ -80,6 +118,13 @@ void JamSession::deleteRemoteUsers()
 JamSession::~JamSession()
 {
     abort();
+
+    // Local channels use metronome_ so stop servicing them before it goes away
+    for (auto chan : std::as_const(localChannels_)) {
+        appView->audioStreamService()->removeClient(chan);
+        delete chan;
+    }
+    localChannels_.clear();
 }
 
 SampleTime JamSession::currentIntervalTime() const
@@ -97,6 +142,13 @@ size_t JamSession::remainingIntervalTime(SampleTime pos) const
     return metronome_.remainingIntervalTime(pos);
 }
 
+void JamSession::stopLocalChannels()
+{
+    for (auto chan : std::as_const(localChannels_)) {
+        chan->stop();
+    }
+}
+
 JamSession::State JamSession::state() const
 {
     return state_;
@@ -158,9 +210,7 @@ void JamSession::disconnectFromServer()
     qDebug("Disconnecting from server %s...",
            server_.toLatin1().constData());
 
-    for (auto chan : std::as_const(localChannels_)) {
-        chan->stop();
-    }
+    stopLocalChannels();
 
     metronome_.stop();
     started = false;
@@ -172,6 +222,11 @@ void JamSession::connConnected()
 {
     screenPreventSleep();
 
+    uploadQualityController.reset();
+    uploadQueuedBytes = 0;
+    lastBytesSent = conn.bytesSent();
+    setUploadQuality(uploadQualityController.quality());
+
     QList<JamConnection::ChannelInfo> channelInfo;
     for (auto chan : std::as_const(localChannels_)) {
         channelInfo.append({chan->name(), 0, 0, 0});
@@ -185,9 +240,7 @@ void JamSession::connConnected()
 
 void JamSession::connDisconnected()
 {
-    for (auto chan : std::as_const(localChannels_)) {
-        chan->stop();
-    }
+    stopLocalChannels();
 
     metronome_.stop();
     started = false;
@@ -260,6 +313,12 @@ void JamSession::sendChatPrivMsg(const QString &username, const QString &msg)
 
 void JamSession::connUserInfoChanged(const QList<JamConnection::UserInfo> &changes)
 {
+    // Publish all playback stream changes to the audio thread at once.
+    // RemoteChannel takes the AudioStreamService lock itself when adding and
+    // removing streams, only the final commit needs it here.
+    AudioProcessor *processor = appView->audioProcessor();
+    processor->beginPlaybackStreamTransaction();
+
     bool emitRemoteUsersChanged = false;
     std::vector<QString> usersLeft;
     std::vector<QString> usersJoined;
@@ -302,6 +361,11 @@ void JamSession::connUserInfoChanged(const QList<JamConnection::UserInfo> &chang
         emitRemoteUsersChanged = true;
     }
 
+    {
+        QMutexLocker locker{appView->audioStreamService()->lock()};
+        processor->commitPlaybackStreamTransaction();
+    }
+
     if (emitRemoteUsersChanged) {
         emit remoteUsersChanged();
     }
@@ -362,7 +426,9 @@ void JamSession::connDownloadIntervalBegan(const QUuid &guid,
 }
 
 void JamSession::connDownloadIntervalReceived(const QUuid &guid,
-                                              const QByteArray &data,
+                                              const QByteArray &chunk,
+                                              qsizetype offset,
+                                              qsizetype size,
                                               bool last)
 {
     if (!remoteIntervals.contains(guid)) {
@@ -371,27 +437,67 @@ void JamSession::connDownloadIntervalReceived(const QUuid &guid,
         return;
     }
 
+    // Intervals are decoded in the AudioStreamService thread, RemoteInterval
+    // hands the data over itself
     auto remoteInterval = remoteIntervals[guid];
-    remoteInterval->appendData(data);
+    remoteInterval->appendData(chunk, offset, size);
     if (last) {
         remoteInterval->finishAppendingData();
         remoteIntervals.remove(guid);
     }
 }
 
+float JamSession::uploadQuality() const
+{
+    return uploadQualityController.quality();
+}
+
+void JamSession::setUploadQuality(float quality)
+{
+    for (auto chan : std::as_const(localChannels_)) {
+        chan->setUploadQuality(quality);
+    }
+}
+
+// Called once per interval to adapt upload quality to the uplink
+void JamSession::updateUploadQuality()
+{
+    const size_t oldTier = uploadQualityController.tier();
+    const qint64 bytesSent = conn.bytesSent();
+
+    float quality = uploadQualityController.update(conn.uploadBacklog(),
+                                                   uploadQueuedBytes,
+                                                   bytesSent - lastBytesSent);
+    uploadQueuedBytes = 0;
+    lastBytesSent = bytesSent;
+
+    const size_t tier = uploadQualityController.tier();
+    if (tier == oldTier) {
+        return;
+    }
+
+    if (tier > oldTier) {
+        qWarning("Upload is falling behind, lowering quality to %.2f",
+                 quality);
+    }
+    setUploadQuality(quality);
+    emit uploadQualityChanged();
+}
+
 void JamSession::uploadData(int channelIdx, const QUuid &guid,
                             const QByteArray &data, bool first, bool last)
 {
+    // The first local channel always exists so it marks interval boundaries
+    if (first && channelIdx == 0) {
+        updateUploadQuality();
+    }
+    uploadQueuedBytes += data.size();
+
     if (first) {
         JamConnection::FourCC fourCC{'O', 'G', 'G', 'v'};
         conn.sendUploadIntervalBegin(guid, 0, fourCC, channelIdx);
     }
     if (!guid.isNull()) {
-        conn.sendUploadIntervalWrite(
-            guid,
-            last ? 0x1 : 0x0,
-            reinterpret_cast<const quint8*>(data.constData()),
-            data.size()
-        );
+        conn.sendUploadIntervalWrite(guid, last ? 0x1 : 0x0, data);
     }
 }
@@ -7,6 +7,7 @@
 #include "LocalChannel.h"
 #include "Metronome.h"
 #include "RemoteUser.h"
+#include "UploadQualityController.h"
 
 /*
  * JamSession implements a running jam session, including responding to
@@ -22,6 +23,7 @@ class JamSession : public QObject, public IIntervalTime
     Q_PROPERTY(Metronome *metronome READ metronome NOTIFY metronomeChanged)
     Q_PROPERTY(QVector<LocalChannel*> localChannels READ localChannels NOTIFY localChannelsChanged)
     Q_PROPERTY(QVector<RemoteUser*> remoteUsers READ remoteUsers NOTIFY remoteUsersChanged)
+    Q_PROPERTY(float uploadQuality READ uploadQuality NOTIFY uploadQualityChanged)
 
 public:
     // Remember to update qml/session/ChordChart.qml if these enum constants
@@ -44,6 +46,9 @@ public:
     const QVector<LocalChannel*> localChannels() const;
     const QVector<RemoteUser*> remoteUsers() const;
 
+    // Vorbis quality currently used for uploads, lowered on slow uplinks
+    float uploadQuality() const;
+
     // Connect to a server, aborting any previous connection first. The state
     // will change to Connecting.
     Q_INVOKABLE
@@ -90,6 +95,8 @@ signals:
     void remoteUserJoined(const QString &who);
     void remoteUserLeft(const QString &who);
 
+    void uploadQualityChanged();
+
     // For error reporting, stateChanged() is emitted for actual state change
     void error(const QString &msg);
 
@@ -118,13 +125,23 @@ private:
     QHash<QString, RemoteUser*> remoteUsers_;
     bool started;
 
+    // Upload quality adapts to the socket backlog once per interval
+    UploadQualityController uploadQualityController;
+    qint64 uploadQueuedBytes; // during the current interval
+    qint64 lastBytesSent;
+
     // Remote intervals with downloads in progress
     QHash<QUuid, std::shared_ptr<RemoteInterval> > remoteIntervals;
 
     void createLocalChannels();
 
+    void stopLocalChannels();
+
     void deleteRemoteUsers();
 
+    void updateUploadQuality();
+    void setUploadQuality(float quality);
+
     void setState(State newState);
 
     // Disconnect immediately
@@ -142,7 +159,9 @@ private slots:
                                    quint8 channelIndex,
                                    const QString &username);
     void connDownloadIntervalReceived(const QUuid &guid,
-                                      const QByteArray &data,
+                                      const QByteArray &chunk,
+                                      qsizetype offset,
+                                      qsizetype size,
                                       bool last);
     void connChatMessageReceived(const QString &command,
                                  const QString &arg1,
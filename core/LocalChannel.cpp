@@ -1,4 +1,6 @@
 // SPDX-License-Identifier: Apache-2.0
+#include <string.h>
+#include <QMutexLocker>
 #include <QSettings>
 #include "LocalChannel.h"
 
@@ -21,16 +23,34 @@ LocalChannel::LocalChannel(const QString &name,
       captureStreams{captureLeft, captureRight},
       name_{name},
       channelIdx{channelIdx_},
-      send_{false},
       nextSend{true},
-      firstUploadData{true},
+      uploadQuality{OggVorbisEncoder::DEFAULT_QUALITY},
+      encoderQueue{ENCODER_QUEUE_BLOCKS},
+      send_{false},
+      firstBlock{true},
       started{false},
-      encoder{1, processor_->getSampleRate()},
+      restarted{false},
       nextCaptureTime{0},
       nextCaptureTimeValid{false},
+      pendingResetSampleRate{0},
+      encoderPool{1, processor_->getSampleRate()},
+      encoder{encoderPool.take()},
+      firstUploadData{true},
+      intervalOpen{false},
+      encoderThread{nullptr},
+      encoderQuit{false},
       dumpFileEnabled{dumpLocalChannelsEnabled()},
       dumpFileNum{0}
 {
+    for (int ch = 0; ch < CHANNELS_STEREO; ch++) {
+        captureBuf[ch].resize(ENCODER_BLOCK_SIZE);
+    }
+    encoderPool.refill();
+}
+
+LocalChannel::~LocalChannel()
+{
+    stopEncoderThread();
 }
 
 QString LocalChannel::name() const
@@ -46,15 +66,15 @@ void LocalChannel::setName(const QString &name)
 
 bool LocalChannel::send() const
 {
-    return nextSend;
+    return nextSend.load();
 }
 
 void LocalChannel::setSend(bool enable)
 {
-    if (nextSend == enable) {
+    if (nextSend.load() == enable) {
         return;
     }
-    nextSend = enable;
+    nextSend.store(enable);
     emit sendChanged();
 }
 
@@ -81,38 +101,143 @@ void LocalChannel::setGain(float gain_)
     emit gainChanged();
 }
 
+void LocalChannel::setUploadQuality(float quality)
+{
+    uploadQuality.store(quality);
+}
+
 void LocalChannel::start()
 {
-    started = true;
-    nextCaptureTimeValid = false;
+    {
+        QMutexLocker locker{&dumpFileNameLock};
+        dumpFileName = QString("dump-%1").arg(name_);
+    }
+    restarted.store(true);
+    started.store(true);
     // TODO sample-accurate way to sync up to start of interval
 }
 
 void LocalChannel::stop()
 {
-    started = false;
+    started.store(false);
 }
 
-void LocalChannel::processAudioStreams()
+void LocalChannel::startEncoderThread()
+{
+    if (encoderThread) {
+        return;
+    }
+
+    encoderQuit.store(false);
+    encoderThread = QThread::create([this]() {
+        while (!encoderQuit.load()) {
+            encoderWakeup.wait();
+            encodeQueuedBlocks();
+        }
+    });
+    encoderThread->setObjectName("LocalChannel encoder");
+    encoderThread->start();
+}
+
+void LocalChannel::stopEncoderThread()
+{
+    if (!encoderThread) {
+        return;
+    }
+
+    encoderQuit.store(true);
+    encoderWakeup.post();
+    encoderThread->wait();
+    delete encoderThread;
+    encoderThread = nullptr;
+}
+
+void LocalChannel::refreshAudioProperties()
 {
     // Periodically emit signal since peak volume is always changing
     emit peakVolumeChanged();
+}
 
+void LocalChannel::processAudioStreams()
+{
+    bool queued = captureAudio();
+
+    if (!encoderThread) {
+        encodeQueuedBlocks();
+    } else if (queued) {
+        encoderWakeup.post();
+    }
+}
+
+// Returns the next encoder queue block cleared for writing, or nullptr if the
+// queue is full
+LocalChannel::EncoderBlock *LocalChannel::acquireBlock()
+{
+    if (!encoderQueue.canWrite()) {
+        return nullptr;
+    }
+
+    EncoderBlock *block = &encoderQueue.writeCurrent();
+    block->nsamples = 0;
+    block->guid = QUuid();
+    block->resetSampleRate = 0;
+    block->first = false;
+    block->last = false;
+    block->silentInterval = false;
+    return block;
+}
+
+void LocalChannel::publishBlock()
+{
+    EncoderBlock &block = encoderQueue.writeCurrent();
+    block.resetSampleRate = pendingResetSampleRate;
+    pendingResetSampleRate = 0;
+    encoderQueue.writeNext();
+}
+
+// Read up to nsamples from the capture streams and mix down to mono
+size_t LocalChannel::captureBlock(float *samples, size_t nsamples)
+{
+    // Mix down to mono for now. Don't use AudioStream::readMixStereo() because
+    // that relies on AudioStream::pan. Leave AudioStream::pan alone for now.
+    // Stereo support will be added later and then panning can be done properly.
+    float *left = captureBuf[CHANNEL_LEFT].data();
+    float *right = captureBuf[CHANNEL_RIGHT].data();
+    size_t n;
+    n = captureStreams[CHANNEL_LEFT]->read(nextCaptureTime, left, nsamples);
+    nsamples = qMin(n, nsamples); // in case data was discarded
+    n = captureStreams[CHANNEL_RIGHT]->read(nextCaptureTime, right, nsamples);
+    assert(n == nsamples);
+
+    float pan = 0.5f; // linear stereo pan
+    memset(samples, 0, nsamples * sizeof(float));
+    mixSamples(left, samples, nsamples, pan * gain());
+    mixSamples(right, samples, nsamples, pan * gain());
+    return nsamples;
+}
+
+// Returns true if blocks were added to the encoder queue
+bool LocalChannel::captureAudio()
+{
     if (captureStreams[CHANNEL_LEFT]->checkResetAndClear() ||
         captureStreams[CHANNEL_RIGHT]->checkResetAndClear()) {
-        encoder.reset(processor->getSampleRate());
+        pendingResetSampleRate = processor->getSampleRate();
+    }
+
+    if (restarted.exchange(false)) {
+        nextCaptureTimeValid = false;
     }
 
-    if (!started) {
+    if (!started.load()) {
         captureStreams[CHANNEL_LEFT]->readDiscardAll();
         captureStreams[CHANNEL_RIGHT]->readDiscardAll();
-        return;
+        return false;
     }
 
     // Synchronize time to the capture stream
     if (!nextCaptureTimeValid) {
         if (!captureStreams[CHANNEL_LEFT]->peekReadSampleTime(&nextCaptureTime)) {
-            return;
+            return false;
         }
 
         // Discard any samples from before the current interval
@@ -126,80 +251,158 @@ void LocalChannel::processAudioStreams()
 
         // Don't start capturing if we haven't reached the start of the interval yet
         if (!captureStreams[CHANNEL_LEFT]->peekReadSampleTime(&nextCaptureTime)) {
-            return;
+            return false;
         }
 
         remainingIntervalTime = intervalTime->remainingIntervalTime(nextCaptureTime);
-        firstUploadData = true;
+        firstBlock = true;
         nextCaptureTimeValid = true;
     }
 
-    size_t readable =
-        qMin(captureStreams[CHANNEL_LEFT]->numSamplesReadable(),
-             captureStreams[CHANNEL_RIGHT]->numSamplesReadable());
-
-    // Mix down to mono for now. Don't use AudioStream::readMixStereo() because
-    // that relies on AudioStream::pan. Leave AudioStream::pan alone for now.
-    // Stereo support will be added later and then panning can be done properly.
-    auto left = std::vector<float>(readable);
-    auto right = std::vector<float>(readable);
-    auto samples = std::vector<float>(readable, 0.f);
-    size_t n;
-    n = captureStreams[CHANNEL_LEFT]->read(nextCaptureTime, left.data(), readable);
-    readable = qMin(n, readable); // in case data was discarded
-    n = captureStreams[CHANNEL_RIGHT]->read(nextCaptureTime, right.data(), readable);
-    assert(n == readable);
-    float pan = 0.5f; // linear stereo pan
-    mixSamples(left.data(), samples.data(), readable, pan * gain());
-    mixSamples(right.data(), samples.data(), readable, pan * gain());
+    bool queued = false;
+    for (;;) {
+        // Samples stay in the capture streams while the encoder queue is full.
+        // Keep room for an audio block and a silent interval marker.
+        if (encoderQueue.numWritable() < 2) {
+            break;
+        }
 
-    for (size_t i = 0; i < readable; i += n) {
-        n = qMin(readable - i, remainingIntervalTime); // only process up to next interval
-        remainingIntervalTime -= n;
-        nextCaptureTime += n;
+        size_t n = qMin<size_t>(ENCODER_BLOCK_SIZE, remainingIntervalTime);
+        n = qMin(n, captureStreams[CHANNEL_LEFT]->numSamplesReadable());
+        n = qMin(n, captureStreams[CHANNEL_RIGHT]->numSamplesReadable());
+        if (n == 0) {
+            break;
+        }
 
         if (send_) {
-            QByteArray data = encoder.encode(samples.data() + i, nullptr, n);
-            if (remainingIntervalTime == 0) {
-                data.append(encoder.encode(nullptr, nullptr, 0)); // drain encoder
-                if (dumpFileEnabled) {
-                    dumpFile.write(data);
-                }
-                emit uploadData(channelIdx, guid, data, firstUploadData, true);
-            } else if (data.size() > 0) {
-                if (dumpFileEnabled) {
-                    if (firstUploadData) {
-                        dumpFile.close();
-                        dumpFile.setFileName(QString("dump-%1-%2.ogg").arg(name_).arg(dumpFileNum++));
-                        if (!dumpFile.open(QIODevice::WriteOnly)) {
-                            qWarning("Failed to open dump file \"%s\"",
-                                     dumpFile.fileName().toLatin1().constData());
-                        }
-                    }
-                    dumpFile.write(data);
-                }
-
-                emit uploadData(channelIdx, guid, data, firstUploadData, false);
-                firstUploadData = false;
+            EncoderBlock *block = acquireBlock();
+            n = captureBlock(block->samples, n);
+            if (n == 0) {
+                break;
+            }
+
+            block->nsamples = n;
+            block->guid = guid;
+            block->first = firstBlock;
+            block->last = n == remainingIntervalTime;
+            publishBlock();
+            firstBlock = false;
+            queued = true;
+        } else {
+            n = captureStreams[CHANNEL_LEFT]->readDiscard(nextCaptureTime, n);
+            captureStreams[CHANNEL_RIGHT]->readDiscard(nextCaptureTime, n);
+            if (n == 0) {
+                break;
             }
         }
 
+        remainingIntervalTime -= n;
+        nextCaptureTime += n;
+
         if (remainingIntervalTime == 0) {
-            send_ = nextSend;
-            firstUploadData = true;
+            send_ = nextSend.load();
+            firstBlock = true;
             if (send_) {
                 guid = QUuid::createUuid(); // random UUID
             } else {
                 guid = QUuid(); // null UUID for silence
-            }
-            encoder.reset();
 
-            // Still emit uploadData once per silent interval
-            if (!send_) {
-                emit uploadData(channelIdx, guid, QByteArray{}, true, true);
+                // Still emit uploadData once per silent interval
+                EncoderBlock *block = acquireBlock();
+                block->silentInterval = true;
+                publishBlock();
+                queued = true;
             }
 
             remainingIntervalTime = intervalTime->remainingIntervalTime(nextCaptureTime);
         }
     }
+    return queued;
+}
+
+// Encode all queued blocks and emit uploadData() once for the batch
+void LocalChannel::encodeQueuedBlocks()
+{
+    while (encoderQueue.canRead()) {
+        encodeBlock(encoderQueue.readCurrent());
+        encoderQueue.readNext();
+    }
+
+    if (!pendingUpload.isEmpty()) {
+        emitUploadData(false);
+    }
+
+    // Prepare the next interval's encoder while there is nothing to encode
+    encoderPool.refill();
+}
+
+void LocalChannel::encodeBlock(const EncoderBlock &block)
+{
+    if (block.resetSampleRate) {
+        encoderPool.setSampleRate(block.resetSampleRate);
+        nextEncoder();
+    }
+
+    // The previous interval was cut short by stop()
+    if ((block.first || block.silentInterval) && intervalOpen) {
+        if (!pendingUpload.isEmpty()) {
+            emitUploadData(false);
+        }
+        nextEncoder();
+        intervalOpen = false;
+    }
+
+    if (block.silentInterval) {
+        emit uploadData(channelIdx, QUuid(), QByteArray{}, true, true);
+        return;
+    }
+
+    if (block.first) {
+        // Start the interval with the requested quality
+        float quality = uploadQuality.load();
+        if (quality != encoderPool.quality()) {
+            encoderPool.setQuality(quality);
+            nextEncoder();
+        }
+
+        uploadGuid = block.guid;
+        firstUploadData = true;
+        intervalOpen = true;
+    }
+
+    pendingUpload.append(encoder->encode(block.samples, nullptr, block.nsamples));
+
+    if (block.last) {
+        pendingUpload.append(encoder->encode(nullptr, nullptr, 0)); // drain encoder
+        emitUploadData(true);
+        nextEncoder();
+        intervalOpen = false;
+    }
+}
+
+// Switch to a spare encoder instead of resetting the current one
+void LocalChannel::nextEncoder()
+{
+    encoderPool.recycle(std::move(encoder));
+    encoder = encoderPool.take();
+}
+
+void LocalChannel::emitUploadData(bool last)
+{
+    if (dumpFileEnabled) {
+        if (firstUploadData) {
+            QMutexLocker locker{&dumpFileNameLock};
+            dumpFile.close();
+            dumpFile.setFileName(QString("%1-%2.ogg").arg(dumpFileName).arg(dumpFileNum++));
+            if (!dumpFile.open(QIODevice::WriteOnly)) {
+                qWarning("Failed to open dump file \"%s\"",
+                         dumpFile.fileName().toLatin1().constData());
+            }
+        }
+        dumpFile.write(pendingUpload);
+    }
+
+    emit uploadData(channelIdx, uploadGuid, pendingUpload, firstUploadData, last);
+    firstUploadData = false;
+    pendingUpload.clear();
 }
@@ -2,17 +2,35 @@
 #pragma once
 
 #include <QFile>
+#include <QMutex>
+#include <QThread>
 #include <QUuid>
+#include <atomic>
+#include <memory>
+#include <vector>
 #include "audio/AudioProcessor.h"
 #include "audio/AudioStream.h"
+#include "audio/RingBuffer.h"
+#include "audio/Semaphore.h"
+#include "IAudioStreamClient.h"
 #include "IIntervalTime.h"
 #include "OggVorbisEncoder.h"
+#include "OggVorbisEncoderPool.h"
 
 /*
  * An audio channel that processes data from a local sound source. Handles
  * uploading intervals as well as pan and monitoring.
+ *
+ * processAudioStreams() may run in another thread. start() and stop() may be
+ * called from the Qt thread at any time.
+ *
+ * Capture and encoding are split. processAudioStreams() mixes captured
+ * samples into blocks on a preallocated lock-free queue and the encoder drains
+ * the queue. After startEncoderThread() the encoder runs in its own thread so
+ * slow Vorbis analysis does not hold up capture. Otherwise
+ * processAudioStreams() encodes the queued blocks itself.
  */
-class LocalChannel : public QObject
+class LocalChannel : public QObject, public IAudioStreamClient
 {
     Q_OBJECT
     Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
@@ -30,6 +48,7 @@ public:
                  AudioProcessor *processor,
                  IIntervalTime *intervalTime,
                  QObject *parent = nullptr);
+    ~LocalChannel();
 
     QString name() const;
     void setName(const QString &name);
@@ -39,14 +58,26 @@ public:
     float gain() const;
     void setGain(float gain_);
 
+    // Vorbis quality for uploads, takes effect at the next interval
+    void setUploadQuality(float quality);
+
     // Begin uploading data from the capture streams
     void start();
 
     // Stop uploading data from capture streams
     void stop();
 
+    // Encode in a background thread. uploadData() is then emitted from that
+    // thread. Call these before the channel is added to AudioStreamService or
+    // while holding AudioStreamService::lock().
+    void startEncoderThread();
+    void stopEncoderThread();
+
 public slots:
-    void processAudioStreams();
+    void processAudioStreams() override;
+
+    // Called periodically from the Qt thread
+    void refreshAudioProperties();
 
 signals:
     // Emitted when there is compressed audio data available for uploading.
@@ -62,23 +93,69 @@ signals:
     void gainChanged();
 
 private:
+    // Samples per encoder queue block
+    enum { ENCODER_BLOCK_SIZE = 1024 };
+
+    // Encoder queue length, a few seconds of audio
+    enum { ENCODER_QUEUE_BLOCKS = 256 };
+
+    // Mono audio or an interval marker handed from capture to the encoder
+    struct EncoderBlock
+    {
+        float samples[ENCODER_BLOCK_SIZE];
+        size_t nsamples;
+        QUuid guid;
+        int resetSampleRate; // reset the encoder first if non-zero
+        bool first;          // first block of an interval
+        bool last;           // last block of an interval
+        bool silentInterval; // no audio, the interval is not sent
+    };
+
     AudioProcessor *processor;
     IIntervalTime *intervalTime;
     AudioStream *captureStreams[CHANNELS_STEREO];
     QString name_;
     int channelIdx;
+    std::atomic<bool> nextSend;
+    std::atomic<float> uploadQuality;
+    RingBuffer<EncoderBlock> encoderQueue;
+
+    // Capture state
     bool send_;
-    bool nextSend;
-    bool firstUploadData;
-    bool started;
+    bool firstBlock;
+    std::atomic<bool> started;
+    std::atomic<bool> restarted; // resynchronize nextCaptureTime
     QUuid guid;
-    OggVorbisEncoder encoder;
     SampleTime nextCaptureTime;
     size_t remainingIntervalTime;
     bool nextCaptureTimeValid;
+    int pendingResetSampleRate;
+    std::vector<float> captureBuf[CHANNELS_STEREO];
+
+    // Encoder state
+    OggVorbisEncoderPool encoderPool;
+    std::unique_ptr<OggVorbisEncoder> encoder;
+    QUuid uploadGuid;
+    QByteArray pendingUpload;
+    bool firstUploadData;
+    bool intervalOpen;
+    QThread *encoderThread;
+    Semaphore encoderWakeup;
+    std::atomic<bool> encoderQuit;
 
     // Uploaded audio can be written to local files for debugging
     QFile dumpFile;
+    QMutex dumpFileNameLock;
+    QString dumpFileName; // copied from name_ in start()
     bool dumpFileEnabled;
     unsigned dumpFileNum;
+
+    bool captureAudio();
+    EncoderBlock *acquireBlock();
+    void publishBlock();
+    size_t captureBlock(float *samples, size_t nsamples);
+    void encodeQueuedBlocks();
+    void encodeBlock(const EncoderBlock &block);
+    void nextEncoder();
+    void emitUploadData(bool last);
 };
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <string.h>
+#include <QtEndian>
+#include "MessageParser.h"
+
+MessageParser::MessageParser()
+    : offset{0}, buffered{0}, failed{false}
+{
+}
+
+void MessageParser::clear()
+{
+    chunks.clear();
+    offset = 0;
+    buffered = 0;
+    failed = false;
+}
+
+void MessageParser::append(const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        return;
+    }
+
+    // QByteArray is implicitly shared so this does not copy the data
+    chunks.push_back(data);
+    buffered += data.size();
+}
+
+qint64 MessageParser::bufferedBytes() const
+{
+    return buffered;
+}
+
+// Copy len bytes without consuming them
+void MessageParser::peek(char *out, qsizetype len) const
+{
+    qsizetype pos = offset;
+    for (const QByteArray &chunk : chunks) {
+        qsizetype n = qMin(len, chunk.size() - pos);
+        memcpy(out, chunk.constData() + pos, n);
+        out += n;
+        len -= n;
+        pos = 0;
+        if (len == 0) {
+            break;
+        }
+    }
+}
+
+// Consume len bytes without looking at them
+void MessageParser::skip(qsizetype len)
+{
+    buffered -= len;
+
+    while (len > 0) {
+        qsizetype n = qMin(len, chunks.front().size() - offset);
+        len -= n;
+        offset += n;
+        if (offset == chunks.front().size()) {
+            chunks.pop_front();
+            offset = 0;
+        }
+    }
+}
+
+// Consume len bytes and return where they are. Bytes within one chunk are not
+// copied, *chunk shares it and *chunkOffset is their position.
+void MessageParser::take(qsizetype len, QByteArray *chunk,
+                         qsizetype *chunkOffset)
+{
+    buffered -= len;
+
+    const QByteArray &front = chunks.front();
+    if (offset + len <= front.size()) {
+        *chunk = front;
+        *chunkOffset = offset;
+        offset += len;
+        if (offset == front.size()) {
+            chunks.pop_front();
+            offset = 0;
+        }
+        return;
+    }
+
+    // Spans chunks, copy
+    QByteArray data;
+    data.reserve(len);
+    while (len > 0) {
+        const QByteArray &chunk = chunks.front();
+        qsizetype n = qMin(len, chunk.size() - offset);
+        data.append(chunk.constData() + offset, n);
+        len -= n;
+        offset += n;
+        if (offset == chunk.size()) {
+            chunks.pop_front();
+            offset = 0;
+        }
+    }
+    *chunk = data;
+    *chunkOffset = 0;
+}
+
+MessageParser::Result MessageParser::next(Message *msg)
+{
+    if (failed) {
+        return PAYLOAD_TOO_LARGE;
+    }
+    if (buffered < HEADER_SIZE) {
+        return NEED_MORE_DATA;
+    }
+
+    char header[HEADER_SIZE];
+    peek(header, sizeof(header));
+
+    quint32 length;
+    memcpy(&length, header + 1, sizeof(length));
+    msg->type = static_cast<quint8>(header[0]);
+    msg->length = qFromLittleEndian(length);
+    msg->chunk.clear();
+    msg->offset = 0;
+
+    if (msg->length > MAX_PAYLOAD_SIZE) {
+        failed = true;
+        return PAYLOAD_TOO_LARGE;
+    }
+    if (buffered < HEADER_SIZE + static_cast<qint64>(msg->length)) {
+        return NEED_MORE_DATA;
+    }
+
+    skip(HEADER_SIZE);
+    if (msg->length > 0) {
+        take(msg->length, &msg->chunk, &msg->offset);
+    }
+    return MESSAGE;
+}
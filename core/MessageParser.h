@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <deque>
+
+/*
+ * Incremental parser for the message framing of the jamming protocol
+ *
+ * Each message is a 1-byte type and a 32-bit little-endian payload length
+ * followed by the payload. Received data is added with append() in chunks of
+ * any size and next() returns complete messages.
+ *
+ * Messages refer to the chunk they were received in by offset, so audio data
+ * is not copied on its way to the decoder. Only a payload that spans two
+ * chunks is copied into a buffer of its own.
+ *
+ * The parser does not depend on a socket, so it can be tested with any
+ * input.
+ */
+class MessageParser
+{
+public:
+    enum {
+        HEADER_SIZE = 5,
+        MAX_PAYLOAD_SIZE = 1 * 1024 * 1024,
+    };
+
+    enum Result {
+        NEED_MORE_DATA,
+        MESSAGE,
+        PAYLOAD_TOO_LARGE, // the stream cannot be parsed any further
+    };
+
+    struct Message
+    {
+        quint8 type;
+        quint32 length; // payload length from the header
+
+        // The payload is length bytes at offset in chunk. chunk shares the
+        // received data and keeps it alive.
+        QByteArray chunk;
+        qsizetype offset;
+
+        // Valid as long as chunk is held
+        QByteArrayView payload() const
+        {
+            return QByteArrayView{chunk.constData() + offset, length};
+        }
+    };
+
+    MessageParser();
+
+    // Discard all buffered data and errors
+    void clear();
+
+    // Add received data. The buffer is kept and shared with messages.
+    void append(const QByteArray &data);
+
+    // Parse the next message into *msg if one is complete
+    Result next(Message *msg);
+
+    // Bytes received but not returned in a message yet
+    qint64 bufferedBytes() const;
+
+private:
+    std::deque<QByteArray> chunks;
+    qsizetype offset; // read position in chunks.front()
+    qint64 buffered;
+    bool failed;
+
+    void peek(char *out, qsizetype len) const;
+    void skip(qsizetype len);
+    void take(qsizetype len, QByteArray *chunk, qsizetype *chunkOffset);
+};
@@ -20,11 +20,14 @@ Metronome::Metronome(AppView *appView_, QObject *parent)
     nextBeatTimer.setTimerType(Qt::PreciseTimer);
     connect(&nextBeatTimer, &QTimer::timeout,
             this, &Metronome::checkNextBeat);
+
+    appView->audioStreamService()->addClient(this, AudioStreamService::PLAYBACK);
 }
 
 Metronome::~Metronome()
 {
     stop();
+    appView->audioStreamService()->removeClient(this);
 }
 
 QString Metronome::accentFilename() const
@@ -39,28 +42,38 @@ QString Metronome::clickFilename() const
 
 void Metronome::setAccentFilename(const QString &filename)
 {
-    accentFilename_ = filename;
+    {
+        QMutexLocker locker{&stateLock};
+        accentFilename_ = filename;
+    }
     emit accentFilenameChanged(filename);
 }
 
 void Metronome::setClickFilename(const QString &filename)
 {
-    clickFilename_ = filename;
+    {
+        QMutexLocker locker{&stateLock};
+        clickFilename_ = filename;
+    }
     emit clickFilenameChanged(filename);
 }
 
 SampleTime Metronome::currentIntervalTime() const
 {
+    QMutexLocker locker{&stateLock};
     return currentIntervalTime_;
 }
 
 SampleTime Metronome::nextIntervalTime() const
 {
+    QMutexLocker locker{&stateLock};
     return nextIntervalTime_;
 }
 
 size_t Metronome::remainingIntervalTime(SampleTime pos) const
 {
+    QMutexLocker locker{&stateLock};
+
     // We don't keep a history of past intervals
     assert(pos >= currentIntervalTime_);
 
@@ -77,17 +90,14 @@ size_t Metronome::remainingIntervalTime(SampleTime pos) const
     }
 }
 
+// Must be called with stateLock held
 void Metronome::nextBeat()
 {
     int sampleRate = appView->audioProcessor()->getSampleRate();
-    bool emitBpmChanged = false;
-    bool emitBpiChanged = false;
 
     beat_++;
     if (beat_ > bpi_) {
         beat_ = 1;
-        emitBpmChanged = bpm_ != nextBpm;
-        emitBpiChanged = bpi_ != nextBpi;
         bpm_ = nextBpm;
         bpi_ = nextBpi;
         currentIntervalTime_ = nextIntervalTime_;
@@ -95,21 +105,32 @@ void Metronome::nextBeat()
     }
 
     nextBeatSampleTime += 60. / bpm_ * sampleRate;
+}
 
-    if (emitBpmChanged) {
+void Metronome::checkNextBeat()
+{
+    const int oldBpm = bpm_;
+    const int oldBpi = bpi_;
+    bool beatAdvanced = false;
+
+    {
+        QMutexLocker locker{&stateLock};
+        while (nextBeatSampleTime <= appView->currentSampleTime()) {
+            nextBeat();
+            beatAdvanced = true;
+        }
+    }
+
+    // Emit after unlocking since slots may call back into the Metronome
+    if (bpm_ != oldBpm) {
         emit bpmChanged(bpm_);
     }
-    if (emitBpiChanged) {
+    if (bpi_ != oldBpi) {
         emit bpiChanged(bpi_);
     }
-    qDebug("beatChanged %d/%d", beat_, bpi_);
-    emit beatChanged(beat_);
-}
-
-void Metronome::checkNextBeat()
-{
-    while (nextBeatSampleTime <= appView->currentSampleTime()) {
-        nextBeat();
+    if (beatAdvanced) {
+        qDebug("beatChanged %d/%d", beat_, bpi_);
+        emit beatChanged(beat_);
     }
 
     // QTimer only has millisecond accuracy so sync against sample time to
@@ -123,6 +144,7 @@ void Metronome::checkNextBeat()
 
 void Metronome::setNextBpmBpi(int bpm, int bpi)
 {
+    QMutexLocker locker{&stateLock};
     nextBpm = bpm;
     nextBpi = bpi;
 }
@@ -163,13 +185,21 @@ static std::vector<float> loadOggSamples(const QString &filename, int outputSamp
 void Metronome::loadSamples()
 {
     int sampleRate = appView->audioProcessor()->getSampleRate();
+    QString accentFilename;
+    QString clickFilename;
+
+    {
+        QMutexLocker locker{&stateLock};
+        accentFilename = accentFilename_;
+        clickFilename = clickFilename_;
+    }
 
-    click = loadOggSamples(clickFilename_, sampleRate);
+    click = loadOggSamples(clickFilename, sampleRate);
 
-    if (accentFilename_.isEmpty()) {
+    if (accentFilename.isEmpty()) {
         accent = click;
     } else {
-        accent = loadOggSamples(accentFilename_, sampleRate);
+        accent = loadOggSamples(accentFilename, sampleRate);
     }
 }
 
@@ -179,29 +209,45 @@ void Metronome::start()
         return;
     }
 
-    stream = new AudioStream;
-    stream->setMonitorEnabled(monitor);
-
-    writeIntervalPos = 0;
+    AudioStream *newStream = new AudioStream;
+    newStream->setMonitorEnabled(monitor);
 
     // Kick off counting using checkNextBeat()
-    beat_ = nextBpi;
-    bpm_ = nextBpm;
-    bpi_ = nextBpi;
-    nextIntervalTime_ = appView->currentSampleTime();
-    nextBeatSampleTime = nextIntervalTime_;
+    {
+        QMutexLocker locker{&stateLock};
+        beat_ = nextBpi;
+        bpm_ = nextBpm;
+        bpi_ = nextBpi;
+        nextIntervalTime_ = appView->currentSampleTime();
+        nextBeatSampleTime = nextIntervalTime_;
+    }
     checkNextBeat();
 
-    appView->audioProcessor()->addPlaybackStream(stream);
-    processAudioStreams();
+    AudioStreamService *service = appView->audioStreamService();
+    {
+        QMutexLocker locker{service->lock()};
+        stream = newStream;
+        writeIntervalPos = 0;
+        appView->audioProcessor()->addPlaybackStream(stream);
+    }
+    service->requestService();
     emit gainChanged();
 }
 
 void Metronome::stop()
 {
-    if (stream) {
-        appView->audioProcessor()->removePlaybackStream(stream);
-        stream = nullptr;
+    bool stopped = false;
+
+    {
+        QMutexLocker locker{appView->audioStreamService()->lock()};
+        if (stream) {
+            appView->audioProcessor()->removePlaybackStream(stream);
+            stream = nullptr;
+            stopped = true;
+        }
+    }
+
+    if (stopped) {
         emit peakVolumeChanged();
         emit gainChanged();
     }
@@ -221,32 +267,70 @@ void Metronome::processAudioStreams()
     }
 
     /*
-     * Audio samples are pre-rendered in the Qt thread instead of rendered in
+     * Audio samples are pre-rendered in AudioStreamService instead of rendered in
      * the real-time audio thread. The BPM/BPI could be changed after samples
      * for the next interval have already been rendered. Ignore this for now
      * because it should not be very noticable. nextBeat() will update bpm_ and
      * bpi_ eventually so further audio samples will be rendered correctly.
      */
+    int bpm;
+    int bpi;
+    {
+        QMutexLocker locker{&stateLock};
+        bpm = bpm_;
+        bpi = bpi_;
+    }
     int sampleRate = appView->audioProcessor()->getSampleRate();
-    SampleTime samplesPerInterval = bpi_ * 60. / bpm_ * sampleRate;
-    SampleTime samplesPerBeat = 60. / bpm_ * sampleRate;
+    SampleTime samplesPerInterval = bpi * 60. / bpm * sampleRate;
+    SampleTime samplesPerBeat = 60. / bpm * sampleRate;
     size_t nsamples = stream->numSamplesWritable();
-    std::vector<float> buf(nsamples);
     size_t offset = writeIntervalPos % samplesPerBeat;
 
-    for (size_t i = 0; i < nsamples; i++) {
-        const std::vector<float> &clip =
-            writeIntervalPos / samplesPerBeat == 0 ?
-            accent : click;
-
-        buf[i] = offset < clip.size() ? clip[offset] : 0.f;
-        offset = (offset + 1) % samplesPerBeat;
-        writeIntervalPos = (writeIntervalPos + 1) % samplesPerInterval;
+    // Render directly into the stream's sample buffer
+    while (nsamples > 0) {
+        // The audio thread frees up descriptors as it reads, try again later
+        if (!stream->canQueueWrite(writeSampleTime, false)) {
+            break;
+        }
+
+        auto region = stream->writeAcquire(nsamples);
+        if (region.nsamples == 0) {
+            break;
+        }
+
+        SampleTime pos = writeIntervalPos;
+        size_t nextOffset = offset;
+        for (size_t i = 0; i < region.nsamples; i++) {
+            const std::vector<float> &clip =
+                pos / samplesPerBeat == 0 ? accent : click;
+
+            region.samples[i] =
+                nextOffset < clip.size() ? clip[nextOffset] : 0.f;
+            nextOffset = (nextOffset + 1) % samplesPerBeat;
+            pos = (pos + 1) % samplesPerInterval;
+        }
+
+        // Only advance the click timeline by what was actually queued
+        size_t n = stream->writeCommit(writeSampleTime, region.nsamples);
+        writeSampleTime += n;
+        writeIntervalPos = (writeIntervalPos + n) % samplesPerInterval;
+        if (n != region.nsamples) {
+            qWarning("%s short metronome stream commit (%zu of %zu samples)",
+                     __func__, n, region.nsamples);
+            break;
+        }
+        offset = nextOffset;
+        nsamples -= n;
     }
+}
 
-    stream->write(writeSampleTime, buf.data(), nsamples);
-    writeSampleTime += nsamples;
+SampleTime Metronome::serviceDeadline() const
+{
+    return writeSampleTime;
+}
 
+void Metronome::refreshAudioProperties()
+{
     // Periodically emit signal since peak volume is always changing
     emit peakVolumeChanged();
 }
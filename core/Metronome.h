@@ -1,11 +1,16 @@
 // SPDX-License-Identifier: Apache-2.0
 #pragma once
 
+#include <QMutex>
 #include <QTimer>
 
 #include "AppView.h"
+#include "IAudioStreamClient.h"
 
-class Metronome : public QObject
+// Beat counting runs in the Qt thread while clicks are rendered in the
+// AudioStreamService thread. State used by both is protected by stateLock,
+// which is only held briefly.
+class Metronome : public QObject, public IAudioStreamClient
 {
     Q_OBJECT
     Q_PROPERTY(int beat MEMBER beat_ NOTIFY beatChanged)
@@ -48,7 +53,11 @@ signals:
 public slots:
     void start();
     void stop();
-    void processAudioStreams();
+    void processAudioStreams() override;
+    SampleTime serviceDeadline() const override;
+
+    // Called periodically from the Qt thread
+    void refreshAudioProperties();
 
     // Set the BPM and BPI values for the next interval
     void setNextBpmBpi(int bpm, int bpi);
@@ -60,10 +69,12 @@ private:
     QTimer nextBeatTimer;
     AppView *appView;
     AudioStream *stream;
+
+    // Protects the following fields that are written in the Qt thread and read
+    // in the AudioStreamService thread
+    mutable QMutex stateLock;
     QString accentFilename_;
     QString clickFilename_;
-    std::vector<float> accent;
-    std::vector<float> click;
     int beat_;
     int bpm_;
     int bpi_;
@@ -71,6 +82,9 @@ private:
     int nextBpi;
     SampleTime currentIntervalTime_; // first sample of the next interval
     SampleTime nextIntervalTime_; // first sample of the next interval
+
+    std::vector<float> accent;
+    std::vector<float> click;
     SampleTime nextBeatSampleTime; // for syncing QTimer to audio stream
     SampleTime writeIntervalPos; // number of samples from start of interval
     SampleTime writeSampleTime; // stream write position
@@ -1,10 +1,13 @@
 // SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
 #include <errno.h>
+#include <string.h>
 #include <QFile>
 #include "OggVorbisDecoder.h"
 
 OggVorbisDecoder::OggVorbisDecoder(QObject *parent)
-    : QObject(parent), state_{State::Closed}
+    : QObject(parent), inputChunk{0}, inputOffset{0}, inputBytes{0},
+      state_{State::Closed}
 {
 }
 
@@ -16,6 +19,9 @@ OggVorbisDecoder::~OggVorbisDecoder()
 void OggVorbisDecoder::reset()
 {
     input.clear();
+    inputChunk = 0;
+    inputOffset = 0;
+    inputBytes = 0;
 
     if (state_ != State::Closed) {
         ov_clear(&ovfile);
@@ -42,15 +48,47 @@ int OggVorbisDecoder::sampleRate()
     return 0;
 }
 
+int OggVorbisDecoder::channels()
+{
+    if (!tryOpen()) {
+        return 0;
+    }
+
+    vorbis_info *info = ov_info(&ovfile, -1);
+    return info ? info->channels : 0;
+}
+
 // Read nmemb elements of size from input into the buffer at ptr
 size_t OggVorbisDecoder::readFunc(void *ptr, size_t size, size_t nmemb)
 {
     // Calculate how many elements to read
-    size_t n = qMin(nmemb, input.size() / size);
+    size_t n = qMin(nmemb, inputBytes / size);
     size_t nbytes = n * size;
+    char *out = static_cast<char*>(ptr);
 
-    memcpy(ptr, input.data(), nbytes);
-    input.remove(0, nbytes);
+    inputBytes -= nbytes;
+
+    // Copy across chunk boundaries
+    while (nbytes > 0) {
+        const InputChunk &chunk = input[inputChunk];
+        size_t m = qMin<size_t>(nbytes, chunk.size - inputOffset);
+
+        memcpy(out, chunk.data.constData() + chunk.offset + inputOffset, m);
+        out += m;
+        nbytes -= m;
+        inputOffset += m;
+
+        if (inputOffset == chunk.size) {
+            inputChunk++;
+            inputOffset = 0;
+        }
+    }
+
+    // Chunks are kept until the stream is open so tryOpen() can rewind after
+    // a failed attempt
+    if (state_ == State::Open) {
+        dropConsumedInput();
+    }
 
     // Clear errno because libvorbisfile checks it when 0 is returned
     errno = 0;
@@ -100,19 +138,21 @@ bool OggVorbisDecoder::tryOpen()
     };
     int ret;
 
-    // ov_open_callbacks() will completely consume input but we'll also need to
-    // restore it in case of failure.
-    QByteArray peekData{std::move(input)};
+    // ov_open_callbacks() may consume all input but we'll also need to
+    // restore it in case of failure
+    const size_t peekBytes = inputBytes;
 
-    ret = ov_open_callbacks(this, &ovfile, peekData.data(), peekData.size(),
-                            callbacks);
+    ret = ov_open_callbacks(this, &ovfile, nullptr, 0, callbacks);
     if (ret < 0) {
-        // Restore input so caller can try opening again later
-        input = std::move(peekData);
+        // Rewind input so caller can try opening again later
+        inputChunk = 0;
+        inputOffset = 0;
+        inputBytes = peekBytes;
         return false;
     }
 
     state_ = State::Open;
+    dropConsumedInput();
 
     // Check our assumptions about the input file
     long nstreams = ov_streams(&ovfile);
@@ -130,9 +170,9 @@ bool OggVorbisDecoder::tryOpen()
 }
 
 static ssize_t doDecode(OggVorbis_File *ovfile,
-                        QByteArray *left,
-                        QByteArray *right,
-                        size_t nsamples)
+                        float *const out[CHANNELS_STEREO],
+                        size_t nsamples,
+                        bool *mono)
 {
     float **samples;
     int bitstream;
@@ -151,44 +191,120 @@ static ssize_t doDecode(OggVorbis_File *ovfile,
     }
 
     // TODO stereo pan law?
-    left->append(reinterpret_cast<char*>(samples[0]),
-                 n * sizeof(samples[0][0]));
-    if (nchannels == 1) {
-        right->append(reinterpret_cast<char*>(samples[0]),
-                      n * sizeof(samples[0][0]));
-    } else {
-        right->append(reinterpret_cast<char*>(samples[1]),
-                      n * sizeof(samples[1][0]));
+    *mono = nchannels == 1;
+    for (int ch = 0; ch < nchannels; ch++) {
+        memcpy(out[ch], samples[ch], n * sizeof(samples[ch][0]));
     }
 
     return n;
 }
 
+void OggVorbisDecoder::appendData(const QByteArray &chunk, size_t offset,
+                                  size_t size)
+{
+    assert(offset + size <= static_cast<size_t>(chunk.size()));
+
+    if (size == 0) {
+        return;
+    }
+
+    // QByteArray is implicitly shared so this does not copy the data
+    input.push_back({chunk, offset, size});
+    inputBytes += size;
+}
+
 void OggVorbisDecoder::appendData(const QByteArray &data)
 {
-    input.append(data);
+    appendData(data, 0, data.size());
 }
 
-size_t OggVorbisDecoder::decode(QByteArray *left, QByteArray *right,
-                                size_t nsamples)
+// Release chunks that have been read completely
+void OggVorbisDecoder::dropConsumedInput()
+{
+    input.erase(input.begin(), input.begin() + inputChunk);
+    inputChunk = 0;
+}
+
+size_t OggVorbisDecoder::decode(float *const samples[CHANNELS_STEREO],
+                                size_t nsamples, bool *mono)
+{
+    if (!tryOpen()) {
+        return 0;
+    }
+
+    size_t decoded = 0;
+    while (decoded < nsamples) {
+        float *const out[CHANNELS_STEREO] = {
+            samples[CHANNEL_LEFT] + decoded,
+            samples[CHANNEL_RIGHT] + decoded,
+        };
+        ssize_t n = doDecode(&ovfile, out, nsamples - decoded, mono);
+        if (n <= 0) {
+            break;
+        }
+
+        decoded += n;
+    }
+
+    return decoded;
+}
+
+size_t OggVorbisDecoder::decodeInterleaved(float *samples, size_t nsamples)
 {
     if (!tryOpen()) {
         return 0;
     }
 
+    const int nchannels = channels();
     size_t decoded = 0;
     while (decoded < nsamples) {
-        ssize_t n = doDecode(&ovfile, left, right, nsamples - decoded);
+        float **pcm;
+        int bitstream;
+        long n = ov_read_float(&ovfile, &pcm, nsamples - decoded, &bitstream);
         if (n <= 0) {
             break;
         }
 
+        // The stream was validated in tryOpen() so the number of channels
+        // cannot change
+        float *out = samples + decoded * nchannels;
+        for (int ch = 0; ch < nchannels; ch++) {
+            for (long i = 0; i < n; i++) {
+                out[i * nchannels + ch] = pcm[ch][i];
+            }
+        }
+
         decoded += n;
     }
 
     return decoded;
 }
 
+size_t OggVorbisDecoder::decode(QByteArray *left, QByteArray *right,
+                                size_t nsamples)
+{
+    const int leftSize = left->size();
+    const int rightSize = right->size();
+
+    left->resize(leftSize + nsamples * sizeof(float));
+    right->resize(rightSize + nsamples * sizeof(float));
+    float *const samples[CHANNELS_STEREO] = {
+        reinterpret_cast<float*>(left->data() + leftSize),
+        reinterpret_cast<float*>(right->data() + rightSize),
+    };
+
+    bool mono = false;
+    size_t n = decode(samples, nsamples, &mono);
+    if (mono) {
+        memcpy(samples[CHANNEL_RIGHT], samples[CHANNEL_LEFT],
+               n * sizeof(float));
+    }
+
+    left->resize(leftSize + n * sizeof(float));
+    right->resize(rightSize + n * sizeof(float));
+    return n;
+}
+
 size_t OggVorbisDecoder::decodeFile(const char *filename,
                                     QByteArray *left,
                                     QByteArray *right,
@@ -3,11 +3,16 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <deque>
 #include <vorbis/vorbisfile.h>
+#include "audio/AudioStream.h" // for CHANNELS_STEREO
 
 // Ogg Vorbis audio decoder using libvorbisfile
 //
-// Call appendData() each time compressed audio data is received.
+// Call appendData() each time compressed audio data is received. The data is
+// not copied, chunks are kept in a queue and read in place. A chunk may be a
+// larger buffer, such as a network receive buffer, with the audio data at an
+// offset.
 //
 // Decode audio samples by calling decode(). If there is not enough compressed
 // audio data fewer samples than requested will be returned.
@@ -37,10 +42,24 @@ public:
     // should handle that just to be safe.
     int sampleRate();
 
-    // Fill the stereo left/right channels with up to nsamples of decoded
-    // samples. Returns the number of samples decoded or 0 if no more samples
-    // are available. More compressed audio data may be added with appendData()
-    // to resume decoding after 0 was returned.
+    // Number of channels (1 or 2), or 0 if not enough compressed audio data
+    // has been added yet to open the stream
+    int channels();
+
+    // Write up to nsamples of decoded samples into the planar buffers. Mono
+    // streams only write samples[CHANNEL_LEFT] and set *mono to true. Returns
+    // the number of samples decoded or 0 if no more samples are available.
+    // More compressed audio data may be added with appendData() to resume
+    // decoding after 0 was returned.
+    size_t decode(float *const samples[CHANNELS_STEREO], size_t nsamples,
+                  bool *mono);
+
+    // Write up to nsamples of decoded samples into an interleaved buffer with
+    // channels() samples per frame. Returns the number of frames decoded.
+    size_t decodeInterleaved(float *samples, size_t nsamples);
+
+    // Same as above but appends to the stereo left/right channels. Mono
+    // streams are copied into both channels.
     size_t decode(QByteArray *left, QByteArray *right, size_t nsamples);
 
     // One-shot convenience function to decode a whole file. Returns the number
@@ -50,17 +69,31 @@ public:
                              QByteArray *right,
                              int *sampleRate);
 
+    // Add size bytes of compressed audio data at offset in chunk
+    void appendData(const QByteArray &chunk, size_t offset, size_t size);
+
 public slots:
     // Add compressed audio data
     void appendData(const QByteArray &data);
 
 private:
+    struct InputChunk
+    {
+        QByteArray data;
+        size_t offset; // first byte of audio data in data
+        size_t size;
+    };
+
     OggVorbis_File ovfile;
-    QByteArray input;
+    std::deque<InputChunk> input; // chunks from appendData()
+    size_t inputChunk;            // chunk being read
+    size_t inputOffset;           // read position in input[inputChunk]
+    size_t inputBytes;            // unread bytes
     State state_;
 
     size_t readFunc(void *ptr, size_t size, size_t nmemb);
     static size_t readFunc_(void *ptr, size_t size, size_t nmemb,
                             void *datasource);
     bool tryOpen();
+    void dropConsumedInput();
 };
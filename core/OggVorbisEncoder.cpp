@@ -1,12 +1,44 @@
 // SPDX-License-Identifier: Apache-2.0
 #include "OggVorbisEncoder.h"
+#include <map>
+#include <tuple>
+#include <vector>
+#include <QMutex>
+#include <QMutexLocker>
 #include <vorbis/codec.h>
 #include <vorbis/vorbisenc.h>
 
+// Header packets only depend on the encoder settings so they are generated
+// once and shared by all encoders
+struct CachedPacket
+{
+    QByteArray data;
+    long b_o_s;
+    long e_o_s;
+    ogg_int64_t granulepos;
+    ogg_int64_t packetno;
+};
+
+typedef std::tuple<int, int, float> HeaderKey; // channels, rate, quality
+static QMutex headerCacheLock;
+static std::map<HeaderKey, std::vector<CachedPacket>> headerCache;
+
+static CachedPacket cachePacket(const ogg_packet &op)
+{
+    return CachedPacket{
+        QByteArray{reinterpret_cast<const char*>(op.packet),
+                   static_cast<int>(op.bytes)},
+        op.b_o_s,
+        op.e_o_s,
+        op.granulepos,
+        op.packetno,
+    };
+}
+
 OggVorbisEncoder::OggVorbisEncoder(int numChannels, int sampleRate,
-                                   QObject *parent)
+                                   float quality, QObject *parent)
     : QObject{parent}, numChannels_{numChannels}, sampleRate_{sampleRate},
-      ready_{false}
+      quality_{quality}, ready_{false}
 {
     assert(numChannels == 1 || numChannels == 2);
     ready_ = init();
@@ -34,6 +66,16 @@ int OggVorbisEncoder::sampleRate() const
     return sampleRate_;
 }
 
+float OggVorbisEncoder::quality() const
+{
+    return quality_;
+}
+
+void OggVorbisEncoder::setQuality(float quality)
+{
+    quality_ = quality;
+}
+
 // Returns true on success, false otherwise
 bool OggVorbisEncoder::init()
 {
@@ -48,8 +90,7 @@ bool OggVorbisEncoder::init()
 
     vorbis_info_init(&vi);
 
-    float quality = 0.f; // nominal bitrate ~64 kbps
-    ret = vorbis_encode_init_vbr(&vi, numChannels_, sampleRate_, quality);
+    ret = vorbis_encode_init_vbr(&vi, numChannels_, sampleRate_, quality_);
     if (ret != 0) {
         qWarning("vorbis_encoder_init_vbr failed %d", ret);
         ogg_stream_clear(&os);
@@ -102,9 +143,20 @@ void OggVorbisEncoder::reset(int sampleRate)
     ready_ = init();
 }
 
-// Returns true on success, false otherwise
-bool OggVorbisEncoder::writeHeader()
+// Returns the header packets for the current settings, generating them the
+// first time
+bool OggVorbisEncoder::headerPackets(std::vector<CachedPacket> *packets)
 {
+    const HeaderKey key{numChannels_, sampleRate_, quality_};
+    {
+        QMutexLocker locker{&headerCacheLock};
+        auto it = headerCache.find(key);
+        if (it != headerCache.end()) {
+            *packets = it->second;
+            return true;
+        }
+    }
+
     ogg_packet op;
     ogg_packet op_comm;
     ogg_packet op_code;
@@ -113,15 +165,42 @@ bool OggVorbisEncoder::writeHeader()
 
     vorbis_comment_init(&vc);
     ret = vorbis_analysis_headerout(&vd, &vc, &op, &op_comm, &op_code);
-    vorbis_comment_clear(&vc);
     if (ret != 0) {
+        vorbis_comment_clear(&vc);
         qWarning("vorbis_analysis_headerout failed %d", ret);
         return false;
     }
 
-    bool ok = ogg_stream_packetin(&os, &op) == 0 &&
-              ogg_stream_packetin(&os, &op_comm) == 0 &&
-              ogg_stream_packetin(&os, &op_code) == 0;
+    // Copy before vorbis_comment_clear() since op_comm points into vc
+    *packets = {cachePacket(op), cachePacket(op_comm), cachePacket(op_code)};
+    vorbis_comment_clear(&vc);
+
+    QMutexLocker locker{&headerCacheLock};
+    headerCache.emplace(key, *packets);
+    return true;
+}
+
+// Returns true on success, false otherwise
+bool OggVorbisEncoder::writeHeader()
+{
+    std::vector<CachedPacket> packets;
+    if (!headerPackets(&packets)) {
+        return false;
+    }
+
+    bool ok = true;
+    for (const CachedPacket &packet : packets) {
+        ogg_packet op;
+        op.packet = reinterpret_cast<unsigned char*>(
+                const_cast<char*>(packet.data.constData()));
+        op.bytes = packet.data.size();
+        op.b_o_s = packet.b_o_s;
+        op.e_o_s = packet.e_o_s;
+        op.granulepos = packet.granulepos;
+        op.packetno = packet.packetno;
+
+        ok = ok && ogg_stream_packetin(&os, &op) == 0;
+    }
 
     if (!ok) {
         qWarning("ogg_stream_packetin failed for header");
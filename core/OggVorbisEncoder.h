@@ -3,26 +3,40 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <vector>
 #include <vorbis/vorbisenc.h>
 #include <vorbis/codec.h>
 
+struct CachedPacket;
+
 // Ogg Vorbis audio encoder using libvorbisenc
 //
-// Encode audio by calling encode().
+// Encode audio by calling encode(). Header packets are identical for all
+// encoders with the same settings so they are generated once and cached.
 class OggVorbisEncoder : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(bool ready READ ready)
     Q_PROPERTY(int numChannels READ numChannels)
     Q_PROPERTY(int sampleRate READ sampleRate)
+    Q_PROPERTY(float quality READ quality)
 
 public:
-    OggVorbisEncoder(int numChannels, int sampleRate, QObject *parent = nullptr);
+    // Vorbis VBR quality from -0.1 (lowest) to 1.0 (highest)
+    static constexpr float DEFAULT_QUALITY = 0.f; // nominal bitrate ~64 kbps
+
+    OggVorbisEncoder(int numChannels, int sampleRate,
+                     float quality = DEFAULT_QUALITY,
+                     QObject *parent = nullptr);
     ~OggVorbisEncoder();
 
     bool ready() const;
     int numChannels() const;
     int sampleRate() const;
+    float quality() const;
+
+    // Takes effect on the next reset()
+    void setQuality(float quality);
 
     // Discard any state and reset the encoder
     void reset(int sampleRate = -1);
@@ -33,6 +47,7 @@ public:
 private:
     int numChannels_;
     int sampleRate_;
+    float quality_;
     bool ready_;         // successfully initialized and ready to encode?
     ogg_stream_state os;
     vorbis_info vi;
@@ -41,6 +56,7 @@ private:
 
     bool init();
     void cleanup();
+    bool headerPackets(std::vector<CachedPacket> *packets);
     bool writeHeader();
 };
 
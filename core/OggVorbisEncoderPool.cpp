@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "OggVorbisEncoderPool.h"
+
+OggVorbisEncoderPool::OggVorbisEncoderPool(int numChannels_, int sampleRate,
+                                           size_t nspare_)
+    : numChannels{numChannels_}, sampleRate_{sampleRate},
+      quality_{OggVorbisEncoder::DEFAULT_QUALITY}, nspare{nspare_}
+{
+}
+
+void OggVorbisEncoderPool::setSampleRate(int sampleRate)
+{
+    if (sampleRate == sampleRate_) {
+        return;
+    }
+
+    sampleRate_ = sampleRate;
+    spare.clear();
+}
+
+int OggVorbisEncoderPool::sampleRate() const
+{
+    return sampleRate_;
+}
+
+void OggVorbisEncoderPool::setQuality(float quality)
+{
+    if (quality == quality_) {
+        return;
+    }
+
+    quality_ = quality;
+    spare.clear();
+}
+
+float OggVorbisEncoderPool::quality() const
+{
+    return quality_;
+}
+
+std::unique_ptr<OggVorbisEncoder> OggVorbisEncoderPool::take()
+{
+    if (spare.empty()) {
+        return std::make_unique<OggVorbisEncoder>(numChannels, sampleRate_,
+                                                  quality_);
+    }
+
+    std::unique_ptr<OggVorbisEncoder> encoder = std::move(spare.back());
+    spare.pop_back();
+    return encoder;
+}
+
+void OggVorbisEncoderPool::recycle(std::unique_ptr<OggVorbisEncoder> encoder)
+{
+    if (encoder && encoder->numChannels() == numChannels) {
+        recycled.push_back(std::move(encoder));
+    }
+}
+
+void OggVorbisEncoderPool::refill()
+{
+    while (spare.size() < nspare) {
+        std::unique_ptr<OggVorbisEncoder> encoder;
+        if (recycled.empty()) {
+            encoder = std::make_unique<OggVorbisEncoder>(numChannels,
+                                                         sampleRate_,
+                                                         quality_);
+        } else {
+            encoder = std::move(recycled.back());
+            recycled.pop_back();
+            encoder->setQuality(quality_);
+            encoder->reset(sampleRate_);
+        }
+
+        if (!encoder->ready()) {
+            break;
+        }
+        spare.push_back(std::move(encoder));
+    }
+
+    recycled.clear();
+}
+
+size_t OggVorbisEncoderPool::numSpare() const
+{
+    return spare.size();
+}
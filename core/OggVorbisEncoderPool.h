@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "OggVorbisEncoder.h"
+
+/*
+ * Spare encoders that are ready to start a new stream
+ *
+ * Setting up an encoder is expensive, so switching to a new stream at an
+ * interval boundary takes a spare encoder instead of resetting the current
+ * one. Used encoders are recycled and reset later by refill() once there is
+ * time, for example when there is no audio waiting to be encoded.
+ *
+ * This class is not thread-safe.
+ */
+class OggVorbisEncoderPool
+{
+public:
+    OggVorbisEncoderPool(int numChannels, int sampleRate, size_t nspare = 1);
+
+    // Spare encoders with different settings are discarded
+    void setSampleRate(int sampleRate);
+    int sampleRate() const;
+    void setQuality(float quality);
+    float quality() const;
+
+    // Returns a ready encoder, building one right away if none are spare
+    std::unique_ptr<OggVorbisEncoder> take();
+
+    // Give back an encoder that is no longer needed
+    void recycle(std::unique_ptr<OggVorbisEncoder> encoder);
+
+    // Reset recycled encoders and build new ones until enough are spare
+    void refill();
+
+    size_t numSpare() const;
+
+private:
+    int numChannels;
+    int sampleRate_;
+    float quality_;
+    size_t nspare;
+    std::vector<std::unique_ptr<OggVorbisEncoder>> spare;
+    std::vector<std::unique_ptr<OggVorbisEncoder>> recycled;
+};
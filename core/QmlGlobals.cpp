@@ -1,13 +1,15 @@
 // SPDX-License-Identifier: Apache-2.0
 #include <QQmlEngine>
+#include <QVariantList>
 #include "QmlGlobals.h"
 #include "SessionListModel.h"
 
 QmlGlobals::QmlGlobals(AppView *appView_, const QString &format, QObject *parent)
-    : QObject(parent), appView{appView_}, format_{format}, session_{appView}
+    : QObject(parent), appView{appView_}, format_{format}, session_{appView},
+      dspLoad_{0.f}
 {
-    connect(appView, &AppView::processAudioStreams,
-            this, &QmlGlobals::processAudioStreams);
+    connect(appView, &AppView::refreshAudioProperties,
+            this, &QmlGlobals::refreshAudioProperties);
 }
 
 float QmlGlobals::masterPeakVolume() const
@@ -17,10 +19,48 @@ float QmlGlobals::masterPeakVolume() const
             appView->audioProcessor()->getMasterPeakVolume(CHANNEL_RIGHT)) / 2.f;
 }
 
-void QmlGlobals::processAudioStreams()
+template<typename T, size_t N>
+static QVariantList toVariantList(const T (&values)[N])
+{
+    QVariantList list;
+    for (const T &value : values) {
+        list.append(static_cast<qulonglong>(value));
+    }
+    return list;
+}
+
+QVariantMap QmlGlobals::audioStats() const
+{
+    const AudioStats::Snapshot snap =
+        appView->audioProcessor()->stats()->snapshot();
+
+    return {
+        {"callbacks", static_cast<qulonglong>(snap.callbacks)},
+        {"maxLoad", snap.maxLoad},
+        {"loadHistogram", toVariantList(snap.loadHistogram)},
+        {"inputUnderflows", static_cast<qulonglong>(snap.xruns[AudioStats::INPUT_UNDERFLOW])},
+        {"inputOverflows", static_cast<qulonglong>(snap.xruns[AudioStats::INPUT_OVERFLOW])},
+        {"outputUnderflows", static_cast<qulonglong>(snap.xruns[AudioStats::OUTPUT_UNDERFLOW])},
+        {"outputOverflows", static_cast<qulonglong>(snap.xruns[AudioStats::OUTPUT_OVERFLOW])},
+        {"streamUnderruns", static_cast<qulonglong>(snap.streamUnderruns)},
+        {"ticks", static_cast<qulonglong>(snap.ticks)},
+        {"maxTickJitterNsec", static_cast<qulonglong>(snap.maxTickJitterNsec)},
+        {"tickJitterHistogram", toVariantList(snap.jitterHistogram)},
+    };
+}
+
+void QmlGlobals::resetAudioStats()
+{
+    appView->audioProcessor()->stats()->reset();
+}
+
+void QmlGlobals::refreshAudioProperties()
 {
     // Periodically emit signal since peak volume is always changing
     emit masterPeakVolumeChanged();
+
+    dspLoad_ = appView->audioProcessor()->stats()->takePeakLoad();
+    emit dspLoadChanged();
 }
 
 void QmlGlobals::registerQmlTypes()
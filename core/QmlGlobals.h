@@ -2,6 +2,7 @@
 #pragma once
 
 #include <QUrl>
+#include <QVariantMap>
 #include "global.h"
 #include "AppView.h"
 #include "JamApiManager.h"
@@ -25,6 +26,10 @@ class QmlGlobals : public QObject
 
     Q_PROPERTY(float masterPeakVolume READ masterPeakVolume NOTIFY masterPeakVolumeChanged)
 
+    // Peak DSP load since the last update, 1.0 means the audio thread is
+    // running out of time
+    Q_PROPERTY(float dspLoad READ dspLoad NOTIFY dspLoadChanged)
+
 public:
     QmlGlobals(AppView *appView, const QString &format, QObject *parent = nullptr);
 
@@ -49,6 +54,14 @@ public:
     }
 
     float masterPeakVolume() const;
+    float dspLoad() const
+    {
+        return dspLoad_;
+    }
+
+    // Snapshot of audio performance counters for diagnostics
+    Q_INVOKABLE QVariantMap audioStats() const;
+    Q_INVOKABLE void resetAudioStats();
 
     // Register C++ classes with QML engine
     static void registerQmlTypes();
@@ -57,13 +70,15 @@ signals:
     void apiManagerChanged();
     void sessionChanged();
     void masterPeakVolumeChanged();
+    void dspLoadChanged();
 
 private:
     AppView *appView;
     QString format_;
     JamApiManager apiManager_;
     JamSession session_;
+    float dspLoad_;
 
 private slots:
-    void processAudioStreams();
+    void refreshAudioProperties();
 };
@@ -1,24 +1,53 @@
 // SPDX-License-Identifier: Apache-2.0
+#include <QSettings>
 #include "JamSession.h"
 #include "QmlGlobals.h"
 #include "RemoteChannel.h"
 
+// Lower the resampling quality if decoding uses more than this fraction of
+// real time
+static const double DECODE_BUDGET = 0.05;
+
+static Resampler::Quality defaultResampleQuality()
+{
+    QSettings settings;
+    int quality = settings.value("audio/resampleQuality",
+                                 Resampler::BestQuality).toInt();
+    return static_cast<Resampler::Quality>(
+            qBound<int>(Resampler::BestQuality, quality, Resampler::Linear));
+}
+
 RemoteChannel::RemoteChannel(const QString &name,
                              AppView *appView_,
                              QObject *parent)
     : QObject{parent}, appView{appView_}, name_{name}, nextPlaybackTime{0},
-      intervalStartTime{0} {
+      intervalStartTime{0}, enqueuedIntervals{0}, takenIntervals{0},
+      remoteSending_{false}, resampleQuality_{defaultResampleQuality()},
+      appliedResampleQuality{resampleQuality_.load()},
+      decodeTime{0}, decodedSamples{0} {
     AudioProcessor *processor = appView->audioProcessor();
 
+    resampler.setQuality(appliedResampleQuality);
+
     playbackStreams[CHANNEL_LEFT] = new AudioStream;
     playbackStreams[CHANNEL_RIGHT] = new AudioStream;
+
+    AudioStreamService *service = appView->audioStreamService();
+    QMutexLocker locker{service->lock()};
+    PlaybackStreamTransaction transaction{processor};
     processor->addPlaybackStream(playbackStreams[CHANNEL_LEFT]);
     processor->addPlaybackStream(playbackStreams[CHANNEL_RIGHT]);
+    service->addClient(this, AudioStreamService::PLAYBACK);
 }
 
 RemoteChannel::~RemoteChannel()
 {
     AudioProcessor *processor = appView->audioProcessor();
+    AudioStreamService *service = appView->audioStreamService();
+    QMutexLocker locker{service->lock()};
+    PlaybackStreamTransaction transaction{processor};
+
+    service->removeClient(this);
 
     processor->removePlaybackStream(playbackStreams[CHANNEL_LEFT]);
     processor->removePlaybackStream(playbackStreams[CHANNEL_RIGHT]);
@@ -64,10 +93,17 @@ bool RemoteChannel::underflow() const
 
 bool RemoteChannel::remoteSending() const
 {
-    if (intervals.isEmpty()) {
-        return false;
+    return remoteSending_;
+}
+
+void RemoteChannel::setRemoteSending(bool sending)
+{
+    if (sending == remoteSending_) {
+        return;
     }
-    return !intervals.last()->isSilence();
+
+    remoteSending_ = sending;
+    emit remoteSendingChanged(sending);
 }
 
 float RemoteChannel::peakVolume() const
@@ -93,35 +129,80 @@ void RemoteChannel::setGain(float gain_)
     emit gainChanged();
 }
 
-// Play nsamples of silence
-void RemoteChannel::fillWithSilence(size_t nsamples)
+Resampler::Quality RemoteChannel::resampleQuality() const
+{
+    return resampleQuality_.load();
+}
+
+// The resampler picks up the new quality in the AudioStreamService thread
+void RemoteChannel::setResampleQuality(Resampler::Quality quality)
 {
-    std::vector<float> silence(nsamples, 0.f);
-    playbackStreams[CHANNEL_LEFT]->write(nextPlaybackTime,
-                                         silence.data(),
-                                         nsamples);
-    playbackStreams[CHANNEL_RIGHT]->write(nextPlaybackTime,
-                                          silence.data(),
-                                          nsamples);
+    if (resampleQuality_.exchange(quality) == quality) {
+        return;
+    }
+    emit resampleQualityChanged();
 }
 
-// Play nsamples from current interval and return actual sample count played
-size_t RemoteChannel::fillFromInterval(size_t nsamples)
+// Returns true if both channels can queue a write at nextPlaybackTime. They
+// receive identical writes so they stay in lock-step.
+bool RemoteChannel::canQueueWrite(bool silence) const
 {
+    for (int ch = 0; ch < CHANNELS_STEREO; ch++) {
+        if (!playbackStreams[ch]->canQueueWrite(nextPlaybackTime, silence)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Play nsamples of silence and return actual sample count played
+size_t RemoteChannel::fillWithSilence(size_t nsamples)
+{
+    // Silence takes no space in the sample buffers and is skipped by the mixer
+    size_t n = playbackStreams[CHANNEL_LEFT]->writeSilence(nextPlaybackTime,
+                                                          nsamples);
+    size_t m = playbackStreams[CHANNEL_RIGHT]->writeSilence(nextPlaybackTime, n);
+    return qMin(n, m);
+}
+
+// Play nsamples from current interval and return actual sample count played.
+// *underflow is set if the interval ran out of audio data.
+size_t RemoteChannel::fillFromInterval(size_t nsamples, bool *underflow)
+{
+    *underflow = false;
+
     auto interval = intervals.first();
     interval->setSampleRate(appView->audioProcessor()->getSampleRate());
 
-    QByteArray left, right;
-    size_t n = interval->decode(&left, &right, nsamples);
+    // Decode directly into the playback stream sample buffers
+    size_t filled = 0;
+    while (filled < nsamples) {
+        auto left = playbackStreams[CHANNEL_LEFT]->writeAcquire(nsamples - filled);
+        auto right = playbackStreams[CHANNEL_RIGHT]->writeAcquire(left.nsamples);
+        size_t m = qMin(left.nsamples, right.nsamples);
+        if (m == 0) {
+            break;
+        }
 
-    playbackStreams[CHANNEL_LEFT]->write(nextPlaybackTime,
-            reinterpret_cast<const float*>(left.constData()),
-            n);
-    playbackStreams[CHANNEL_RIGHT]->write(nextPlaybackTime,
-            reinterpret_cast<const float*>(right.constData()),
-            n);
+        size_t n = interval->decode(left.samples, right.samples, m);
+        size_t nleft = playbackStreams[CHANNEL_LEFT]->writeCommit(
+                nextPlaybackTime + filled, n);
+        size_t nright = playbackStreams[CHANNEL_RIGHT]->writeCommit(
+                nextPlaybackTime + filled, n);
+        filled += qMin(nleft, nright);
+
+        if (nleft != n || nright != n) {
+            qWarning("%s short playback stream commit (%zu/%zu of %zu samples)",
+                     __func__, nleft, nright, n);
+            break;
+        }
+        if (n < m) {
+            *underflow = true;
+            break;
+        }
+    }
 
-    return n;
+    return filled;
 }
 
 // Returns true if done, false if we should try again
@@ -135,14 +216,21 @@ bool RemoteChannel::fillPlaybackStreams()
                        intervalStartTime - nextPlaybackTime :
                        session->remainingIntervalTime(nextPlaybackTime);
     size_t n = qMin(nwritable, remaining);
+    bool silence = intervals.isEmpty() || nextPlaybackTime < intervalStartTime;
+
+    // Check before decoding so that decoded samples are never dropped. The
+    // audio thread frees up descriptors as it reads.
+    if (!canQueueWrite(silence)) {
+        return true;
+    }
 
-    if (intervals.isEmpty() || nextPlaybackTime < intervalStartTime){
-        fillWithSilence(n);
+    if (silence) {
+        n = fillWithSilence(n);
     } else {
-        size_t fill = n;
-        n = fillFromInterval(fill);
+        bool underflow;
+        n = fillFromInterval(n, &underflow);
+        decodedSamples += n;
 
-        bool underflow = n < fill;
         if (underflow) {
             // TODO signal underflow
             intervalStartTime = nextPlaybackTime + remaining;
@@ -152,11 +240,17 @@ bool RemoteChannel::fillPlaybackStreams()
         if (finishedInterval || underflow) {
             intervals.removeFirst();
 
+            // Notify from the Qt thread since this runs in AudioStreamService
             if (intervals.isEmpty()) {
-                emit remoteSendingChanged(false);
+                size_t taken = takenIntervals;
+                QMetaObject::invokeMethod(this, [this, taken]() {
+                    // Still sending if more intervals were enqueued since
+                    if (taken == enqueuedIntervals) {
+                        setRemoteSending(false);
+                    }
+                }, Qt::QueuedConnection);
             } else if (intervals.first()->isSilence()) {
-                resampler[CHANNEL_LEFT].reset();
-                resampler[CHANNEL_RIGHT].reset();
+                resampler.reset();
             }
         }
     }
@@ -171,36 +265,109 @@ void RemoteChannel::processAudioStreams()
     bool wasResetRight = playbackStreams[CHANNEL_RIGHT]->checkResetAndClear();
     if (wasResetLeft || wasResetRight) {
         nextPlaybackTime = appView->currentSampleTime();
-        resampler[CHANNEL_LEFT].reset();
-        resampler[CHANNEL_RIGHT].reset();
+        resampler.reset();
     }
 
+    applyResampleQuality();
+    takePendingIntervals();
+
+    auto start = std::chrono::steady_clock::now();
     while (!fillPlaybackStreams()) {
         // Do nothing
     }
+    decodeTime += std::chrono::steady_clock::now() - start;
 
+    checkDecodeBudget();
+}
+
+// Move intervals enqueued from the Qt thread to the playback queue
+void RemoteChannel::takePendingIntervals()
+{
+    QMutexLocker locker{&pendingLock};
+    for (const PendingInterval &pending : pendingIntervals) {
+        if (intervals.isEmpty()) {
+            intervalStartTime = pending.startTime;
+        }
+        intervals.append(pending.interval);
+    }
+    takenIntervals += pendingIntervals.size();
+    pendingIntervals.clear();
+}
+
+void RemoteChannel::applyResampleQuality()
+{
+    Resampler::Quality quality = resampleQuality_.load();
+    if (quality != appliedResampleQuality) {
+        appliedResampleQuality = quality;
+        resampler.setQuality(quality);
+    }
+}
+
+// Step down one resampling quality tier if decoding is too slow. Quality is
+// not raised again automatically.
+void RemoteChannel::checkDecodeBudget()
+{
+    // Measure over at least one second of audio
+    int sampleRate = appView->audioProcessor()->getSampleRate();
+    if (decodedSamples < static_cast<size_t>(sampleRate)) {
+        return;
+    }
+
+    double load = std::chrono::duration<double>(decodeTime).count() /
+                  (static_cast<double>(decodedSamples) / sampleRate);
+    decodeTime = std::chrono::nanoseconds{0};
+    decodedSamples = 0;
+
+    // Passthrough does not resample so lowering the quality would not help
+    Resampler::Quality quality = appliedResampleQuality;
+    if (load <= DECODE_BUDGET ||
+        quality == Resampler::Linear ||
+        resampler.isPassthrough()) {
+        return;
+    }
+
+    // Leave the quality alone if the Qt thread has just changed it
+    Resampler::Quality lowered = static_cast<Resampler::Quality>(quality + 1);
+    if (!resampleQuality_.compare_exchange_strong(quality, lowered)) {
+        return;
+    }
+    appliedResampleQuality = lowered;
+    resampler.setQuality(lowered);
+
+    // Notify from the Qt thread since this runs in AudioStreamService
+    QMetaObject::invokeMethod(this, [this, load]() {
+        qWarning("Decoding remote channel \"%s\" took %.1f%% of real time, "
+                 "lowering resampling quality",
+                 name_.toLatin1().constData(), load * 100);
+        emit resampleQualityChanged();
+    }, Qt::QueuedConnection);
+}
+
+// Playback streams run dry once the audio thread reaches nextPlaybackTime
+SampleTime RemoteChannel::serviceDeadline() const
+{
+    return nextPlaybackTime;
+}
+
+void RemoteChannel::refreshAudioProperties()
+{
     // Periodically emit signal since peak volume is always changing
     emit peakVolumeChanged();
 }
 
 void RemoteChannel::enqueueRemoteInterval(SharedRemoteInterval remoteInterval)
 {
-    bool oldSilence = true;
-    bool newSilence = remoteInterval->isSilence();
-
-    if (intervals.isEmpty()) {
-        intervalStartTime = appView->qmlGlobals()->session()->nextIntervalTime();
-    } else {
-        oldSilence = intervals.last()->isSilence();
-    }
+    SampleTime startTime =
+        appView->qmlGlobals()->session()->nextIntervalTime();
 
     // Resampling is stateful so all intervals share one resampler
-    remoteInterval->setResampler(&resampler[CHANNEL_LEFT],
-                                 &resampler[CHANNEL_RIGHT]);
+    remoteInterval->setResampler(&resampler);
 
-    intervals.append(remoteInterval);
-
-    if (oldSilence != newSilence) {
-        emit remoteSendingChanged(!newSilence);
+    {
+        QMutexLocker locker{&pendingLock};
+        pendingIntervals.append({remoteInterval, startTime});
     }
+    enqueuedIntervals++;
+
+    setRemoteSending(!remoteInterval->isSilence());
 }
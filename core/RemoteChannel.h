@@ -1,14 +1,19 @@
 // SPDX-License-Identifier: Apache-2.0
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include "audio/AudioStream.h"
 #include "AppView.h"
+#include "IAudioStreamClient.h"
 #include "RemoteInterval.h"
 #include "Resampler.h"
 
 // A remote audio channel. Handles remote interval playback, including
-// controlling pan and monitoring.
-class RemoteChannel : public QObject
+// controlling pan and monitoring. Intervals are decoded in the
+// AudioStreamService thread. Properties are accessed from the Qt thread
+// without taking AudioStreamService::lock().
+class RemoteChannel : public QObject, public IAudioStreamClient
 {
     Q_OBJECT
     Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
@@ -24,6 +29,10 @@ class RemoteChannel : public QObject
     Q_PROPERTY(bool remoteSending READ remoteSending NOTIFY remoteSendingChanged)
     Q_PROPERTY(float peakVolume READ peakVolume NOTIFY peakVolumeChanged)
 
+    // Sample rate conversion quality, lowered automatically when decoding
+    // takes too long
+    Q_PROPERTY(Resampler::Quality resampleQuality READ resampleQuality WRITE setResampleQuality NOTIFY resampleQualityChanged)
+
 public:
     typedef std::shared_ptr<RemoteInterval> SharedRemoteInterval;
 
@@ -43,6 +52,8 @@ public:
     float peakVolume() const;
     float gain() const;
     void setGain(float gain_);
+    Resampler::Quality resampleQuality() const;
+    void setResampleQuality(Resampler::Quality quality);
 
 signals:
     void nameChanged(const QString &newName);
@@ -51,21 +62,50 @@ signals:
     void remoteSendingChanged(bool newValue);
     void peakVolumeChanged();
     void gainChanged();
+    void resampleQualityChanged();
 
 public slots:
-    void processAudioStreams();
+    void processAudioStreams() override;
+    SampleTime serviceDeadline() const override;
     void enqueueRemoteInterval(SharedRemoteInterval remoteInterval);
 
+    // Called periodically from the Qt thread
+    void refreshAudioProperties();
+
 private:
     AppView *appView;
     AudioStream *playbackStreams[CHANNELS_STEREO];
-    Resampler resampler[CHANNELS_STEREO];
+    Resampler resampler; // shared by left/right channels
     QVector<SharedRemoteInterval> intervals;
     QString name_;
     SampleTime nextPlaybackTime;
     SampleTime intervalStartTime;
 
-    void fillWithSilence(size_t nsamples);
-    size_t fillFromInterval(size_t nsamples);
+    // Intervals handed over from the Qt thread by enqueueRemoteInterval()
+    struct PendingInterval {
+        SharedRemoteInterval interval;
+        SampleTime startTime; // used if no interval is playing
+    };
+    QMutex pendingLock;
+    QVector<PendingInterval> pendingIntervals;
+    size_t enqueuedIntervals; // Qt thread only
+    size_t takenIntervals; // AudioStreamService thread only
+    bool remoteSending_; // Qt thread only
+
+    // Requested quality and the quality the resampler is currently using
+    std::atomic<Resampler::Quality> resampleQuality_;
+    Resampler::Quality appliedResampleQuality;
+
+    // Decoding cost since the last checkDecodeBudget()
+    std::chrono::nanoseconds decodeTime;
+    size_t decodedSamples;
+
+    bool canQueueWrite(bool silence) const;
+    size_t fillWithSilence(size_t nsamples);
+    size_t fillFromInterval(size_t nsamples, bool *underflow);
     bool fillPlaybackStreams();
+    void takePendingIntervals();
+    void applyResampleQuality();
+    void checkDecodeBudget();
+    void setRemoteSending(bool sending);
 };
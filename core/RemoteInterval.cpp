@@ -1,4 +1,6 @@
 // SPDX-License-Identifier: Apache-2.0
+#include <string.h>
+#include <algorithm>
 #include "RemoteInterval.h"
 
 RemoteInterval::RemoteInterval(const QString &username,
@@ -6,20 +8,20 @@ RemoteInterval::RemoteInterval(const QString &username,
                                const JamConnection::FourCC fourCC_,
                                QObject *parent)
     : QObject{parent},
-      resampler{nullptr, nullptr},
+      resampler{nullptr},
       username_{username},
       guid_{guid},
       fourCC{fourCC_},
       outputSampleRate{44100},
       decodeStarted{false},
-      finished{false}
+      finished{false},
+      pendingFinished{false}
 {
 }
 
-void RemoteInterval::setResampler(Resampler *left, Resampler *right)
+void RemoteInterval::setResampler(Resampler *resampler_)
 {
-    resampler[CHANNEL_LEFT] = left;
-    resampler[CHANNEL_RIGHT] = right;
+    resampler = resampler_;
 }
 
 QString RemoteInterval::username() const
@@ -47,23 +49,47 @@ bool RemoteInterval::appendingFinished() const
     return finished;
 }
 
+// Without sample rate conversion samples can be decoded straight into the
+// output buffers
+bool RemoteInterval::canDecodeDirectly()
+{
+    return decodeStarted &&
+           decoder.sampleRate() == outputSampleRate &&
+           resampler->isPassthrough() &&
+           resampler->numBufferedSamples() == 0;
+}
+
 // Returns number of output samples
-size_t RemoteInterval::drainResampler(QByteArray *left, QByteArray *right,
+size_t RemoteInterval::drainResampler(float *left, float *right,
                                       size_t nsamples)
 {
-    size_t n = resampler[CHANNEL_LEFT]->resample(left, nsamples);
-    size_t m = resampler[CHANNEL_RIGHT]->resample(right, n);
-    if (n != m) {
-        qWarning("Stereo channels out of sync, resamplers produced %zu and %zu samples",
-                 n, m);
+    // Mono streams are resampled once and copied to both channels
+    float *const out[CHANNELS_STEREO] = {left, right};
+    return resampler->resample(out, CHANNELS_STEREO, nsamples);
+}
+
+// Returns true if the resampler was switched to the decoder's number of
+// channels. Only call this after the resampler has been flushed since
+// switching resets it.
+bool RemoteInterval::switchResamplerChannels()
+{
+    int channels = decoder.channels();
+    if (channels == 0 || channels == resampler->channels()) {
+        return false;
     }
-    return qMin(n, m);
+
+    resampler->setChannels(channels);
+    return true;
 }
 
 // Returns number of samples filled
 size_t RemoteInterval::fillResampler(size_t nsamples)
 {
-    QByteArray tmpLeft, tmpRight;
+    // The stream may not be open yet
+    int channels = decoder.channels();
+    if (channels == 0) {
+        return 0;
+    }
 
     // Estimate how many input samples need to be decoded to produce nsamples
     // output samples.
@@ -72,38 +98,39 @@ size_t RemoteInterval::fillResampler(size_t nsamples)
                           static_cast<double>(inputSampleRate) /
                           outputSampleRate + 0.5;
 
-    size_t n = decoder.decode(&tmpLeft, &tmpRight, inputSamples);
-    assert(tmpLeft.size() == tmpRight.size());
-    assert(static_cast<size_t>(tmpLeft.size()) == n * sizeof(float));
-    if (n > 0) {
-        double ratio = static_cast<double>(outputSampleRate) /
-                       decoder.sampleRate();
-        resampler[CHANNEL_LEFT]->setRatio(ratio);
-        resampler[CHANNEL_RIGHT]->setRatio(ratio);
-        decodeStarted = true;
+    // All channels share one resampler so they are filtered together. If the
+    // previous interval had a different number of channels its last samples
+    // are still in the filter. Flush them out before decode() switches
+    // channels.
+    if (channels != resampler->channels()) {
+        resampler->finishAppendingData();
+        return 0;
     }
 
-    // We have no input samples yet, so there is nothing to resample
-    if (!decodeStarted) {
-        return 0;
+    // Decode straight into the resampler input buffer
+    float *samples = resampler->appendAcquire(inputSamples);
+    size_t n = decoder.decodeInterleaved(samples, inputSamples);
+    if (n > 0) {
+        resampler->setRatio(static_cast<double>(outputSampleRate) /
+                            decoder.sampleRate());
+        decodeStarted = true;
     }
 
-    resampler[CHANNEL_LEFT]->appendData(tmpLeft);
-    resampler[CHANNEL_RIGHT]->appendData(tmpRight);
+    resampler->appendCommit(n);
     return n;
 }
 
-size_t RemoteInterval::decode(QByteArray *left, QByteArray *right,
-                              size_t nsamples)
+size_t RemoteInterval::decode(float *left, float *right, size_t nsamples)
 {
     // setResampler() must have been called
-    assert(resampler[CHANNEL_LEFT] != nullptr);
-    assert(resampler[CHANNEL_RIGHT] != nullptr);
+    assert(resampler != nullptr);
+
+    takePendingData();
 
     /* Infinite silence, caller will stop decoding when interval expires */
     if (isSilence()) {
-        left->fill(0, nsamples * sizeof(float));
-        right->fill(0, nsamples * sizeof(float));
+        std::fill_n(left, nsamples, 0.f);
+        std::fill_n(right, nsamples, 0.f);
         return nsamples;
     }
 
@@ -111,15 +138,38 @@ size_t RemoteInterval::decode(QByteArray *left, QByteArray *right,
     size_t decoded = 0;
 
     while (nsamples > 0) {
+        if (canDecodeDirectly()) {
+            float *const samples[CHANNELS_STEREO] = {
+                left + decoded,
+                right + decoded,
+            };
+            bool mono = false;
+            size_t n = decoder.decode(samples, nsamples, &mono);
+            if (mono) {
+                memcpy(samples[CHANNEL_RIGHT], samples[CHANNEL_LEFT],
+                       n * sizeof(float));
+            }
+            if (n == 0) {
+                break;
+            }
+
+            nsamples -= n;
+            decoded += n;
+            continue;
+        }
+
         size_t filled = 0;
         if (needFill) {
             filled = fillResampler(nsamples);
         }
 
-        size_t n = drainResampler(left, right, nsamples);
+        size_t n = drainResampler(left + decoded, right + decoded, nsamples);
 
         // No input left to decode, stop for now
         if (n == 0 && needFill && filled == 0) {
+            if (switchResamplerChannels()) {
+                continue;
+            }
             break;
         }
 
@@ -131,12 +181,26 @@ size_t RemoteInterval::decode(QByteArray *left, QByteArray *right,
     return decoded;
 }
 
-void RemoteInterval::appendData(const QByteArray &data)
+// Hand data received so far to the decoder
+void RemoteInterval::takePendingData()
+{
+    QMutexLocker locker{&pendingLock};
+    for (const PendingData &data : pendingData) {
+        decoder.appendData(data.chunk, data.offset, data.size);
+    }
+    pendingData.clear();
+    finished = pendingFinished;
+}
+
+void RemoteInterval::appendData(const QByteArray &chunk, qsizetype offset,
+                                qsizetype size)
 {
-    decoder.appendData(data);
+    QMutexLocker locker{&pendingLock};
+    pendingData.append({chunk, offset, size});
 }
 
 void RemoteInterval::finishAppendingData()
 {
-    finished = true;
+    QMutexLocker locker{&pendingLock};
+    pendingFinished = true;
 }
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: Apache-2.0
 #pragma once
 
+#include <QMutex>
 #include "audio/AudioStream.h"
 #include "JamConnection.h"
 #include "OggVorbisDecoder.h"
@@ -9,7 +10,8 @@
 // An interval of compressed audio data being downloaded from the server
 //
 // Call appendData() each time compressed audio data is received. Call
-// finishAppendingData() when the download is complete.
+// finishAppendingData() when the download is complete. These may be called
+// from the Qt thread while another thread decodes.
 //
 // Decode audio samples by calling decode(). The download may still be in
 // progress and if there is not enough data fewer samples than requested will
@@ -25,7 +27,7 @@ public:
                    QObject *parent = nullptr);
 
     // This must be called before decode()
-    void setResampler(Resampler *left, Resampler *right);
+    void setResampler(Resampler *resampler_);
 
     QString username() const;
     QUuid guid() const;
@@ -39,20 +41,21 @@ public:
     // Returns true if no more samples can be decoded after decode() returns 0
     bool appendingFinished() const;
 
-    // Fill the stereo left/right channels with up to nsamples of decoded
+    // Fill the stereo left/right buffers with up to nsamples of decoded
     // samples. Returns the number of samples decoded.
-    size_t decode(QByteArray *left, QByteArray *right, size_t nsamples);
+    size_t decode(float *left, float *right, size_t nsamples);
 
 public slots:
-    // Add compressed audio data
-    void appendData(const QByteArray &data);
+    // Add size bytes of compressed audio data at offset in chunk. The chunk
+    // is shared, not copied.
+    void appendData(const QByteArray &chunk, qsizetype offset, qsizetype size);
 
     // No more compressed audio data will be appended
     void finishAppendingData();
 
 private:
     OggVorbisDecoder decoder;
-    Resampler *resampler[CHANNELS_STEREO];
+    Resampler *resampler;
     QString username_;
     QUuid guid_;
     JamConnection::FourCC fourCC;
@@ -60,7 +63,21 @@ private:
     bool decodeStarted;
     bool finished;
 
-    size_t drainResampler(QByteArray *left, QByteArray *right,
-                          size_t nsamples);
+    // Data received in the Qt thread but not yet passed to the decoder
+    struct PendingData
+    {
+        QByteArray chunk;
+        qsizetype offset;
+        qsizetype size;
+    };
+    QMutex pendingLock;
+    QVector<PendingData> pendingData;
+    bool pendingFinished;
+
+    void takePendingData();
+
+    bool canDecodeDirectly();
+    size_t drainResampler(float *left, float *right, size_t nsamples);
     size_t fillResampler(size_t nsamples);
+    bool switchResamplerChannels();
 };
@@ -46,8 +46,8 @@ void RemoteUser::setChannelInfo(int channelIndex, const QString &channelName,
     } else if (!channel && active) {
         channel = new RemoteChannel{channelName, appView};
         channels_.insert(channelIndex, channel);
-        connect(appView, &AppView::processAudioStreams,
-                channel, &RemoteChannel::processAudioStreams);
+        connect(appView, &AppView::refreshAudioProperties,
+                channel, &RemoteChannel::refreshAudioProperties);
         emit channelsChanged();
     }
 }
@@ -1,10 +1,13 @@
 // SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
 #include "Resampler.h"
 
 Resampler::Resampler(QObject *parent)
-    : QObject{parent}, srcState{nullptr}, ratio{1.0}, endOfInput{false}
+    : QObject{parent}, inputStart{0}, inputEnd{0}, srcState{nullptr},
+      channels_{1}, quality_{BestQuality}, ratio{1.0}, endOfInput{false}, converting{false}
 {
-    reset();
 }
 
 Resampler::~Resampler()
@@ -14,21 +17,45 @@ Resampler::~Resampler()
 
 void Resampler::reset()
 {
-    int error;
-
     src_delete(srcState);
-    srcState = src_new(SRC_SINC_BEST_QUALITY, 1, &error);
+    srcState = nullptr;
+
+    inputStart = 0;
+    inputEnd = 0;
+    ratio = 1.0;
+    endOfInput = false;
+    converting = false;
+}
+
+bool Resampler::createSrcState()
+{
+    int converterType = SRC_SINC_BEST_QUALITY;
+    switch (quality_) {
+    case BestQuality:
+        converterType = SRC_SINC_BEST_QUALITY;
+        break;
+    case MediumQuality:
+        converterType = SRC_SINC_MEDIUM_QUALITY;
+        break;
+    case Fastest:
+        converterType = SRC_SINC_FASTEST;
+        break;
+    case Linear:
+        converterType = SRC_LINEAR;
+        break;
+    }
+
+    int error;
+    srcState = src_new(converterType, channels_, &error);
     if (!srcState) {
         const char *errMsg = src_strerror(error);
         if (!errMsg) {
             errMsg = "Unkown error";
         }
         qCritical("src_new failed: %s", errMsg);
+        return false;
     }
-
-    input.clear();
-    ratio = 1.0;
-    endOfInput = false;
+    return true;
 }
 
 void Resampler::setRatio(double ratio_)
@@ -36,9 +63,95 @@ void Resampler::setRatio(double ratio_)
     ratio = ratio_;
 }
 
+void Resampler::setChannels(int channels)
+{
+    assert(channels > 0);
+    if (channels == channels_) {
+        return;
+    }
+
+    channels_ = channels;
+    reset();
+}
+
+int Resampler::channels() const
+{
+    return channels_;
+}
+
+void Resampler::setQuality(Quality quality)
+{
+    if (quality == quality_) {
+        return;
+    }
+
+    quality_ = quality;
+
+    // Recreated with the new quality when needed
+    src_delete(srcState);
+    srcState = nullptr;
+}
+
+Resampler::Quality Resampler::quality() const
+{
+    return quality_;
+}
+
+bool Resampler::isPassthrough() const
+{
+    return ratio == 1.0 && !converting;
+}
+
+size_t Resampler::numBufferedSamples() const
+{
+    return inputEnd - inputStart;
+}
+
+float *Resampler::appendAcquire(size_t nsamples)
+{
+    if ((inputEnd + nsamples) * channels_ > input.size()) {
+        // Move unread samples to the front before growing the buffer
+        std::copy(input.begin() + inputStart * channels_,
+                  input.begin() + inputEnd * channels_,
+                  input.begin());
+        inputEnd -= inputStart;
+        inputStart = 0;
+
+        if ((inputEnd + nsamples) * channels_ > input.size()) {
+            input.resize((inputEnd + nsamples) * channels_);
+        }
+    }
+    return input.data() + inputEnd * channels_;
+}
+
+void Resampler::appendCommit(size_t nsamples)
+{
+    assert((inputEnd + nsamples) * channels_ <= input.size());
+    inputEnd += nsamples;
+}
+
+void Resampler::appendData(const float *samples, size_t nsamples)
+{
+    memcpy(appendAcquire(nsamples), samples,
+           nsamples * channels_ * sizeof(float));
+    appendCommit(nsamples);
+}
+
+void Resampler::appendPlanar(const float *const samples[], size_t nsamples)
+{
+    float *out = appendAcquire(nsamples);
+    for (int ch = 0; ch < channels_; ch++) {
+        for (size_t i = 0; i < nsamples; i++) {
+            out[i * channels_ + ch] = samples[ch][i];
+        }
+    }
+    appendCommit(nsamples);
+}
+
 void Resampler::appendData(const QByteArray &data)
 {
-    input.append(data);
+    appendData(reinterpret_cast<const float*>(data.constData()),
+               data.size() / (sizeof(float) * channels_));
 }
 
 void Resampler::finishAppendingData()
@@ -48,13 +161,69 @@ void Resampler::finishAppendingData()
 
 size_t Resampler::resample(QByteArray *output, size_t nsamples)
 {
+    const size_t frameSize = channels_ * sizeof(float);
     int oldOutputSize = output->size();
-    output->resize(oldOutputSize + nsamples * sizeof(float));
+    output->resize(oldOutputSize + nsamples * frameSize);
+
+    size_t n = resample(reinterpret_cast<float*>(output->data() + oldOutputSize),
+                        nsamples);
+
+    output->resize(oldOutputSize + n * frameSize);
+    return n;
+}
+
+size_t Resampler::resample(float *const planar[], size_t nsamples)
+{
+    return resample(planar, channels_, nsamples);
+}
+
+size_t Resampler::resample(float *const planar[], int outputChannels,
+                           size_t nsamples)
+{
+    assert(outputChannels == channels_ || channels_ == 1);
+
+    if (outputChannels == 1) {
+        return resample(planar[0], nsamples);
+    }
+
+    if (output.size() < nsamples * channels_) {
+        output.resize(nsamples * channels_);
+    }
+
+    // Deinterleave, duplicating mono into every output channel
+    size_t n = resample(output.data(), nsamples);
+    for (int ch = 0; ch < outputChannels; ch++) {
+        const int inputChannel = channels_ == 1 ? 0 : ch;
+        for (size_t i = 0; i < n; i++) {
+            planar[ch][i] = output[i * channels_ + inputChannel];
+        }
+    }
+    return n;
+}
+
+size_t Resampler::resample(float *output, size_t nsamples)
+{
+    if (isPassthrough()) {
+        size_t n = std::min(nsamples, inputEnd - inputStart);
+        memcpy(output, input.data() + inputStart * channels_,
+               n * channels_ * sizeof(float));
+        inputStart += n;
+        if (inputStart == inputEnd) {
+            inputStart = 0;
+            inputEnd = 0;
+        }
+        return n;
+    }
+
+    if (!srcState && !createSrcState()) {
+        return 0;
+    }
+    converting = true;
 
     SRC_DATA srcData = {
-        reinterpret_cast<float*>(input.data()),
-        reinterpret_cast<float*>(output->data() + oldOutputSize),
-        static_cast<long>(input.size() / sizeof(float)),
+        input.data() + inputStart * channels_,
+        output,
+        static_cast<long>(inputEnd - inputStart),
         static_cast<long>(nsamples),
         0,
         0,
@@ -64,8 +233,11 @@ size_t Resampler::resample(QByteArray *output, size_t nsamples)
 
     int error = src_process(srcState, &srcData);
 
-    input.remove(0, srcData.input_frames_used * sizeof(float));
-    output->resize(oldOutputSize + srcData.output_frames_gen * sizeof(float));
+    inputStart += srcData.input_frames_used;
+    if (inputStart == inputEnd) {
+        inputStart = 0;
+        inputEnd = 0;
+    }
 
     if (error) {
         const char *errMsg = src_strerror(error);
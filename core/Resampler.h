@@ -3,20 +3,55 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <vector>
 #include <samplerate.h>
 
 // Sample rate converter using libsamplerate
+//
+// Multiple channels share one converter with interleaved samples so that
+// channels are filtered together and always produce the same number of
+// samples. Sample counts are per channel (frames).
+//
+// When the ratio is exactly 1.0 input is copied to the output unchanged and no
+// libsamplerate state is created. Once samples have been converted at another
+// ratio the resampler keeps converting until reset() so that no samples are
+// lost inside the filter.
 class Resampler : public QObject
 {
     Q_OBJECT
 
 public:
+    // From most to least expensive
+    enum Quality {
+        BestQuality,
+        MediumQuality,
+        Fastest,
+        Linear,
+    };
+    Q_ENUM(Quality)
+
     // The sampling conversion ratio is outputSampleRate / inputSampleRate
     Resampler(QObject *parent = nullptr);
     ~Resampler();
 
     void setRatio(double ratio);
 
+    // Number of interleaved channels, 1 by default. Changing the number of
+    // channels resets the resampler.
+    void setChannels(int channels);
+    int channels() const;
+
+    // Changing the quality while converting restarts the filter, which may
+    // cause a small glitch
+    void setQuality(Quality quality);
+    Quality quality() const;
+
+    // Is input being copied unchanged?
+    bool isPassthrough() const;
+
+    // Number of input samples that have not been consumed yet
+    size_t numBufferedSamples() const;
+
     // Discard any state and reset the resampler
     void reset();
 
@@ -26,6 +61,31 @@ public:
     // after 0 was returned.
     size_t resample(QByteArray *output, size_t nsamples);
 
+    // Same as above but writes into a caller-provided interleaved buffer
+    size_t resample(float *output, size_t nsamples);
+
+    // Same as above but writes into caller-provided planar buffers, one per
+    // channel
+    size_t resample(float *const output[], size_t nsamples);
+
+    // Same as above but mono is converted once and duplicated into each of
+    // the outputChannels buffers. Otherwise outputChannels must equal
+    // channels().
+    size_t resample(float *const output[], int outputChannels,
+                    size_t nsamples);
+
+    // Returns an interleaved buffer for up to nsamples of input audio data so
+    // that it can be produced in place, e.g. by a decoder. Call appendCommit()
+    // with the number of samples actually written before the next call.
+    float *appendAcquire(size_t nsamples);
+    void appendCommit(size_t nsamples);
+
+    // Copy nsamples of interleaved input audio data
+    void appendData(const float *samples, size_t nsamples);
+
+    // Copy nsamples of input audio data from planar buffers, one per channel
+    void appendPlanar(const float *const samples[], size_t nsamples);
+
 public slots:
     // Add input audio data
     void appendData(const QByteArray &data);
@@ -34,8 +94,16 @@ public slots:
     void finishAppendingData();
 
 private:
-    QByteArray input;
-    SRC_STATE *srcState;
+    std::vector<float> input; // unread frames are [inputStart, inputEnd)
+    size_t inputStart;
+    size_t inputEnd;
+    std::vector<float> output; // interleaved output for planar resample()
+    SRC_STATE *srcState; // created on demand
+    int channels_;
+    Quality quality_;
     double ratio;
     bool endOfInput;
+    bool converting; // srcState has been used since reset()
+
+    bool createSrcState();
 };
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include "UploadQualityController.h"
+
+UploadQualityController::UploadQualityController(const std::vector<float> &ladder_)
+    : ladder{ladder_}
+{
+    assert(!ladder.empty());
+    reset();
+}
+
+std::vector<float> UploadQualityController::defaultLadder()
+{
+    return {0.f, -0.05f, -0.1f}; // nominal bitrate ~64 kbps and below
+}
+
+void UploadQualityController::reset()
+{
+    tier_ = 0;
+    lastBacklogBytes = 0;
+    drainedIntervals = 0;
+}
+
+float UploadQualityController::update(int64_t backlogBytes,
+                                      int64_t queuedBytes,
+                                      int64_t sentBytes)
+{
+    // Step down before the backlog reaches a whole interval
+    bool congested = backlogBytes > 0 &&
+                     (backlogBytes * 2 >= queuedBytes ||
+                      (backlogBytes > lastBacklogBytes &&
+                       sentBytes < queuedBytes));
+    bool drained = backlogBytes == 0 || backlogBytes * 10 < queuedBytes;
+    lastBacklogBytes = backlogBytes;
+
+    if (congested) {
+        drainedIntervals = 0;
+        if (tier_ + 1 < ladder.size()) {
+            tier_++;
+        }
+    } else if (drained && tier_ > 0) {
+        if (++drainedIntervals >= STEP_UP_INTERVALS) {
+            drainedIntervals = 0;
+            tier_--;
+        }
+    } else {
+        drainedIntervals = 0;
+    }
+
+    return quality();
+}
+
+float UploadQualityController::quality() const
+{
+    return ladder[tier_];
+}
+
+size_t UploadQualityController::tier() const
+{
+    return tier_;
+}
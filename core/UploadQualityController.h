@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Picks the Vorbis quality for uploads from a ladder of tiers based on how
+ * well the network keeps up.
+ *
+ * update() is called once per interval with the socket send backlog and the
+ * number of bytes queued and actually sent during the last interval. The
+ * quality steps down as soon as the backlog reaches half an interval or keeps
+ * growing, so a weak uplink never falls a whole interval behind. It steps
+ * back up after the backlog has stayed drained for several intervals.
+ */
+class UploadQualityController
+{
+public:
+    // Tiers from highest to lowest quality
+    UploadQualityController(const std::vector<float> &ladder = defaultLadder());
+
+    // Highest tier is the long-standing default quality
+    static std::vector<float> defaultLadder();
+
+    // Start again from the highest tier
+    void reset();
+
+    // Returns the quality for the next interval
+    float update(int64_t backlogBytes, int64_t queuedBytes, int64_t sentBytes);
+
+    float quality() const;
+    size_t tier() const;
+
+private:
+    // Intervals without backlog before stepping up again
+    enum { STEP_UP_INTERVALS = 4 };
+
+    std::vector<float> ladder;
+    size_t tier_;
+    int64_t lastBacklogBytes;
+    unsigned drainedIntervals;
+};
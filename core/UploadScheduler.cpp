@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: Apache-2.0
+#include "UploadScheduler.h"
+
+enum {
+    FLAG_LAST = 0x1,
+};
+
+UploadScheduler::UploadScheduler()
+    : budget_{DEFAULT_BUDGET}, pendingBytes_{0}, droppedBytes_{0},
+      droppedIntervals_{0}
+{
+}
+
+void UploadScheduler::setBudget(qint64 bytes)
+{
+    budget_ = bytes;
+}
+
+qint64 UploadScheduler::budget() const
+{
+    return budget_;
+}
+
+void UploadScheduler::clear()
+{
+    intervals.clear();
+    pendingBytes_ = 0;
+}
+
+// Discard queued audio data and make the interval finish as soon as possible
+void UploadScheduler::dropInterval(Interval *interval)
+{
+    for (const Write &write : interval->writes) {
+        pendingBytes_ -= write.data.size();
+        droppedBytes_ += write.data.size();
+    }
+    interval->writes.clear();
+    interval->dropped = true;
+    droppedIntervals_++;
+
+    if (interval->beginSent) {
+        // Tell receivers the interval is over, they decode what they have
+        interval->writes.push_back(Write{FLAG_LAST, QByteArray{}});
+    } else {
+        // Send as silence
+        interval->guid = QUuid();
+    }
+    interval->finished = true;
+}
+
+void UploadScheduler::beginInterval(const QUuid &guid, quint32 estimatedSize,
+                                    const FourCC &fourCC, quint8 channelIndex)
+{
+    // Intervals of this channel with audio that is still waiting to be sent
+    auto isQueued = [channelIndex](const Interval &interval) {
+        return interval.channelIndex == channelIndex &&
+               !interval.guid.isNull() && !interval.dropped;
+    };
+
+    int nqueued = 0;
+    for (const Interval &interval : intervals) {
+        if (isQueued(interval)) {
+            nqueued++;
+        }
+    }
+
+    // Keep at most one older interval so we are never more than one interval
+    // late. The newest one is kept since it can be sent right away.
+    for (Interval &interval : intervals) {
+        if (nqueued < 2) {
+            break;
+        }
+        if (isQueued(interval)) {
+            dropInterval(&interval);
+            nqueued--;
+        }
+    }
+
+    intervals.push_back(Interval{guid, estimatedSize, fourCC, channelIndex,
+                                 false, guid.isNull(), false, {}});
+}
+
+void UploadScheduler::writeInterval(const QUuid &guid, quint8 flags,
+                                    const QByteArray &data)
+{
+    for (Interval &interval : intervals) {
+        if (interval.guid != guid || interval.finished) {
+            continue;
+        }
+
+        interval.writes.push_back(Write{flags, data});
+        interval.finished = flags & FLAG_LAST;
+        pendingBytes_ += data.size();
+        return;
+    }
+
+    // The interval was abandoned
+    droppedBytes_ += data.size();
+}
+
+bool UploadScheduler::next(qint64 bytesInFlight, Message *msg)
+{
+    if (bytesInFlight >= budget_) {
+        return false;
+    }
+
+    for (auto it = intervals.begin(); it != intervals.end(); ++it) {
+        Interval &interval = *it;
+
+        if (!interval.beginSent) {
+            interval.beginSent = true;
+            *msg = Message{true, interval.guid, interval.estimatedSize,
+                           interval.fourCC, interval.channelIndex, 0,
+                           QByteArray{}};
+        } else if (!interval.writes.empty()) {
+            Write &write = interval.writes.front();
+            *msg = Message{false, interval.guid, 0, FourCC{}, 0, write.flags,
+                           write.data};
+            pendingBytes_ -= write.data.size();
+            interval.writes.pop_front();
+        } else {
+            continue; // waiting for more data
+        }
+
+        if (interval.finished && interval.writes.empty()) {
+            intervals.erase(it);
+        }
+        return true;
+    }
+    return false;
+}
+
+qint64 UploadScheduler::pendingBytes() const
+{
+    return pendingBytes_;
+}
+
+qint64 UploadScheduler::droppedBytes() const
+{
+    return droppedBytes_;
+}
+
+quint64 UploadScheduler::droppedIntervals() const
+{
+    return droppedIntervals_;
+}
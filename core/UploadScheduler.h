@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: Apache-2.0
+#pragma once
+
+#include <QByteArray>
+#include <QUuid>
+#include <array>
+#include <deque>
+
+/*
+ * Queues upload interval messages and hands them out within a byte budget
+ *
+ * Writing uploads straight into the socket lets a stalled uplink build up an
+ * unbounded backlog of audio that is already obsolete. Instead, messages
+ * wait here and next() only releases them while fewer than budget() bytes
+ * are in flight. Older intervals are sent first.
+ *
+ * Each channel has at most two intervals queued: the one being sent and the
+ * current one. When another interval begins, all but the newest of the older
+ * intervals are abandoned. An abandoned interval that has started sending is
+ * finished early and one that has not started is sent as silence. The user
+ * is therefore never more than one interval late.
+ */
+class UploadScheduler
+{
+public:
+    typedef std::array<quint8, 4> FourCC;
+
+    // An upload message that is ready to be sent
+    struct Message
+    {
+        bool begin; // UploadIntervalBegin, otherwise UploadIntervalWrite
+        QUuid guid;
+
+        // UploadIntervalBegin fields
+        quint32 estimatedSize;
+        FourCC fourCC;
+        quint8 channelIndex;
+
+        // UploadIntervalWrite fields
+        quint8 flags;
+        QByteArray data;
+    };
+
+    enum { DEFAULT_BUDGET = 16 * 1024 }; // bytes, about 2 seconds at 64 kbps
+
+    UploadScheduler();
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+
+    // Drop all queued messages
+    void clear();
+
+    void beginInterval(const QUuid &guid, quint32 estimatedSize,
+                       const FourCC &fourCC, quint8 channelIndex);
+
+    // Queue audio data, flags bit 0 marks the last write of the interval
+    void writeInterval(const QUuid &guid, quint8 flags, const QByteArray &data);
+
+    // Fetch the next message if bytesInFlight is within the budget
+    bool next(qint64 bytesInFlight, Message *msg);
+
+    // Bytes of audio data waiting to be sent
+    qint64 pendingBytes() const;
+
+    // Bytes of audio data discarded by abandoning intervals
+    qint64 droppedBytes() const;
+
+    // Number of intervals abandoned or replaced with silence
+    quint64 droppedIntervals() const;
+
+private:
+    struct Write
+    {
+        quint8 flags;
+        QByteArray data;
+    };
+
+    struct Interval
+    {
+        QUuid guid;
+        quint32 estimatedSize;
+        FourCC fourCC;
+        quint8 channelIndex;
+        bool beginSent;
+        bool finished; // the last write has been queued
+        bool dropped;
+        std::deque<Write> writes;
+    };
+
+    std::deque<Interval> intervals; // in the order they began
+    qint64 budget_;
+    qint64 pendingBytes_;
+    qint64 droppedBytes_;
+    quint64 droppedIntervals_;
+
+    void dropInterval(Interval *interval);
+};
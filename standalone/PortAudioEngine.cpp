@@ -6,7 +6,8 @@
 #include "PortAudioEngine.h"
 
 PortAudioEngine::PortAudioEngine(QObject *parent)
-    : QObject{parent}, processFn{nullptr}, stream{nullptr}, now{0},
+    : QObject{parent}, processFn{nullptr}, audioStats{nullptr},
+      stream{nullptr}, now{0},
       sampleRate_{44100}, bufferSize_{512}
 {
 #ifdef HAVE_PA_JACK_H
@@ -37,6 +38,15 @@ void PortAudioEngine::setProcessFn(std::function<ProcessFn> processFn_)
     processFn = processFn_;
 }
 
+void PortAudioEngine::setAudioStats(AudioStats *audioStats_)
+{
+    if (stream != nullptr) {
+        qFatal("Cannot set audioStats after starting stream");
+    }
+
+    audioStats = audioStats_;
+}
+
 QStringList PortAudioEngine::availableHostApis() const
 {
     const PaHostApiInfo *info;
@@ -415,7 +425,25 @@ int PortAudioEngine::streamCallback(const void *input_,
     auto engine = reinterpret_cast<PortAudioEngine *>(userData);
 
     Q_UNUSED(timeInfo); // TODO use timestamp instead of frame time
-    Q_UNUSED(statusFlags); // TODO handle over/underflows?
+
+    // Count over/underflows reported by the device
+    if (statusFlags && engine->audioStats) {
+        static const struct {
+            PaStreamCallbackFlags flag;
+            AudioStats::Xrun xrun;
+        } xrunFlags[] = {
+            {paInputUnderflow, AudioStats::INPUT_UNDERFLOW},
+            {paInputOverflow, AudioStats::INPUT_OVERFLOW},
+            {paOutputUnderflow, AudioStats::OUTPUT_UNDERFLOW},
+            {paOutputOverflow, AudioStats::OUTPUT_OVERFLOW},
+        };
+
+        for (const auto &x : xrunFlags) {
+            if (statusFlags & x.flag) {
+                engine->audioStats->addXrun(x.xrun);
+            }
+        }
+    }
 
     engine->process(input, output, frameCount);
     return paContinue;
@@ -3,7 +3,9 @@
 
 #include <QObject>
 #include <QString>
+#include <functional>
 #include <portaudio.h>
+#include "audio/AudioStats.h"
 #include "audio/AudioStream.h" // for types and constants
 
 /* How to route an input/output channel */
@@ -47,6 +49,9 @@ public:
     // start while the C++ code sets the process function.
     void setProcessFn(std::function<ProcessFn> processFn_);
 
+    // Call before start() to count over/underflows reported by the device
+    void setAudioStats(AudioStats *audioStats_);
+
     bool running() const { return stream; }
     const QString &hostApi() const { return hostApi_; }
     const QString &inputDevice() const { return inputDevice_; }
@@ -86,6 +91,7 @@ signals:
 
 private:
     std::function<ProcessFn> processFn;
+    AudioStats *audioStats;
     PaStream *stream;
     SampleTime now;
     std::vector<float> sampleBuf[CHANNELS_STEREO];
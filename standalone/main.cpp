@@ -1,12 +1,98 @@
 // SPDX-License-Identifier: Apache-2.0
+#include <QCommandLineParser>
 #include <QGuiApplication>
 #include <QQmlEngine>
+#include <QTimer>
 
 #include "core/global.h"
 #include "core/AppView.h"
 #include "core/QmlGlobals.h"
+#include "audio/OfflineAudioEngine.h"
 #include "PortAudioEngine.h"
 
+// Command-line options for running without a sound card
+struct OfflineOptions
+{
+    QCommandLineOption offline{"offline",
+        "Process audio from/to files instead of a sound card."};
+    QCommandLineOption input{"input",
+        "Offline input WAV file (default: silence).", "file"};
+    QCommandLineOption output{"output",
+        "Offline output file, WAV if the name ends in .wav and raw 32-bit "
+        "float otherwise (default: discard).", "file"};
+    QCommandLineOption duration{"duration",
+        "Stop offline processing after this many seconds (default: when the "
+        "input ends or the application quits).", "seconds"};
+    QCommandLineOption fast{"fast",
+        "Process offline audio as fast as possible instead of in real time."};
+    QCommandLineOption sampleRate{"sample-rate",
+        "Offline sample rate without an input file.", "hz", "44100"};
+    QCommandLineOption bufferSize{"buffer-size",
+        "Offline samples per process callback.", "samples", "512"};
+
+    void addTo(QCommandLineParser *parser)
+    {
+        parser->addOptions({offline, input, output, duration, fast,
+                            sampleRate, bufferSize});
+    }
+};
+
+// Configure the offline engine from the command-line and fill in the number
+// of samples to render. Returns false on error.
+static bool setupOfflineEngine(const QCommandLineParser &parser,
+                               const OfflineOptions &options,
+                               OfflineAudioEngine *engine,
+                               AudioFileReader *reader,
+                               AudioFileWriter *writer,
+                               SampleTime *nsamples)
+{
+    int sampleRate = parser.value(options.sampleRate).toInt();
+    if (parser.isSet(options.input)) {
+        const QString path = parser.value(options.input);
+        if (!reader->openWav(path.toLocal8Bit().constData())) {
+            qCritical("Unable to open input file \"%s\"",
+                      path.toLocal8Bit().constData());
+            return false;
+        }
+        sampleRate = reader->getSampleRate();
+        engine->setInput(reader);
+    }
+
+    const int bufferSize = parser.value(options.bufferSize).toInt();
+    if (sampleRate <= 0 || bufferSize <= 0) {
+        qCritical("Invalid offline sample rate or buffer size");
+        return false;
+    }
+    engine->setSampleRate(sampleRate);
+    engine->setBufferSize(bufferSize);
+    engine->setPaced(!parser.isSet(options.fast));
+
+    if (parser.isSet(options.output)) {
+        const QString path = parser.value(options.output);
+        const QByteArray pathBytes = path.toLocal8Bit();
+        bool ok = path.endsWith(".wav", Qt::CaseInsensitive) ?
+                  writer->openWav(pathBytes.constData(), sampleRate) :
+                  writer->openRaw(pathBytes.constData());
+        if (!ok) {
+            qCritical("Unable to open output file \"%s\"", pathBytes.constData());
+            return false;
+        }
+        engine->setOutput(writer);
+    }
+
+    // OfflineAudioEngine renders until the input ends when given 0
+    *nsamples = parser.isSet(options.input) ? 0 : UINT64_MAX;
+    if (parser.isSet(options.duration)) {
+        const double seconds = parser.value(options.duration).toDouble();
+        *nsamples = seconds * sampleRate;
+        if (seconds <= 0 || *nsamples == 0) {
+            qCritical("Invalid offline duration");
+            return false;
+        }
+    }
+    return true;
+}
+
 int main(int argc, char **argv)
 {
     int rc;
@@ -15,6 +101,25 @@ int main(int argc, char **argv)
 
     QGuiApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    OfflineOptions offlineOptions;
+    parser.addHelpOption();
+    offlineOptions.addTo(&parser);
+    parser.process(app);
+
+    const bool offline = parser.isSet(offlineOptions.offline);
+    OfflineAudioEngine offlineEngine;
+    AudioFileReader offlineInput;
+    AudioFileWriter offlineOutput;
+    SampleTime offlineSamples = 0;
+    if (offline) {
+        if (!setupOfflineEngine(parser, offlineOptions, &offlineEngine,
+                                &offlineInput, &offlineOutput,
+                                &offlineSamples)) {
+            return 1;
+        }
+    }
+
     globalInit();
     QmlGlobals::registerQmlTypes();
 
@@ -26,34 +131,64 @@ int main(int argc, char **argv)
         return &portAudioEngine;
     });
 
-    portAudioEngine.logDeviceInfo();
+    if (!offline) {
+        portAudioEngine.logDeviceInfo();
+    }
 
     {
         AppView appView{"standalone"};
+        QTimer offlineFinishedTimer;
 
-        QObject::connect(&portAudioEngine, &PortAudioEngine::runningChanged,
-            [&](bool enabled) {
-                if (enabled) {
-                    appView.setSampleRate(portAudioEngine.sampleRate());
+        auto processFn = [&](float *inOutSamples[CHANNELS_STEREO],
+                             size_t nsamples,
+                             SampleTime now) {
+            appView.process(inOutSamples, nsamples, now);
+        };
+
+        if (offline) {
+            // PortAudioEngine has no process function so it cannot be started
+            offlineEngine.setProcessFn(processFn);
+            appView.setSampleRate(offlineEngine.getSampleRate());
+            appView.setAudioRunning(true);
+            offlineEngine.start(offlineSamples);
+
+            QObject::connect(&offlineFinishedTimer, &QTimer::timeout,
+                [&]() {
+                    if (!offlineEngine.isRunning()) {
+                        app.quit();
+                    }
                 }
-                appView.setAudioRunning(enabled);
-            }
-        );
+            );
+            offlineFinishedTimer.start(100);
+        } else {
+            QObject::connect(&portAudioEngine, &PortAudioEngine::runningChanged,
+                [&](bool enabled) {
+                    if (enabled) {
+                        appView.setSampleRate(portAudioEngine.sampleRate());
+                    }
+                    appView.setAudioRunning(enabled);
+                }
+            );
 
-        portAudioEngine.setProcessFn(
-            [&](float *inOutSamples[CHANNELS_STEREO],
-                size_t nsamples,
-                SampleTime now) {
-                appView.process(inOutSamples, nsamples, now);
-            }
-        );
+            portAudioEngine.setAudioStats(appView.audioProcessor()->stats());
+            portAudioEngine.setProcessFn(processFn);
+        }
 
         appView.setSource({"qrc:/qml/application.qml"});
         appView.show();
 
         rc = app.exec();
 
-        portAudioEngine.stop(false);
+        if (offline) {
+            offlineEngine.stop();
+            appView.setAudioRunning(false);
+            if (parser.isSet(offlineOptions.output) && !offlineOutput.close()) {
+                qCritical("Failed to write output file");
+                rc = 1;
+            }
+        } else {
+            portAudioEngine.stop(false);
+        }
     }
 
     globalCleanup();
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "audio/AudioProcessor.h"
+
+// Time AudioProcessor::process() mixing nstreams playback streams. Streams
+// are refilled outside the timed region like the non-real-time thread would.
+static void benchProcess(size_t nstreams, size_t blockSize,
+                         unsigned int mixThreads)
+{
+    const int sampleRate = 48000;
+    const size_t bufferSize = 8192; // samples per stream
+    const size_t callbacksPerFill = bufferSize / blockSize;
+    const int rounds = 50;
+
+    AudioProcessor processor;
+    processor.setSampleRate(sampleRate);
+    processor.setMixThreads(mixThreads);
+
+    std::vector<std::unique_ptr<AudioStream>> streams;
+    {
+        PlaybackStreamTransaction transaction{&processor};
+        for (size_t i = 0; i < nstreams; i++) {
+            streams.emplace_back(new AudioStream{AudioStream::PLAYBACK});
+            streams.back()->setPan(i % 2 ? -0.5f : 0.5f);
+            processor.addPlaybackStream(streams.back().get());
+        }
+    }
+    processor.setRunning(true);
+
+    // addPlaybackStream() sizes the stream buffer from the sample rate
+    std::vector<float> input(bufferSize, 0.5f);
+    std::vector<float> out[CHANNELS_STEREO] = {
+        std::vector<float>(blockSize),
+        std::vector<float>(blockSize),
+    };
+    float *outPtrs[CHANNELS_STEREO] = {
+        out[CHANNEL_LEFT].data(),
+        out[CHANNEL_RIGHT].data(),
+    };
+
+    SampleTime now = 0;
+    std::chrono::nanoseconds elapsed{0};
+
+    for (int round = 0; round < rounds; round++) {
+        for (auto &stream : streams) {
+            size_t n = std::min(bufferSize, stream->numSamplesWritable());
+            stream->write(now, input.data(), n);
+        }
+        processor.tick();
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t cb = 0; cb < callbacksPerFill; cb++) {
+            processor.process(outPtrs, blockSize, now);
+            now += blockSize;
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        for (auto &stream : streams) {
+            stream->readDiscardAll();
+        }
+    }
+
+    processor.setRunning(false);
+    {
+        PlaybackStreamTransaction transaction{&processor};
+        for (auto &stream : streams) {
+            // The processor deletes removed streams
+            processor.removePlaybackStream(stream.release());
+        }
+    }
+
+    const double nsPerCallback =
+        static_cast<double>(elapsed.count()) / (rounds * callbacksPerFill);
+    const double load = nsPerCallback / (blockSize * 1e9 / sampleRate);
+    printf("process,%zu,%zu,%u,%.1f,%.4f\n",
+           nstreams, blockSize, mixThreads, nsPerCallback, load);
+}
+
+int main(int argc, char **argv)
+{
+    const size_t streamCounts[] = {1, 2, 4, 8, 16, 32, 64, 128};
+    const size_t blockSizes[] = {64, 256};
+    const unsigned int ncpus = std::thread::hardware_concurrency();
+
+    printf("benchmark,streams,block_size,mix_threads,ns_per_callback,dsp_load\n");
+
+    for (size_t blockSize : blockSizes) {
+        for (size_t nstreams : streamCounts) {
+            benchProcess(nstreams, blockSize, 1);
+            if (ncpus > 1) {
+                benchProcess(nstreams, blockSize, std::min(ncpus, 4u));
+            }
+        }
+    }
+    return 0;
+}
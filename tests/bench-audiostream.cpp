@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "audio/AudioStream.h"
+
+// Emulate the mixer reading every playback stream once per audio callback
+template<typename ReadFn>
+static void benchRead(const char *name, size_t nstreams, size_t blockSize,
+                      ReadFn readFn)
+{
+    const size_t bufferSize = 8192; // samples per stream
+    const size_t callbacksPerFill = bufferSize / blockSize;
+    const int rounds = 200;
+
+    std::vector<std::unique_ptr<AudioStream>> streams;
+    for (size_t i = 0; i < nstreams; i++) {
+        streams.emplace_back(new AudioStream{AudioStream::PLAYBACK, bufferSize});
+        streams.back()->setGain(0.8f);
+        streams.back()->setPeakVolumeDecay(0.999f);
+    }
+
+    std::vector<float> input(bufferSize, 0.5f);
+    std::vector<float> out[CHANNELS_STEREO] = {
+        std::vector<float>(blockSize),
+        std::vector<float>(blockSize),
+    };
+    float *outPtrs[CHANNELS_STEREO] = {
+        out[CHANNEL_LEFT].data(),
+        out[CHANNEL_RIGHT].data(),
+    };
+
+    SampleTime now = 0;
+    std::chrono::nanoseconds elapsed{0};
+
+    for (int round = 0; round < rounds; round++) {
+        for (auto &stream : streams) {
+            stream->write(now, input.data(), bufferSize);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t cb = 0; cb < callbacksPerFill; cb++) {
+            for (auto &stream : streams) {
+                readFn(stream.get(), now, outPtrs, blockSize);
+            }
+            now += blockSize;
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+
+    const double nsPerCallback =
+        static_cast<double>(elapsed.count()) / (rounds * callbacksPerFill);
+    printf("%s,%zu,%zu,%.1f\n", name, nstreams, blockSize, nsPerCallback);
+}
+
+// Emulate a channel refilling every playback stream in blocks
+static void benchWrite(size_t nstreams, size_t blockSize)
+{
+    const size_t bufferSize = 8192; // samples per stream
+    const size_t writesPerFill = bufferSize / blockSize;
+    const int rounds = 200;
+
+    std::vector<std::unique_ptr<AudioStream>> streams;
+    for (size_t i = 0; i < nstreams; i++) {
+        streams.emplace_back(new AudioStream{AudioStream::PLAYBACK, bufferSize});
+    }
+
+    std::vector<float> input(blockSize, 0.5f);
+    SampleTime now = 0;
+    std::chrono::nanoseconds elapsed{0};
+
+    for (int round = 0; round < rounds; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t w = 0; w < writesPerFill; w++) {
+            for (auto &stream : streams) {
+                stream->write(now, input.data(), blockSize);
+            }
+            now += blockSize;
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        for (auto &stream : streams) {
+            stream->readDiscardAll();
+        }
+    }
+
+    const double nsPerCallback =
+        static_cast<double>(elapsed.count()) / (rounds * writesPerFill);
+    printf("write,%zu,%zu,%.1f\n", nstreams, blockSize, nsPerCallback);
+}
+
+int main(int argc, char **argv)
+{
+    const size_t nstreams = 64;
+    const size_t blockSizes[] = {32, 64, 128, 256, 512, 1024};
+
+    printf("benchmark,streams,block_size,ns_per_callback\n");
+
+    for (size_t blockSize : blockSizes) {
+        benchWrite(nstreams, blockSize);
+        benchRead("read", nstreams, blockSize,
+            [](AudioStream *stream, SampleTime now, float **out, size_t n) {
+                stream->read(now, out[CHANNEL_LEFT], n);
+            });
+        benchRead("readMixStereo", nstreams, blockSize,
+            [](AudioStream *stream, SampleTime now, float **out, size_t n) {
+                stream->readMixStereo(now, out, n);
+            });
+        benchRead("readDiscard", nstreams, blockSize,
+            [](AudioStream *stream, SampleTime now, float **out, size_t n) {
+                stream->readDiscard(now, n);
+            });
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "audio/rcu.h"
+
+static void report(const char *name, size_t batchSize, size_t nops,
+                   std::chrono::nanoseconds elapsed)
+{
+    const double nsPerOp = static_cast<double>(elapsed.count()) / nops;
+    printf("%s,%zu,%.1f,%.0f\n", name, batchSize, nsPerOp, 1e9 / nsPerOp);
+}
+
+// Read-side critical section overhead as seen by the audio thread
+static void benchReadLock()
+{
+    const size_t nops = 10 * 1000 * 1000;
+    RCUContext rcu;
+    RCUPointer<int> pointer{&rcu, new int{1}};
+    long sum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nops; i++) {
+        RCUReadLocker locker{&rcu};
+        sum += *pointer.load();
+    }
+    report("read_lock", 1, nops, std::chrono::steady_clock::now() - start);
+
+    if (sum != static_cast<long>(nops)) {
+        printf("unexpected sum %ld\n", sum);
+    }
+}
+
+// Publish batchSize new versions, then reclaim the old ones
+static void benchPublishReclaim(size_t batchSize)
+{
+    const size_t nops = 1000 * 1000;
+    RCUContext rcu;
+    RCUPointer<int> pointer{&rcu, new int{0}};
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nops; i += batchSize) {
+        for (size_t j = 0; j < batchSize; j++) {
+            pointer.store(new int{static_cast<int>(i + j)});
+        }
+        rcu.reclaim();
+    }
+    report("publish_reclaim", batchSize, nops,
+           std::chrono::steady_clock::now() - start);
+}
+
+// Like benchPublishReclaim() but with a reader thread entering and leaving
+// critical sections, so reclaim sometimes has to wait for the next epoch
+static void benchPublishReclaimWithReader(size_t batchSize)
+{
+    const size_t nops = 1000 * 1000;
+    RCUContext rcu;
+    RCUPointer<int> pointer{&rcu, new int{0}};
+    std::atomic<bool> done{false};
+
+    std::thread reader{[&rcu, &pointer, &done]() {
+        volatile int value;
+        while (!done.load(std::memory_order_relaxed)) {
+            RCUReadLocker locker{&rcu};
+            value = *pointer.load();
+        }
+        (void)value;
+    }};
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nops; i += batchSize) {
+        for (size_t j = 0; j < batchSize; j++) {
+            pointer.store(new int{static_cast<int>(i + j)});
+        }
+        rcu.reclaim();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    done.store(true);
+    reader.join();
+    report("publish_reclaim_with_reader", batchSize, nops, elapsed);
+}
+
+int main(int argc, char **argv)
+{
+    const size_t batchSizes[] = {1, 16, 256};
+
+    printf("benchmark,batch_size,ns_per_op,ops_per_sec\n");
+
+    benchReadLock();
+    for (size_t batchSize : batchSizes) {
+        benchPublishReclaim(batchSize);
+    }
+
+    // Skip on a single CPU where this only measures the scheduler
+    if (std::thread::hardware_concurrency() > 1) {
+        for (size_t batchSize : batchSizes) {
+            benchPublishReclaimWithReader(batchSize);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "audio/RingBuffer.h"
+
+static const size_t ringSize = 4096;
+static const size_t totalElems = 16 * 1024 * 1024;
+
+static void report(const char *name, size_t chunkSize,
+                   std::chrono::nanoseconds elapsed)
+{
+    const double nsPerElem = static_cast<double>(elapsed.count()) / totalElems;
+    const double melemsPerSec = totalElems / (elapsed.count() / 1e3);
+    printf("%s,%zu,%.3f,%.1f\n", name, chunkSize, nsPerElem, melemsPerSec);
+}
+
+// Write and read back on a single thread, this is the best case
+static void benchSingleThread(size_t chunkSize)
+{
+    RingBuffer<float> ring{ringSize};
+    double sum = 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < totalElems; done += chunkSize) {
+        for (size_t n = 0; n < chunkSize; ) {
+            auto span = ring.writeSpan(chunkSize - n);
+            for (size_t i = 0; i < span.size; i++) {
+                span.data[i] = 1.f;
+            }
+            ring.writeAdvance(span.size);
+            n += span.size;
+        }
+        for (size_t n = 0; n < chunkSize; ) {
+            auto span = ring.readSpan(chunkSize - n);
+            for (size_t i = 0; i < span.size; i++) {
+                sum += span.data[i];
+            }
+            ring.readAdvance(span.size);
+            n += span.size;
+        }
+    }
+    report("span_single_thread", chunkSize,
+           std::chrono::steady_clock::now() - start);
+
+    if (sum != totalElems) {
+        printf("unexpected sum %f\n", sum);
+    }
+}
+
+// Producer and consumer threads, chunkSize 1 uses the per-element API
+static void benchTwoThreads(size_t chunkSize)
+{
+    RingBuffer<float> ring{ringSize};
+    double sum = 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer{[&ring, &sum, chunkSize]() {
+        for (size_t done = 0; done < totalElems; ) {
+            if (chunkSize == 1) {
+                if (ring.canRead()) {
+                    sum += ring.readCurrent();
+                    ring.readNext();
+                    done++;
+                }
+                continue;
+            }
+
+            auto span = ring.readSpan(chunkSize);
+            for (size_t i = 0; i < span.size; i++) {
+                sum += span.data[i];
+            }
+            ring.readAdvance(span.size);
+            done += span.size;
+        }
+    }};
+
+    for (size_t done = 0; done < totalElems; ) {
+        if (chunkSize == 1) {
+            if (ring.canWrite()) {
+                ring.writeCurrent() = 1.f;
+                ring.writeNext();
+                done++;
+            }
+            continue;
+        }
+
+        auto span = ring.writeSpan(std::min(chunkSize, totalElems - done));
+        for (size_t i = 0; i < span.size; i++) {
+            span.data[i] = 1.f;
+        }
+        ring.writeAdvance(span.size);
+        done += span.size;
+    }
+    consumer.join();
+
+    report(chunkSize == 1 ? "element_two_threads" : "span_two_threads",
+           chunkSize, std::chrono::steady_clock::now() - start);
+
+    if (sum != totalElems) {
+        printf("unexpected sum %f\n", sum);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const size_t chunkSizes[] = {32, 256, 1024};
+
+    printf("benchmark,chunk_size,ns_per_element,melements_per_sec\n");
+
+    for (size_t chunkSize : chunkSizes) {
+        benchSingleThread(chunkSize);
+    }
+
+    // Skip threaded runs on a single CPU where they only measure the scheduler
+    if (std::thread::hardware_concurrency() > 1) {
+        benchTwoThreads(1);
+        for (size_t chunkSize : chunkSizes) {
+            benchTwoThreads(chunkSize);
+        }
+    }
+    return 0;
+}
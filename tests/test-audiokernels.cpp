@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "audio/AudioKernels.h"
+
+static const size_t maxSamples = 67; // not a multiple of the vector width
+
+static std::vector<float> makeInput(size_t nsamples)
+{
+    std::vector<float> samples(nsamples);
+    for (size_t i = 0; i < nsamples; i++) {
+        samples[i] = sinf(i * 0.37f) * (i % 7 == 0 ? 1.f : 0.5f);
+    }
+    return samples;
+}
+
+static bool nearlyEqual(float a, float b)
+{
+    return fabsf(a - b) <= 1e-6f * (1.f + fabsf(a));
+}
+
+// Compare each implementation against the scalar one, which is always last
+static void testKernels()
+{
+    const auto kernels = supportedAudioKernels();
+    const AudioKernels *ref = kernels.back();
+
+    for (const AudioKernels *k : kernels) {
+        printf("checking %s kernels\n", k->name);
+
+        // Use an offset so vector loads are unaligned
+        for (size_t offset = 0; offset < 3; offset++) {
+            for (size_t n = 0; n <= maxSamples; n++) {
+                const std::vector<float> in = makeInput(n + offset);
+                std::vector<float> a(n + offset, 0.25f), b(a);
+                std::vector<float> l(a), r(a), refL(a), refR(a);
+
+                k->mixSamples(in.data() + offset, a.data() + offset, n, 0.7f);
+                ref->mixSamples(in.data() + offset, b.data() + offset, n, 0.7f);
+                for (size_t i = 0; i < n + offset; i++) {
+                    assert(nearlyEqual(a[i], b[i]));
+                }
+
+                k->mixSamplesStereo(in.data() + offset, l.data() + offset,
+                                    r.data() + offset, n, 0.3f, 0.9f);
+                ref->mixSamplesStereo(in.data() + offset, refL.data() + offset,
+                                      refR.data() + offset, n, 0.3f, 0.9f);
+                for (size_t i = 0; i < n + offset; i++) {
+                    assert(nearlyEqual(l[i], refL[i]));
+                    assert(nearlyEqual(r[i], refR[i]));
+                }
+
+                k->applyGain(in.data() + offset, a.data() + offset, n, 0.5f);
+                ref->applyGain(in.data() + offset, b.data() + offset, n, 0.5f);
+                for (size_t i = 0; i < n + offset; i++) {
+                    assert(nearlyEqual(a[i], b[i]));
+                }
+
+                const float peakA = k->updatePeakVolume(in.data() + offset, n,
+                                                        0.99f, 0.8f);
+                const float peakB = ref->updatePeakVolume(in.data() + offset,
+                                                          n, 0.99f, 0.8f);
+                assert(nearlyEqual(peakA, peakB));
+            }
+        }
+    }
+}
+
+// Check the peak hold and decay behavior of the reference implementation
+static void testPeakVolume()
+{
+    const AudioKernels *ref = supportedAudioKernels().back();
+    const float in[] = {0.5f, -1.f, 0.f, 0.f};
+
+    assert(ref->updatePeakVolume(in, 2, 0.5f, 0.f) == 1.f);
+    assert(ref->updatePeakVolume(in, 4, 0.5f, 0.f) == 0.25f);
+    assert(ref->updatePeakVolume(&in[2], 2, 0.5f, 2.f) == 0.5f);
+}
+
+int main(int argc, char **argv)
+{
+    testKernels();
+    testPeakVolume();
+
+    printf("ok\n");
+    return 0;
+}
@@ -3,6 +3,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
 #include "audio/AudioProcessor.h"
 
 static const float pi = 3.14159f;
@@ -73,9 +76,239 @@ static void testPlayback()
     // TODO
 }
 
+// Check gain, pan, and monitor of playback streams
 static void testMixing()
 {
-    // TODO
+    const size_t blockSize = 64;
+    AudioProcessor processor;
+    AudioStream *streams[] = {
+        new AudioStream{AudioStream::PLAYBACK},
+        new AudioStream{AudioStream::PLAYBACK},
+        new AudioStream{AudioStream::PLAYBACK},
+    };
+    float left[blockSize];
+    float right[blockSize];
+    float *samples[] = {left, right};
+    float input[blockSize];
+
+    for (size_t i = 0; i < blockSize; i++) {
+        input[i] = 1.f;
+    }
+
+    processor.setRunning(true);
+    for (AudioStream *stream : streams) {
+        processor.addPlaybackStream(stream);
+    }
+
+    streams[0]->setGain(0.5f);
+    streams[1]->setPan(-1.f);
+    streams[2]->setMonitorEnabled(false);
+    processor.tick(); // apply stream parameters
+
+    for (int i = 0; i < 2; i++) {
+        for (AudioStream *stream : streams) {
+            stream->write(i * blockSize, input, blockSize);
+        }
+
+        memset(left, 0, sizeof(left));
+        memset(right, 0, sizeof(right));
+        processor.process(samples, blockSize, i * blockSize);
+
+        for (size_t j = 0; j < blockSize; j++) {
+            assert(left[j] == 0.25f + 1.f);
+            assert(right[j] == 0.25f);
+        }
+
+        // Unmonitored streams are still consumed
+        assert(streams[2]->numSamplesReadable() == 0);
+    }
+    assert(processor.stats()->snapshot().callbacks == 2);
+    assert(processor.stats()->snapshot().streamUnderruns == 0);
+
+    // Monitored streams underrun once when they run dry
+    processor.process(samples, blockSize, 2 * blockSize);
+    processor.process(samples, blockSize, 3 * blockSize);
+    assert(processor.stats()->snapshot().streamUnderruns == 2);
+    assert(streams[0]->getUnderruns() == 1);
+    assert(streams[1]->getUnderruns() == 1);
+    assert(streams[2]->getUnderruns() == 0);
+
+    for (AudioStream *stream : streams) {
+        processor.removePlaybackStream(stream);
+    }
+    processor.tick();
+}
+
+// Mix one block of ones from each stream and return the left output
+static float mixOnes(AudioProcessor &processor,
+                     const std::vector<AudioStream *> &streams,
+                     SampleTime now)
+{
+    const size_t blockSize = 16;
+    float left[blockSize] = {};
+    float right[blockSize] = {};
+    float *samples[] = {left, right};
+    float input[blockSize];
+
+    for (size_t i = 0; i < blockSize; i++) {
+        input[i] = 1.f;
+    }
+    for (AudioStream *stream : streams) {
+        stream->write(now, input, blockSize);
+    }
+
+    processor.process(samples, blockSize, now);
+
+    for (size_t i = 1; i < blockSize; i++) {
+        assert(left[i] == left[0]);
+    }
+    return left[0];
+}
+
+// Check that batched additions and removals are published at once
+static void testTransactions()
+{
+    const size_t nstreams = 40; // spans several chunks
+    AudioProcessor processor;
+    std::vector<AudioStream *> streams;
+    SampleTime now = 0;
+
+    processor.setRunning(true);
+
+    {
+        PlaybackStreamTransaction transaction{&processor};
+
+        for (size_t i = 0; i < nstreams; i++) {
+            streams.push_back(new AudioStream{AudioStream::PLAYBACK});
+            processor.addPlaybackStream(streams.back());
+        }
+
+        // Not visible to the mixer before commit
+        assert(mixOnes(processor, streams, now) == 0.f);
+        now += 16;
+    }
+    assert(mixOnes(processor, streams, now) == nstreams * 0.5f);
+    now += 16;
+
+    // Remove from the front, middle, and end
+    {
+        PlaybackStreamTransaction transaction{&processor};
+
+        for (size_t i : {39u, 0u, 17u, 18u, 5u}) {
+            processor.removePlaybackStream(streams[i]);
+            streams[i] = nullptr;
+        }
+    }
+    streams.erase(std::remove(streams.begin(), streams.end(), nullptr),
+                  streams.end());
+    assert(mixOnes(processor, streams, now) == streams.size() * 0.5f);
+    now += 16;
+
+    // Unbatched changes still work
+    processor.removePlaybackStream(streams.back());
+    streams.pop_back();
+    streams.push_back(new AudioStream{AudioStream::PLAYBACK});
+    processor.addPlaybackStream(streams.back());
+    assert(mixOnes(processor, streams, now) == streams.size() * 0.5f);
+
+    {
+        PlaybackStreamTransaction transaction{&processor};
+        for (AudioStream *stream : streams) {
+            processor.removePlaybackStream(stream);
+        }
+    }
+    processor.tick();
+}
+
+// Check that parallel mixing produces the same output as serial mixing
+static void testParallelMixing()
+{
+    const size_t nstreams = 37;
+    AudioProcessor processor;
+    std::vector<AudioStream *> streams;
+
+    processor.setMixThreads(4);
+    assert(processor.getMixThreads() == 4);
+    processor.setRunning(true);
+
+    for (size_t i = 0; i < nstreams; i++) {
+        streams.push_back(new AudioStream{AudioStream::PLAYBACK});
+        processor.addPlaybackStream(streams.back());
+    }
+
+    for (SampleTime now = 0; now < 1000 * 16; now += 16) {
+        assert(mixOnes(processor, streams, now) == nstreams * 0.5f);
+        processor.tick();
+    }
+
+    {
+        PlaybackStreamTransaction transaction{&processor};
+        for (AudioStream *stream : streams) {
+            processor.removePlaybackStream(stream);
+        }
+    }
+    processor.setRunning(false);
+    processor.setMixThreads(1);
+    assert(processor.getMixThreads() == 1);
+}
+
+// Check that crossing the low-water mark requests service once
+static void testWatermarks()
+{
+    const size_t blockSize = 10;
+    AudioProcessor processor;
+    AudioStream *stream = new AudioStream{AudioStream::PLAYBACK};
+    float left[blockSize];
+    float right[blockSize];
+    float *samples[] = {left, right};
+    float input[100] = {};
+    SampleTime now = 0;
+
+    // 100 samples of buffer and a low-water mark of 50 samples
+    processor.setSampleRate(1000);
+    processor.setWatermarks(100, 50);
+    processor.setRunning(true);
+    processor.addPlaybackStream(stream);
+    assert(stream->write(now, input, 100) == 100);
+
+    auto processBlocks = [&](int nblocks) {
+        for (int i = 0; i < nblocks; i++) {
+            processor.process(samples, blockSize, now);
+            now += blockSize;
+        }
+    };
+    auto requested = [&]() {
+        return processor.waitForServiceRequest(std::chrono::milliseconds{0});
+    };
+
+    // The playback stream drains and the undrained capture streams fill up
+    // at the same rate
+    processBlocks(5);
+    assert(!requested());
+
+    processBlocks(1);
+    assert(requested());
+
+    // Staying below the low-water mark does not request service again
+    processBlocks(2);
+    assert(!requested());
+    processor.tick();
+    processBlocks(1);
+    assert(!requested());
+
+    // Refill and cross again, the full capture streams stay quiet
+    assert(stream->write(100, input, 90) == 90);
+    processBlocks(5);
+    assert(!requested());
+    processBlocks(1);
+    assert(requested());
+    processor.tick();
+
+    processor.interruptServiceWait();
+    assert(!requested());
+
+    processor.removePlaybackStream(stream);
+    processor.tick();
 }
 
 int main(int argc, char **argv)
@@ -83,6 +316,9 @@ int main(int argc, char **argv)
     testCapture();
     testPlayback();
     testMixing();
+    testTransactions();
+    testParallelMixing();
+    testWatermarks();
 
     printf("ok\n");
     return 0;
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include "audio/AudioStats.h"
+
+static void testLoad()
+{
+    AudioStats stats;
+
+    stats.addCallback(250, 1000);
+    stats.addCallback(500, 1000);
+    stats.addCallback(3000, 1000); // missed the deadline
+    stats.addCallback(100, 0); // ignored
+
+    AudioStats::Snapshot snap = stats.snapshot();
+    assert(snap.callbacks == 3);
+    assert(snap.maxLoad == 3.f);
+    assert(snap.loadHistogram[2] == 1);
+    assert(snap.loadHistogram[5] == 1);
+    assert(snap.loadHistogram[AudioStats::LOAD_BUCKETS - 1] == 1);
+
+    // The peak load restarts after each call but maxLoad does not
+    assert(stats.takePeakLoad() == 3.f);
+    assert(stats.takePeakLoad() == 0.f);
+    stats.addCallback(100, 1000);
+    assert(stats.takePeakLoad() == 0.1f);
+    assert(stats.snapshot().maxLoad == 3.f);
+}
+
+static void testXruns()
+{
+    AudioStats stats;
+
+    stats.addXrun(AudioStats::INPUT_OVERFLOW);
+    stats.addXrun(AudioStats::OUTPUT_UNDERFLOW);
+    stats.addXrun(AudioStats::OUTPUT_UNDERFLOW);
+    stats.addStreamUnderrun();
+
+    AudioStats::Snapshot snap = stats.snapshot();
+    assert(snap.xruns[AudioStats::INPUT_UNDERFLOW] == 0);
+    assert(snap.xruns[AudioStats::INPUT_OVERFLOW] == 1);
+    assert(snap.xruns[AudioStats::OUTPUT_UNDERFLOW] == 2);
+    assert(snap.xruns[AudioStats::OUTPUT_OVERFLOW] == 0);
+    assert(snap.streamUnderruns == 1);
+
+    stats.reset();
+    snap = stats.snapshot();
+    assert(snap.xruns[AudioStats::OUTPUT_UNDERFLOW] == 0);
+    assert(snap.streamUnderruns == 0);
+}
+
+static void testTickJitter()
+{
+    AudioStats stats;
+
+    stats.addTick(500 * 1000); // 0.5 ms
+    stats.addTick(-3 * 1000 * 1000); // early ticks count too
+    stats.addTick(INT64_C(10) * 1000 * 1000 * 1000);
+
+    AudioStats::Snapshot snap = stats.snapshot();
+    assert(snap.ticks == 3);
+    assert(snap.maxTickJitterNsec == UINT64_C(10) * 1000 * 1000 * 1000);
+    assert(snap.jitterHistogram[0] == 1);
+    assert(snap.jitterHistogram[2] == 1);
+    assert(snap.jitterHistogram[AudioStats::JITTER_BUCKETS - 1] == 1);
+}
+
+// Counters must not lose updates from concurrent threads
+static void testConcurrentUpdates()
+{
+    const unsigned nthreads = 4;
+    const unsigned niterations = 10000;
+    AudioStats stats;
+    std::vector<std::thread> threads;
+
+    for (unsigned i = 0; i < nthreads; i++) {
+        threads.emplace_back([&stats, i]() {
+            for (unsigned j = 0; j < niterations; j++) {
+                stats.addCallback(i * 100 + j % 100, 1000);
+                stats.addStreamUnderrun();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    AudioStats::Snapshot snap = stats.snapshot();
+    uint64_t total = 0;
+    for (uint64_t count : snap.loadHistogram) {
+        total += count;
+    }
+    assert(snap.callbacks == nthreads * niterations);
+    assert(total == nthreads * niterations);
+    assert(snap.streamUnderruns == nthreads * niterations);
+    assert(snap.maxLoad == 0.399f);
+}
+
+int main(int argc, char **argv)
+{
+    testLoad();
+    testXruns();
+    testTickJitter();
+    testConcurrentUpdates();
+
+    printf("ok\n");
+    return 0;
+}
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: Apache-2.0
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include "audio/AudioStream.h"
 
 const size_t blockSize = 64 /* samples */;
@@ -98,12 +99,222 @@ void testNumSamplesWritable()
     assert(stream.numSamplesReadable() == 0);
 }
 
+// Contiguous writes share a descriptor so many small writes fit
+static void testCoalesceWrites()
+{
+    AudioStream stream{AudioStream::PLAYBACK, 4 * blockSize};
+    float samples[4 * blockSize];
+    float pattern[4 * blockSize];
+
+    for (size_t i = 0; i < 4 * blockSize; i++) {
+        pattern[i] = i;
+        assert(stream.write(i, &pattern[i], 1) == 1);
+    }
+    assert(stream.numSamplesWritable() == 0);
+
+    assert(stream.read(0, samples, 4 * blockSize) == 4 * blockSize);
+    assert(memcmp(samples, pattern, sizeof(samples)) == 0);
+}
+
+// Writes with gaps in time need their own descriptors
+static void testDiscontinuousWrites()
+{
+    AudioStream stream{AudioStream::PLAYBACK, 4 * blockSize};
+    float samples[blockSize];
+    float pattern[blockSize];
+    SampleTime t;
+
+    for (size_t i = 0; i < blockSize; i++) {
+        pattern[i] = i;
+    }
+
+    assert(stream.write(0, pattern, blockSize) == blockSize);
+    assert(stream.write(2 * blockSize, pattern, blockSize) == blockSize);
+
+    assert(stream.peekReadSampleTime(&t) && t == 0);
+    assert(stream.read(0, samples, blockSize) == blockSize);
+    assert(memcmp(samples, pattern, sizeof(samples)) == 0);
+
+    // Nothing to read in the gap
+    assert(stream.peekReadSampleTime(&t) && t == 2 * blockSize);
+    assert(stream.read(blockSize, samples, blockSize) == 0);
+
+    // Seek into the second descriptor
+    assert(stream.read(2 * blockSize + 1, samples, blockSize) == blockSize - 1);
+    assert(memcmp(samples, &pattern[1], (blockSize - 1) * sizeof(float)) == 0);
+    assert(!stream.peekReadSampleTime(&t));
+
+    // Too many gaps
+    size_t n = 0;
+    for (size_t i = 0; i < 2 * MAX_QUEUED_WRITE_BLOCKS; i++) {
+        n += stream.write(4 * blockSize + 2 * i, pattern, 1);
+    }
+    assert(n == MAX_QUEUED_WRITE_BLOCKS - 1);
+
+    // Only writes that continue the last write can still be queued
+    const SampleTime end = 4 * blockSize + 2 * (MAX_QUEUED_WRITE_BLOCKS - 2) + 1;
+    assert(stream.canQueueWrite(end, false));
+    assert(!stream.canQueueWrite(end + 1, false));
+    assert(!stream.canQueueWrite(end, true));
+    assert(stream.write(end, pattern, 1) == 1);
+
+    stream.readDiscardAll();
+    assert(stream.numSamplesReadable() == 0);
+    assert(!stream.peekReadSampleTime(&t));
+}
+
+static void testWriteAcquire()
+{
+    AudioStream stream{AudioStream::PLAYBACK, 2 * blockSize};
+    float samples[blockSize];
+
+    // Fill the region in place and commit part of it
+    AudioStream::WriteRegion region = stream.writeAcquire(blockSize);
+    assert(region.nsamples == blockSize);
+    for (size_t i = 0; i < region.nsamples; i++) {
+        region.samples[i] = i;
+    }
+    assert(stream.writeCommit(0, blockSize / 2) == blockSize / 2);
+    assert(stream.numSamplesReadable() == blockSize / 2);
+
+    // Regions are contiguous so they stop at the end of the sample buffer
+    region = stream.writeAcquire(2 * blockSize);
+    assert(region.nsamples == 3 * blockSize / 2);
+    assert(stream.writeCommit(blockSize / 2, region.nsamples) ==
+           region.nsamples);
+    assert(stream.writeAcquire(blockSize).nsamples == 0);
+
+    assert(stream.read(0, samples, blockSize) == blockSize);
+    for (size_t i = 0; i < blockSize / 2; i++) {
+        assert(samples[i] == i);
+    }
+}
+
+static void testSilence()
+{
+    AudioStream stream{AudioStream::PLAYBACK, 2 * blockSize};
+    float pattern[blockSize];
+    float left[blockSize];
+    float right[blockSize];
+    float *mix[CHANNELS_STEREO] = {left, right};
+    SampleTime t;
+
+    for (size_t i = 0; i < blockSize; i++) {
+        pattern[i] = i + 1;
+    }
+
+    // Silence counts towards the buffer size but takes no sample space
+    assert(stream.writeSilence(0, blockSize) == blockSize);
+    assert(stream.numSamplesReadable() == blockSize);
+    assert(stream.numSamplesWritable() == blockSize);
+    assert(stream.write(blockSize, pattern, blockSize) == blockSize);
+    assert(stream.numSamplesWritable() == 0);
+    assert(stream.writeSilence(2 * blockSize, 1) == 0);
+
+    // Reading silence produces zeros
+    assert(stream.peekReadSampleTime(&t) && t == 0);
+    std::fill_n(left, blockSize, 1.f);
+    assert(stream.read(0, left, blockSize / 2) == blockSize / 2);
+    for (size_t i = 0; i < blockSize / 2; i++) {
+        assert(left[i] == 0.f);
+    }
+
+    // Mixing skips silence and continues into the audio data
+    std::fill_n(left, blockSize, 1.f);
+    std::fill_n(right, blockSize, 1.f);
+    assert(stream.readMixStereo(blockSize / 2, mix, blockSize) == blockSize);
+    for (size_t i = 0; i < blockSize / 2; i++) {
+        assert(left[i] == 1.f && right[i] == 1.f);
+        assert(left[blockSize / 2 + i] == 1.f + pattern[i] / 2);
+    }
+
+    stream.readDiscardAll();
+    assert(stream.numSamplesReadable() == 0);
+    assert(stream.numSamplesWritable() == 2 * blockSize);
+    assert(!stream.peekReadSampleTime(&t));
+}
+
+// Contiguous silence writes share a descriptor like audio data writes
+static void testCoalesceSilence()
+{
+    AudioStream stream{AudioStream::PLAYBACK, 4 * blockSize};
+    float pattern[blockSize];
+    float samples[4 * blockSize];
+
+    for (size_t i = 0; i < blockSize; i++) {
+        pattern[i] = i + 1;
+    }
+
+    for (size_t i = 0; i < 2 * blockSize; i++) {
+        assert(stream.writeSilence(i, 1) == 1);
+    }
+    assert(stream.write(2 * blockSize, pattern, blockSize) == blockSize);
+
+    // The reader catches up with the newest descriptor while it is extended
+    for (size_t i = 0; i < blockSize / 2; i++) {
+        assert(stream.writeSilence(3 * blockSize + i, 1) == 1);
+    }
+    std::fill_n(samples, 4 * blockSize, 1.f);
+    assert(stream.read(0, samples, 4 * blockSize) == 7 * blockSize / 2);
+    for (size_t i = 0; i < blockSize; i++) {
+        assert(samples[2 * blockSize + i] == pattern[i]);
+    }
+    assert(samples[0] == 0.f && samples[7 * blockSize / 2 - 1] == 0.f);
+
+    for (size_t i = blockSize / 2; i < blockSize; i++) {
+        assert(stream.writeSilence(3 * blockSize + i, 1) == 1);
+    }
+    assert(stream.numSamplesReadable() == blockSize / 2);
+    assert(stream.read(7 * blockSize / 2, samples, blockSize) == blockSize / 2);
+    assert(stream.numSamplesWritable() == 4 * blockSize);
+}
+
+// Underruns count when queued samples run out, not while a stream is idle
+static void testUnderruns()
+{
+    AudioStream stream{AudioStream::PLAYBACK, 4 * blockSize};
+    float samples[blockSize] = {};
+
+    assert(stream.read(0, samples, blockSize) == 0);
+    assert(stream.getUnderruns() == 0);
+
+    // Running dry in the middle of a read
+    assert(stream.write(blockSize, samples, blockSize / 2) == blockSize / 2);
+    assert(stream.read(blockSize, samples, blockSize) == blockSize / 2);
+    assert(stream.getUnderruns() == 1);
+    assert(stream.read(2 * blockSize, samples, blockSize) == 0);
+    assert(stream.getUnderruns() == 1);
+
+    // Running dry at the start of a read
+    assert(stream.writeSilence(3 * blockSize, blockSize) == blockSize);
+    assert(stream.read(3 * blockSize, samples, blockSize) == blockSize);
+    assert(stream.read(4 * blockSize, samples, blockSize) == 0);
+    assert(stream.getUnderruns() == 2);
+
+    // Waiting for data queued in the future is not an underrun
+    assert(stream.write(6 * blockSize, samples, blockSize) == blockSize);
+    assert(stream.read(5 * blockSize, samples, blockSize) == 0);
+    assert(stream.read(6 * blockSize, samples, blockSize) == blockSize);
+    assert(stream.getUnderruns() == 2);
+
+    // Unmonitored streams are not heard
+    assert(stream.write(7 * blockSize, samples, blockSize / 2) == blockSize / 2);
+    assert(stream.readDiscard(7 * blockSize, blockSize) == blockSize / 2);
+    assert(stream.getUnderruns() == 2);
+}
+
 int main(int argc, char **argv)
 {
     testWriteFull();
     testReadEmpty();
     testWrapBuffer();
     testNumSamplesWritable();
+    testCoalesceWrites();
+    testDiscontinuousWrites();
+    testWriteAcquire();
+    testSilence();
+    testCoalesceSilence();
+    testUnderruns();
 
     printf("ok\n");
     return 0;
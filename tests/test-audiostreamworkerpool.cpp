@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+#include "core/AudioStreamWorkerPool.h"
+
+// Counts how often and in which order clients are processed
+class CountingClient : public IAudioStreamClient
+{
+public:
+    static std::atomic<unsigned int> sequence;
+
+    std::atomic<unsigned int> count{0};
+    unsigned int startedAt{0};
+
+    void processAudioStreams() override
+    {
+        startedAt = sequence.fetch_add(1);
+        count.fetch_add(1);
+    }
+};
+
+std::atomic<unsigned int> CountingClient::sequence{0};
+
+static void testRun(unsigned int nthreads, size_t nclients)
+{
+    AudioStreamWorkerPool pool;
+    pool.setThreads(nthreads);
+    assert(pool.getThreads() == nthreads);
+
+    std::vector<CountingClient> clients(nclients);
+    std::vector<IAudioStreamClient *> schedule;
+    for (auto &client : clients) {
+        schedule.push_back(&client);
+    }
+
+    const int rounds = 100;
+    for (int round = 0; round < rounds; round++) {
+        pool.run(schedule.data(), schedule.size());
+
+        // run() returns only after every client has been processed
+        for (auto &client : clients) {
+            assert(client.count.load() == static_cast<unsigned int>(round + 1));
+        }
+    }
+}
+
+// Clients are started in the order given
+static void testOrder()
+{
+    AudioStreamWorkerPool pool;
+    std::vector<CountingClient> clients(4);
+    IAudioStreamClient *schedule[] = {
+        &clients[2], &clients[0], &clients[3], &clients[1],
+    };
+
+    CountingClient::sequence.store(0);
+    pool.run(schedule, 4);
+    assert(clients[2].startedAt == 0);
+    assert(clients[0].startedAt == 1);
+    assert(clients[3].startedAt == 2);
+    assert(clients[1].startedAt == 3);
+}
+
+int main(int argc, char **argv)
+{
+    testRun(1, 5);
+    testRun(4, 0);
+    testRun(4, 1);
+    testRun(4, 20);
+    testRun(8, 3);
+    testOrder();
+
+    // Threads can be changed between runs
+    AudioStreamWorkerPool pool;
+    pool.setThreads(3);
+    pool.setThreads(2);
+    assert(pool.getThreads() == 2);
+
+    printf("ok\n");
+    return 0;
+}
@@ -169,12 +169,46 @@ static void testSendIntervals()
     assert(expectedUploadData.empty());
 }
 
+// Encoding in a background thread emits the same signals
+static void testEncoderThread()
+{
+    intervalTime.nextIntervalTime_ = sampleRate; // 1 second
+
+    size_t sampleBufferSize = msecToSamples(sampleRate, 1000);
+    AudioStream captureLeft{AudioStream::CAPTURE, sampleBufferSize};
+    AudioStream captureRight{AudioStream::CAPTURE, sampleBufferSize};
+
+    SampleTime now = 0;
+    LocalChannel chan{"channel0", 0, &captureLeft, &captureRight, &processor,
+                      &intervalTime};
+    QObject::connect(&chan, &LocalChannel::uploadData, uploadData);
+    chan.startEncoderThread();
+    chan.start();
+
+    // The first interval has no signals
+    generateAudioSamples(&captureLeft, now, sampleBufferSize);
+    generateAudioSamples(&captureRight, now, sampleBufferSize);
+    now += sampleBufferSize;
+    chan.processAudioStreams();
+
+    // The second interval has one signal, stopping the thread drains the
+    // encoder queue
+    expectedUploadData.push_back({0, false, true, true, 0});
+    generateAudioSamples(&captureLeft, now, sampleBufferSize);
+    generateAudioSamples(&captureRight, now, sampleBufferSize);
+    now += sampleBufferSize;
+    chan.processAudioStreams();
+    chan.stopEncoderThread();
+    assert(expectedUploadData.empty());
+}
+
 int main(int argc, char **argv)
 {
     processor.setSampleRate(sampleRate);
 
     testSilentIntervals();
     testSendIntervals();
+    testEncoderThread();
 
     printf("ok\n");
     return 0;
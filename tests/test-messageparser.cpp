@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include <QtEndian>
+#include "core/MessageParser.h"
+
+struct TestMessage
+{
+    quint8 type;
+    QByteArray payload;
+};
+
+static QByteArray encode(quint8 type, const QByteArray &payload)
+{
+    const quint32 length = qToLittleEndian(static_cast<quint32>(payload.size()));
+    QByteArray bytes;
+    bytes.append(reinterpret_cast<const char*>(&type), sizeof(type));
+    bytes.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    bytes.append(payload);
+    return bytes;
+}
+
+static QByteArray encode(const std::vector<TestMessage> &msgs)
+{
+    QByteArray bytes;
+    for (const TestMessage &msg : msgs) {
+        bytes.append(encode(msg.type, msg.payload));
+    }
+    return bytes;
+}
+
+// Messages inside one received buffer share its memory
+static void testWholeBuffer()
+{
+    const std::vector<TestMessage> msgs = {
+        {0x5, QByteArray(1000, 'a')},
+        {0xfd, QByteArray()},
+        {0x2, QByteArray(4, 'b')},
+    };
+    const QByteArray bytes = encode(msgs);
+    MessageParser parser;
+    MessageParser::Message msg;
+
+    assert(parser.next(&msg) == MessageParser::NEED_MORE_DATA);
+
+    parser.append(bytes);
+    assert(parser.bufferedBytes() == bytes.size());
+
+    for (const TestMessage &expected : msgs) {
+        assert(parser.next(&msg) == MessageParser::MESSAGE);
+        assert(msg.type == expected.type);
+        assert(msg.length == static_cast<quint32>(expected.payload.size()));
+        assert(msg.payload().toByteArray() == expected.payload);
+        if (msg.length > 0) {
+            assert(msg.chunk.constData() == bytes.constData());
+        }
+    }
+    assert(parser.next(&msg) == MessageParser::NEED_MORE_DATA);
+    assert(parser.bufferedBytes() == 0);
+}
+
+// A payload outlives the parser and the buffer it was received in
+static void testPayloadLifetime()
+{
+    MessageParser::Message kept;
+    {
+        MessageParser parser;
+        MessageParser::Message msg;
+        parser.append(encode(0x5, QByteArray(100, 'c')));
+        assert(parser.next(&msg) == MessageParser::MESSAGE);
+        kept = msg;
+    }
+    assert(kept.payload().toByteArray() == QByteArray(100, 'c'));
+}
+
+// A payload received together with its header, as from
+// QTcpSocket::readAll(), is not copied
+static void testSharedPayload()
+{
+    const QByteArray payload(1000, 'f');
+    const QByteArray bytes = encode(0x5, payload);
+    MessageParser parser;
+    MessageParser::Message msg;
+
+    parser.append(bytes);
+    assert(parser.next(&msg) == MessageParser::MESSAGE);
+    assert(msg.payload().toByteArray() == payload);
+    assert(msg.chunk.constData() == bytes.constData());
+    assert(msg.payload().constData() ==
+           bytes.constData() + MessageParser::HEADER_SIZE);
+
+    // A payload that spans chunks is copied into a buffer of its own
+    const qsizetype split = MessageParser::HEADER_SIZE + 10;
+    parser.append(bytes.left(split));
+    parser.append(bytes.mid(split));
+    assert(parser.next(&msg) == MessageParser::MESSAGE);
+    assert(msg.payload().toByteArray() == payload);
+    assert(msg.offset == 0);
+    assert(msg.chunk.size() == payload.size());
+}
+
+// Headers and payloads split across appends at every possible offset
+static void testSplit()
+{
+    const std::vector<TestMessage> msgs = {
+        {0x1, QByteArray(7, 'd')},
+        {0xfd, QByteArray()},
+        {0x4, QByteArray(30, 'e')},
+    };
+    const QByteArray bytes = encode(msgs);
+
+    for (qsizetype split = 1; split < bytes.size(); split++) {
+        MessageParser parser;
+        MessageParser::Message msg;
+        size_t i = 0;
+
+        parser.append(QByteArray(bytes.constData(), split));
+        while (parser.next(&msg) == MessageParser::MESSAGE) {
+            assert(msg.payload().toByteArray() == msgs.at(i++).payload);
+        }
+        parser.append(QByteArray(bytes.constData() + split,
+                                 bytes.size() - split));
+        while (parser.next(&msg) == MessageParser::MESSAGE) {
+            assert(msg.type == msgs.at(i).type);
+            assert(msg.payload().toByteArray() == msgs.at(i++).payload);
+        }
+        assert(i == msgs.size());
+        assert(parser.bufferedBytes() == 0);
+    }
+}
+
+static void testPayloadTooLarge()
+{
+    MessageParser parser;
+    MessageParser::Message msg;
+    const quint8 type = 0x5;
+    const quint32 length = qToLittleEndian<quint32>(MessageParser::MAX_PAYLOAD_SIZE + 1);
+    QByteArray bytes;
+    bytes.append(reinterpret_cast<const char*>(&type), sizeof(type));
+    bytes.append(reinterpret_cast<const char*>(&length), sizeof(length));
+
+    parser.append(bytes);
+    assert(parser.next(&msg) == MessageParser::PAYLOAD_TOO_LARGE);
+    assert(msg.length == MessageParser::MAX_PAYLOAD_SIZE + 1);
+
+    // The stream cannot be resynchronized
+    parser.append(encode(0xfd, QByteArray()));
+    assert(parser.next(&msg) == MessageParser::PAYLOAD_TOO_LARGE);
+
+    parser.clear();
+    assert(parser.bufferedBytes() == 0);
+    parser.append(encode(0xfd, QByteArray()));
+    assert(parser.next(&msg) == MessageParser::MESSAGE);
+}
+
+// Random messages fed in random chunk sizes come out unchanged
+static void testRandomChunks()
+{
+    std::mt19937 rng{1234};
+
+    for (int round = 0; round < 50; round++) {
+        std::vector<TestMessage> msgs;
+        const int nmsgs = rng() % 20 + 1;
+        for (int i = 0; i < nmsgs; i++) {
+            QByteArray payload(rng() % 3000, '\0');
+            for (qsizetype j = 0; j < payload.size(); j++) {
+                payload[j] = static_cast<char>(rng());
+            }
+            msgs.push_back({static_cast<quint8>(rng()), payload});
+        }
+        const QByteArray bytes = encode(msgs);
+
+        MessageParser parser;
+        MessageParser::Message msg;
+        size_t i = 0;
+        qsizetype pos = 0;
+        while (pos < bytes.size()) {
+            const qsizetype n = qMin<qsizetype>(rng() % 4096 + 1,
+                                                bytes.size() - pos);
+            parser.append(QByteArray(bytes.constData() + pos, n));
+            pos += n;
+
+            while (parser.next(&msg) == MessageParser::MESSAGE) {
+                assert(i < msgs.size());
+                assert(msg.type == msgs.at(i).type);
+                assert(msg.payload().toByteArray() == msgs.at(i).payload);
+                i++;
+            }
+        }
+        assert(i == msgs.size());
+        assert(parser.bufferedBytes() == 0);
+    }
+}
+
+// Arbitrary input never reads out of bounds
+static void testGarbage()
+{
+    std::mt19937 rng{5678};
+
+    for (int round = 0; round < 200; round++) {
+        MessageParser parser;
+        MessageParser::Message msg;
+        qint64 total = 0;
+        qint64 consumed = 0;
+        MessageParser::Result result = MessageParser::NEED_MORE_DATA;
+
+        for (int chunk = 0; chunk < 10; chunk++) {
+            QByteArray bytes(rng() % 64, '\0');
+            for (qsizetype j = 0; j < bytes.size(); j++) {
+                // Small lengths so that some messages complete
+                bytes[j] = static_cast<char>(rng() % 8);
+            }
+            parser.append(bytes);
+            total += bytes.size();
+
+            while ((result = parser.next(&msg)) == MessageParser::MESSAGE) {
+                assert(msg.payload().size() == static_cast<qsizetype>(msg.length));
+                consumed += MessageParser::HEADER_SIZE + msg.payload().size();
+            }
+            if (result == MessageParser::PAYLOAD_TOO_LARGE) {
+                break;
+            }
+            assert(parser.bufferedBytes() == total - consumed);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testWholeBuffer();
+    testPayloadLifetime();
+    testSharedPayload();
+    testSplit();
+    testPayloadTooLarge();
+    testRandomChunks();
+    testGarbage();
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "audio/AudioProcessor.h"
+#include "audio/OfflineAudioEngine.h"
+
+static const int sampleRate = 44100;
+static const size_t nsamples = 10000;
+
+static std::string tempPath(const char *name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// Write a stereo sine wave file with different frequencies on each channel
+static void writeSineWave(const std::string &path)
+{
+    std::vector<float> left(nsamples);
+    std::vector<float> right(nsamples);
+    const float *samples[] = {left.data(), right.data()};
+
+    for (size_t i = 0; i < nsamples; i++) {
+        left[i] = sinf(i * 0.1f);
+        right[i] = sinf(i * 0.13f);
+    }
+
+    AudioFileWriter writer;
+    assert(writer.openWav(path.c_str(), sampleRate));
+    assert(writer.write(samples, nsamples / 2));
+    assert(writer.write(samples, 0));
+    const float *secondHalf[] = {&left[nsamples / 2], &right[nsamples / 2]};
+    assert(writer.write(secondHalf, nsamples - nsamples / 2));
+    assert(writer.close());
+}
+
+static void checkSineWave(AudioFileReader &reader)
+{
+    std::vector<float> left(nsamples + 1);
+    std::vector<float> right(nsamples + 1);
+    float *samples[] = {left.data(), right.data()};
+
+    assert(reader.read(samples, nsamples + 1) == nsamples);
+    for (size_t i = 0; i < nsamples; i++) {
+        assert(left[i] == sinf(i * 0.1f));
+        assert(right[i] == sinf(i * 0.13f));
+    }
+    assert(reader.read(samples, 1) == 0);
+}
+
+static void testWavFile()
+{
+    const std::string path = tempPath("test-offlineaudioengine-wav.wav");
+    writeSineWave(path);
+
+    AudioFileReader reader;
+    assert(reader.openWav(path.c_str()));
+    assert(reader.getChannels() == CHANNELS_STEREO);
+    assert(reader.getSampleRate() == sampleRate);
+    checkSineWave(reader);
+
+    // Raw files have no header
+    assert(!reader.openWav("test-offlineaudioengine.cpp"));
+
+    std::filesystem::remove(path);
+}
+
+// Render a file through AudioProcessor and check that input is monitored
+static void testRender()
+{
+    const std::string inPath = tempPath("test-offlineaudioengine-in.wav");
+    const std::string outPath = tempPath("test-offlineaudioengine-out.raw");
+    writeSineWave(inPath);
+
+    AudioProcessor processor;
+    processor.setSampleRate(sampleRate);
+    processor.setRunning(true);
+
+    AudioFileReader reader;
+    AudioFileWriter writer;
+    assert(reader.openWav(inPath.c_str()));
+    assert(writer.openRaw(outPath.c_str()));
+
+    OfflineAudioEngine engine;
+    engine.setSampleRate(sampleRate);
+    engine.setBufferSize(256);
+    engine.setInput(&reader);
+    engine.setOutput(&writer);
+    engine.setProcessFn(
+        [&](float *inOutSamples[CHANNELS_STEREO],
+            size_t n,
+            SampleTime now) {
+            processor.process(inOutSamples, n, now);
+        }
+    );
+
+    // Render until the end of the input file
+    assert(engine.render(0) == nsamples);
+    assert(engine.getSampleTime() == nsamples);
+    assert(processor.getNextSampleTime() == nsamples);
+    assert(writer.close());
+
+    assert(reader.openRaw(outPath.c_str(), CHANNELS_STEREO, sampleRate));
+    checkSineWave(reader);
+
+    std::filesystem::remove(inPath);
+    std::filesystem::remove(outPath);
+}
+
+// Paced rendering takes as long as the audio lasts
+static void testPaced()
+{
+    OfflineAudioEngine engine;
+    size_t nblocks = 0;
+
+    engine.setSampleRate(sampleRate);
+    engine.setPaced(true);
+    engine.setProcessFn(
+        [&](float *inOutSamples[CHANNELS_STEREO], size_t n, SampleTime now) {
+            nblocks++;
+        }
+    );
+
+    const auto start = std::chrono::steady_clock::now();
+    assert(engine.render(sampleRate / 10) == sampleRate / 10);
+    assert(std::chrono::steady_clock::now() - start >=
+           std::chrono::milliseconds(99));
+    assert(nblocks == (sampleRate / 10 + 511) / 512);
+}
+
+// The render thread runs until stopped
+static void testThread()
+{
+    OfflineAudioEngine engine;
+    std::atomic<bool> started{false};
+
+    engine.setProcessFn(
+        [&](float *inOutSamples[CHANNELS_STEREO], size_t n, SampleTime now) {
+            started.store(true);
+        }
+    );
+
+    engine.start(UINT64_MAX);
+    while (!started.load()) {
+        std::this_thread::yield();
+    }
+    assert(engine.isRunning());
+    engine.stop();
+    assert(!engine.isRunning());
+    assert(engine.getSampleTime() > 0);
+
+    // A finite render finishes on its own
+    const SampleTime t = engine.getSampleTime();
+    engine.start(1000);
+    engine.wait();
+    assert(!engine.isRunning());
+    assert(engine.getSampleTime() == t + 1000);
+}
+
+int main(int argc, char **argv)
+{
+    testWavFile();
+    testRender();
+    testPaced();
+    testThread();
+
+    printf("ok\n");
+    return 0;
+}
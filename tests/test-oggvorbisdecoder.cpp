@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: Apache-2.0
 #include <assert.h>
 #include <stdio.h>
+#include <vector>
 #include <QFile>
 #include "core/OggVorbisDecoder.h"
 
@@ -102,6 +103,141 @@ static void testSmallReadsStereo()
     decodeFileSmallReads("data/sine-44_1kHz-stereo.ogg", 8, 44100);
 }
 
+// Append the whole file in uneven chunks before decoding so that reads span
+// chunk boundaries
+static void decodeFileChunked(const char *filename, int seconds,
+                              int sampleRate)
+{
+    QFile file{filename};
+    assert(file.open(QIODevice::ReadOnly));
+
+    OggVorbisDecoder decoder;
+    int chunkSize = 1;
+    while (!file.atEnd()) {
+        decoder.appendData(file.read(chunkSize));
+        chunkSize = chunkSize * 3 % 1021 + 1;
+    }
+
+    QByteArray left, right;
+    size_t nsamples = seconds * sampleRate;
+    assert(decoder.decode(&left, &right, nsamples + 1) == nsamples);
+    assert(decoder.state() == OggVorbisDecoder::State::Open);
+    assert(decoder.sampleRate() == sampleRate);
+    assert(decoder.decode(&left, &right, 1) == 0);
+}
+
+static void testChunkedInputMono()
+{
+    decodeFileChunked("data/sine-44_1kHz-mono.ogg", 8, 44100);
+}
+
+static void testChunkedInputStereo()
+{
+    decodeFileChunked("data/sine-44_1kHz-stereo.ogg", 8, 44100);
+}
+
+// Audio data at an offset inside larger buffers, like network receive buffers
+// that also hold message headers
+static void testChunkSlices()
+{
+    QFile file{"data/sine-44_1kHz-stereo.ogg"};
+    assert(file.open(QIODevice::ReadOnly));
+    const QByteArray data = file.readAll();
+
+    OggVorbisDecoder decoder;
+    const qsizetype chunkSize = 997;
+    const qsizetype headerSize = 5;
+    for (qsizetype pos = 0; pos < data.size(); pos += chunkSize) {
+        const qsizetype n = qMin(chunkSize, data.size() - pos);
+        QByteArray chunk(headerSize, 'h');
+        chunk.append(data.constData() + pos, n);
+        chunk.append(QByteArray(headerSize, 't'));
+        decoder.appendData(chunk, headerSize, n);
+    }
+
+    QByteArray left, right;
+    size_t nsamples = 8 * 44100;
+    assert(decoder.decode(&left, &right, nsamples + 1) == nsamples);
+    assert(decoder.sampleRate() == 44100);
+}
+
+// Decode into planar float buffers, mono streams only fill the left channel
+static void decodePlanar(const char *filename, bool expectMono)
+{
+    QFile file{filename};
+    assert(file.open(QIODevice::ReadOnly));
+
+    OggVorbisDecoder decoder;
+    decoder.appendData(file.readAll());
+
+    const size_t nsamples = 1024;
+    std::vector<float> left(nsamples, 2.f);
+    std::vector<float> right(nsamples, 2.f);
+    float *const samples[CHANNELS_STEREO] = {left.data(), right.data()};
+    bool mono = !expectMono;
+
+    assert(decoder.decode(samples, nsamples, &mono) == nsamples);
+    assert(mono == expectMono);
+    for (size_t i = 0; i < nsamples; i++) {
+        assert(left[i] >= -1.f && left[i] <= 1.f);
+        if (expectMono) {
+            assert(right[i] == 2.f);
+        } else {
+            assert(right[i] >= -1.f && right[i] <= 1.f);
+        }
+    }
+}
+
+static void testPlanarMono()
+{
+    decodePlanar("data/sine-44_1kHz-mono.ogg", true);
+}
+
+static void testPlanarStereo()
+{
+    decodePlanar("data/sine-44_1kHz-stereo.ogg", false);
+}
+
+// Interleaved decoding matches planar decoding
+static void decodeInterleaved(const char *filename, int expectedChannels)
+{
+    QFile file{filename};
+    assert(file.open(QIODevice::ReadOnly));
+    const QByteArray data = file.readAll();
+
+    OggVorbisDecoder planarDecoder;
+    OggVorbisDecoder decoder;
+    assert(decoder.channels() == 0);
+    planarDecoder.appendData(data);
+    decoder.appendData(data);
+    assert(decoder.channels() == expectedChannels);
+
+    const size_t nsamples = 1024;
+    std::vector<float> left(nsamples);
+    std::vector<float> right(nsamples);
+    float *const samples[CHANNELS_STEREO] = {left.data(), right.data()};
+    bool mono;
+    assert(planarDecoder.decode(samples, nsamples, &mono) == nsamples);
+
+    std::vector<float> interleaved(nsamples * expectedChannels);
+    assert(decoder.decodeInterleaved(interleaved.data(), nsamples) == nsamples);
+    for (size_t i = 0; i < nsamples; i++) {
+        for (int ch = 0; ch < expectedChannels; ch++) {
+            assert(interleaved[i * expectedChannels + ch] == samples[ch][i]);
+        }
+    }
+}
+
+static void testInterleavedMono()
+{
+    decodeInterleaved("data/sine-44_1kHz-mono.ogg", 1);
+}
+
+static void testInterleavedStereo()
+{
+    decodeInterleaved("data/sine-44_1kHz-stereo.ogg", 2);
+}
+
 static void decodeWholeFile(const char *filename, int seconds, int sampleRate)
 {
     QByteArray left, right;
@@ -137,6 +273,13 @@ int main(int argc, char **argv)
     testStereo();
     testSmallReadsMono();
     testSmallReadsStereo();
+    testChunkedInputMono();
+    testChunkedInputStereo();
+    testChunkSlices();
+    testPlanarMono();
+    testPlanarStereo();
+    testInterleavedMono();
+    testInterleavedStereo();
     testDecodeFileMono();
     testDecodeFileStereo();
     testDecodeFileMono48k();
@@ -1,7 +1,10 @@
 // SPDX-License-Identifier: Apache-2.0
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
+#include <vector>
 #include "core/OggVorbisEncoder.h"
+#include "core/OggVorbisEncoderPool.h"
 
 enum {
     NUM_CHANNELS = 1,
@@ -25,9 +28,91 @@ static void testReset()
     assert(data.size() > 1);
 }
 
+static QByteArray encodeSilence(OggVorbisEncoder *encoder)
+{
+    std::vector<float> samples(SAMPLE_RATE, 0.f);
+
+    QByteArray data = encoder->encode(samples.data(), nullptr, samples.size());
+    data.append(encoder->encode(nullptr, nullptr, 0));
+    return data;
+}
+
+// Encoders using cached header packets produce identical streams
+static void testHeaderCache()
+{
+    OggVorbisEncoder first(NUM_CHANNELS, SAMPLE_RATE);
+    OggVorbisEncoder second(NUM_CHANNELS, SAMPLE_RATE);
+
+    QByteArray expected = encodeSilence(&first);
+    assert(expected.size() > 1);
+    assert(encodeSilence(&second) == expected);
+
+    first.reset();
+    assert(encodeSilence(&first) == expected);
+}
+
+static void testPool()
+{
+    OggVorbisEncoderPool pool(NUM_CHANNELS, SAMPLE_RATE);
+    assert(pool.numSpare() == 0);
+    pool.refill();
+    assert(pool.numSpare() == 1);
+
+    std::unique_ptr<OggVorbisEncoder> encoder = pool.take();
+    assert(encoder->ready());
+    assert(pool.numSpare() == 0);
+    QByteArray expected = encodeSilence(encoder.get());
+
+    // Recycled encoders are reset before reuse
+    pool.recycle(std::move(encoder));
+    pool.refill();
+    assert(pool.numSpare() == 1);
+    encoder = pool.take();
+    assert(encodeSilence(encoder.get()) == expected);
+
+    // Encoders are built on demand when none are spare
+    assert(pool.take()->ready());
+
+    // Changing the sample rate discards spare encoders
+    pool.refill();
+    pool.setSampleRate(48000);
+    assert(pool.numSpare() == 0);
+    assert(pool.take()->sampleRate() == 48000);
+}
+
+// Lower quality produces less data
+static void testQuality()
+{
+    std::vector<float> samples(SAMPLE_RATE);
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = sinf(i * 0.1f) * 0.5f + sinf(i * 0.37f) * 0.25f;
+    }
+
+    OggVorbisEncoder high(NUM_CHANNELS, SAMPLE_RATE, 0.5f);
+    OggVorbisEncoder low(NUM_CHANNELS, SAMPLE_RATE, -0.1f);
+    assert(high.quality() == 0.5f);
+    assert(low.quality() == -0.1f);
+
+    QByteArray highData = high.encode(samples.data(), nullptr, samples.size());
+    highData.append(high.encode(nullptr, nullptr, 0));
+    QByteArray lowData = low.encode(samples.data(), nullptr, samples.size());
+    lowData.append(low.encode(nullptr, nullptr, 0));
+    assert(lowData.size() < highData.size());
+
+    // Quality changes take effect on reset
+    low.setQuality(0.5f);
+    low.reset();
+    QByteArray data = low.encode(samples.data(), nullptr, samples.size());
+    data.append(low.encode(nullptr, nullptr, 0));
+    assert(data == highData);
+}
+
 int main(int argc, char **argv)
 {
     testReset();
+    testHeaderCache();
+    testPool();
+    testQuality();
 
     printf("ok\n");
     return 0;
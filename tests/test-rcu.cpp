@@ -1,7 +1,10 @@
 // SPDX-License-Identifier: Apache-2.0
 #include <assert.h>
 #include <stdio.h>
+#include <atomic>
+#include <chrono>
 #include <thread>
+#include <vector>
 #include <future>
 #include <functional>
 #include "audio/rcu.h"
@@ -66,10 +69,114 @@ static void testDeleter()
     assert(deleted);
 }
 
+// Readers in several threads must never see a reclaimed object
+static void testMultipleReaders()
+{
+    struct Object
+    {
+        unsigned magic;
+    };
+    const unsigned nreaders = 4;
+    const unsigned live = 0x600df00d;
+
+    RCUContext rcu;
+    RCUPointer<Object, std::function<void (Object *)>> pointer{
+        &rcu, new Object{live},
+        [](Object *object) {
+            object->magic = 0xdeadbeef;
+            delete object;
+        }
+    };
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readerThreads;
+
+    for (unsigned reader = 0; reader < nreaders; reader++) {
+        readerThreads.emplace_back([&rcu, &pointer, &done, reader, live]() {
+            while (!done.load()) {
+                RCUReadLocker readLocker{&rcu, reader};
+                Object *object = pointer.load();
+                for (int i = 0; i < 100; i++) {
+                    assert(object->magic == live);
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < 20000; i++) {
+        pointer.store(new Object{live});
+        rcu.reclaim();
+    }
+
+    done.store(true);
+    for (auto &thread : readerThreads) {
+        thread.join();
+    }
+
+    pointer.store(nullptr);
+}
+
+static void testSynchronize()
+{
+    RCUContext rcu;
+    int reclaimed = 0;
+
+    rcu.readLock(1);
+    rcu.addReclaimItem([&reclaimed]() { reclaimed++; });
+
+    // The reader is still in its critical section
+    rcu.reclaim();
+    assert(reclaimed == 0);
+    assert(!rcu.synchronize(std::chrono::milliseconds(10)));
+    assert(reclaimed == 0);
+
+    std::thread readerThread{[&rcu]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        rcu.readUnlock(1);
+    }};
+    assert(rcu.synchronize(std::chrono::milliseconds(10000)));
+    assert(reclaimed == 1);
+    readerThread.join();
+
+    // Readers that are not running do not hold up reclamation
+    rcu.addReclaimItem([&reclaimed]() { reclaimed++; });
+    rcu.reclaim();
+    assert(reclaimed == 2);
+}
+
+// More reclaim items than are preallocated
+static void testManyItems()
+{
+    const int nitems = 3 * RCUContext::RECLAIM_BLOCK_SIZE + 1;
+    int reclaimed = 0;
+
+    {
+        RCUContext rcu;
+
+        rcu.readLock();
+        for (int i = 0; i < nitems; i++) {
+            rcu.addReclaimItem([&reclaimed]() { reclaimed++; });
+        }
+        rcu.reclaim();
+        assert(reclaimed == 0);
+        rcu.readUnlock();
+
+        rcu.reclaim();
+        assert(reclaimed == nitems);
+
+        rcu.addReclaimItem([&reclaimed]() { reclaimed++; });
+    }
+
+    // Destructor reclaims remaining items
+    assert(reclaimed == nitems + 1);
+}
+
 int main(int argc, char **argv)
 {
     testPointer();
     testDeleter();
+    testMultipleReaders();
+    testSynchronize();
+    testManyItems();
 
     printf("ok\n");
     return 0;
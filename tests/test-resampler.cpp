@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: Apache-2.0
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 #include <QFile>
 #include "core/OggVorbisDecoder.h"
 #include "core/Resampler.h"
@@ -43,10 +46,212 @@ static void testDownsample()
     resample("data/sine-48kHz-mono.ogg", 8, 48000, 44100);
 }
 
+// Feeding input in place in small pieces produces the same output as
+// appending everything at once
+static void testAppendInPlace()
+{
+    QByteArray left, right;
+    int sampleRate;
+    size_t n = OggVorbisDecoder::decodeFile("data/sine-44_1kHz-mono.ogg",
+                                            &left, &right, &sampleRate);
+    assert(n > 0);
+    const float *input = reinterpret_cast<const float*>(left.constData());
+    const double ratio = 48000. / 44100.;
+
+    Resampler expected;
+    expected.setRatio(ratio);
+    expected.appendData(left);
+    expected.finishAppendingData();
+    QByteArray expectedOutput;
+    while (expected.resample(&expectedOutput, 4096) > 0) {
+        // Do nothing
+    }
+
+    Resampler resampler;
+    resampler.setRatio(ratio);
+    QByteArray output;
+    const size_t chunkSize = 1000;
+    for (size_t i = 0; i < n; i += chunkSize) {
+        size_t m = qMin(chunkSize, n - i);
+        float *buf = resampler.appendAcquire(chunkSize);
+        memcpy(buf, input + i, m * sizeof(float));
+        resampler.appendCommit(m);
+        resampler.resample(&output, 512);
+    }
+    resampler.finishAppendingData();
+    while (resampler.resample(&output, 4096) > 0) {
+        // Do nothing
+    }
+
+    assert(output.size() == expectedOutput.size());
+    const float *a = reinterpret_cast<const float*>(output.constData());
+    const float *b = reinterpret_cast<const float*>(expectedOutput.constData());
+    for (size_t i = 0; i < output.size() / sizeof(float); i++) {
+        assert(fabsf(a[i] - b[i]) < 1e-4f);
+    }
+}
+
+// A ratio of exactly 1.0 copies samples unchanged
+static void testPassthrough()
+{
+    std::vector<float> input(1000);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = sinf(i * 0.1f);
+    }
+
+    Resampler resampler;
+    resampler.setRatio(1.0);
+    assert(resampler.isPassthrough());
+    resampler.appendData(input.data(), input.size());
+    assert(resampler.numBufferedSamples() == input.size());
+
+    std::vector<float> output(input.size());
+    assert(resampler.resample(output.data(), 600) == 600);
+    assert(resampler.resample(output.data() + 600, 600) == 400);
+    assert(resampler.resample(output.data(), 1) == 0);
+    assert(output == input);
+    assert(resampler.numBufferedSamples() == 0);
+
+    // Once converting the resampler keeps its filter state until reset
+    resampler.setRatio(2.0);
+    resampler.appendData(input.data(), input.size());
+    assert(!resampler.isPassthrough());
+    assert(resampler.resample(output.data(), output.size()) > 0);
+    resampler.setRatio(1.0);
+    assert(!resampler.isPassthrough());
+
+    resampler.reset();
+    resampler.setRatio(1.0);
+    assert(resampler.isPassthrough());
+}
+
+// All quality tiers produce the expected number of samples
+static void testQuality()
+{
+    static const Resampler::Quality tiers[] = {
+        Resampler::BestQuality,
+        Resampler::MediumQuality,
+        Resampler::Fastest,
+        Resampler::Linear,
+    };
+    std::vector<float> input(44100);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = sinf(i * 0.1f);
+    }
+
+    for (Resampler::Quality quality : tiers) {
+        Resampler resampler;
+        resampler.setQuality(quality);
+        assert(resampler.quality() == quality);
+        resampler.setRatio(48000. / 44100.);
+        resampler.appendData(input.data(), input.size());
+        resampler.finishAppendingData();
+
+        QByteArray output;
+        while (resampler.resample(&output, 4096) > 0) {
+            // Do nothing
+        }
+
+        size_t n = output.size() / sizeof(float);
+        assert(n >= 47990 && n <= 48010);
+    }
+}
+
+// Stereo channels are filtered together and match separate mono resamplers
+static void testStereo()
+{
+    std::vector<float> left(10000), right(10000);
+    for (size_t i = 0; i < left.size(); i++) {
+        left[i] = sinf(i * 0.1f);
+        right[i] = sinf(i * 0.13f);
+    }
+    const double ratio = 48000. / 44100.;
+
+    Resampler stereo;
+    stereo.setChannels(2);
+    assert(stereo.channels() == 2);
+    stereo.setRatio(ratio);
+    const float *input[] = {left.data(), right.data()};
+    stereo.appendPlanar(input, left.size());
+    assert(stereo.numBufferedSamples() == left.size());
+    stereo.finishAppendingData();
+
+    std::vector<float> outLeft(12000), outRight(12000);
+    float *output[] = {outLeft.data(), outRight.data()};
+    size_t n = 0;
+    size_t m;
+    while ((m = stereo.resample(output, 1000)) > 0) {
+        output[0] += m;
+        output[1] += m;
+        n += m;
+    }
+    assert(n > left.size());
+
+    for (const std::vector<float> *channel : {&left, &right}) {
+        Resampler mono;
+        mono.setRatio(ratio);
+        mono.appendData(channel->data(), channel->size());
+        mono.finishAppendingData();
+
+        std::vector<float> expected(12000);
+        size_t k = 0;
+        while ((m = mono.resample(expected.data() + k, 1000)) > 0) {
+            k += m;
+        }
+        assert(k == n);
+
+        const std::vector<float> &actual =
+            channel == &left ? outLeft : outRight;
+        for (size_t i = 0; i < n; i++) {
+            assert(fabsf(actual[i] - expected[i]) < 1e-4f);
+        }
+    }
+
+    // Changing the number of channels discards buffered input
+    stereo.appendPlanar(input, 100);
+    stereo.setChannels(1);
+    assert(stereo.numBufferedSamples() == 0);
+}
+
+// Mono is converted once and duplicated into both planar outputs
+static void testMonoToStereo()
+{
+    std::vector<float> input(10000);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = sinf(i * 0.1f);
+    }
+
+    Resampler resampler;
+    resampler.setRatio(48000. / 44100.);
+    resampler.appendData(input.data(), input.size());
+    resampler.finishAppendingData();
+
+    std::vector<float> outLeft(12000), outRight(12000, -1.f);
+    float *output[] = {outLeft.data(), outRight.data()};
+    size_t n = 0;
+    size_t m;
+    while ((m = resampler.resample(output, 2, 1000)) > 0) {
+        output[0] += m;
+        output[1] += m;
+        n += m;
+    }
+    assert(n > input.size());
+    assert(resampler.channels() == 1);
+
+    for (size_t i = 0; i < n; i++) {
+        assert(outLeft[i] == outRight[i]);
+    }
+}
+
 int main(int argc, char **argv)
 {
     testUpsample();
     testDownsample();
+    testAppendInPlace();
+    testPassthrough();
+    testQuality();
+    testStereo();
+    testMonoToStereo();
 
     printf("ok\n");
     return 0;
@@ -3,7 +3,7 @@
 #include <stdio.h>
 #include <thread>
 #include <future>
-#include "RingBuffer.h"
+#include "audio/RingBuffer.h"
 
 static void testCanWrite()
 {
@@ -50,11 +50,92 @@ static void testWrapping()
     }
 }
 
+// Capacity is not rounded up even though storage is a power of two
+static void testCapacity()
+{
+    RingBuffer<char> ring{5};
+
+    assert(ring.capacity() == 5);
+    for (int i = 0; i < 5; i++) {
+        assert(ring.canWrite());
+        ring.writeNext();
+    }
+    assert(!ring.canWrite());
+    assert(ring.numWritable() == 0);
+    assert(ring.numReadable() == 5);
+}
+
+static void testSpans()
+{
+    RingBuffer<int> ring{8};
+
+    auto w = ring.writeSpan(6);
+    assert(w.size == 6);
+    for (size_t i = 0; i < w.size; i++) {
+        w.data[i] = i;
+    }
+    ring.writeAdvance(6);
+
+    auto r = ring.readSpan(4);
+    assert(r.size == 4);
+    assert(r.data[0] == 0 && r.data[3] == 3);
+    ring.readAdvance(4);
+
+    // Only the region up to the end of storage is contiguous
+    w = ring.writeSpan();
+    assert(w.size == 2);
+    ring.writeAdvance(2);
+    w = ring.writeSpan();
+    assert(w.size == 4);
+    ring.writeAdvance(4);
+    assert(ring.writeSpan().size == 0);
+
+    r = ring.readSpan();
+    assert(r.size == 4);
+    ring.readAdvance(4);
+    assert(ring.numReadable() == 4);
+}
+
+// One reader thread and one writer thread
+static void testThreads()
+{
+    const unsigned count = 1000000;
+    RingBuffer<unsigned> ring{100};
+
+    std::thread readerThread{
+        [&ring]() {
+            unsigned expected = 0;
+            while (expected < count) {
+                auto span = ring.readSpan();
+                for (size_t i = 0; i < span.size; i++) {
+                    assert(span.data[i] == expected);
+                    expected++;
+                }
+                ring.readAdvance(span.size);
+            }
+        }
+    };
+
+    for (unsigned i = 0; i < count;) {
+        if (!ring.canWrite()) {
+            continue;
+        }
+        ring.writeCurrent() = i++;
+        ring.writeNext();
+    }
+
+    readerThread.join();
+    assert(!ring.canRead());
+}
+
 int main(int argc, char **argv)
 {
     testCanWrite();
     testCanRead();
     testWrapping();
+    testCapacity();
+    testSpans();
+    testThreads();
 
     printf("ok\n");
     return 0;
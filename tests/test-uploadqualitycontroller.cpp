@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <stdio.h>
+#include "core/UploadQualityController.h"
+
+static const int64_t intervalBytes = 64000;
+
+// Keeping up with the upload stays at the highest quality
+static void testKeepingUp()
+{
+    UploadQualityController controller;
+    for (int i = 0; i < 10; i++) {
+        controller.update(0, intervalBytes, intervalBytes);
+        assert(controller.tier() == 0);
+    }
+
+    // A small backlog that is draining is fine
+    controller.update(intervalBytes / 8, intervalBytes, intervalBytes);
+    controller.update(intervalBytes / 16, intervalBytes, intervalBytes);
+    assert(controller.tier() == 0);
+}
+
+// Step down before the backlog reaches a whole interval
+static void testStepDown()
+{
+    UploadQualityController controller{{0.4f, 0.f, -0.1f}};
+    assert(controller.quality() == 0.4f);
+
+    assert(controller.update(intervalBytes / 2, intervalBytes,
+                             intervalBytes / 2) == 0.f);
+    assert(controller.tier() == 1);
+
+    // A growing backlog steps down too
+    controller.update(intervalBytes / 2 + 1, intervalBytes * 2,
+                      intervalBytes * 2 - 1);
+    assert(controller.tier() == 2);
+
+    // Never below the lowest tier
+    controller.update(intervalBytes * 4, intervalBytes, 0);
+    assert(controller.tier() == 2);
+    assert(controller.quality() == -0.1f);
+}
+
+// Step back up after the backlog has stayed drained
+static void testStepUp()
+{
+    UploadQualityController controller{{0.4f, 0.f}};
+    controller.update(intervalBytes, intervalBytes, 0);
+    assert(controller.tier() == 1);
+
+    for (int i = 0; i < 3; i++) {
+        controller.update(0, intervalBytes, intervalBytes * 2);
+        assert(controller.tier() == 1);
+    }
+
+    // Silent intervals count as drained
+    controller.update(0, 0, 0);
+    assert(controller.tier() == 0);
+
+    controller.update(intervalBytes, intervalBytes, 0);
+    controller.reset();
+    assert(controller.tier() == 0);
+}
+
+int main(int argc, char **argv)
+{
+    testKeepingUp();
+    testStepDown();
+    testStepUp();
+
+    printf("ok\n");
+    return 0;
+}
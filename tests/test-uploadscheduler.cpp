@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: Apache-2.0
+#include <assert.h>
+#include <stdio.h>
+#include "core/UploadScheduler.h"
+
+static const UploadScheduler::FourCC fourCC{'O', 'G', 'G', 'v'};
+
+static QByteArray audioData(int size)
+{
+    return QByteArray(size, 'x');
+}
+
+// Send everything that fits and return the number of messages
+static int drain(UploadScheduler *scheduler, qint64 bytesInFlight = 0)
+{
+    UploadScheduler::Message msg;
+    int n = 0;
+    while (scheduler->next(bytesInFlight, &msg)) {
+        n++;
+    }
+    return n;
+}
+
+// Messages come out in order: begin first, then writes
+static void testOrder()
+{
+    UploadScheduler scheduler;
+    const QUuid guid = QUuid::createUuid();
+    UploadScheduler::Message msg;
+
+    assert(!scheduler.next(0, &msg));
+
+    scheduler.beginInterval(guid, 0, fourCC, 0);
+    scheduler.writeInterval(guid, 0, audioData(100));
+    scheduler.writeInterval(guid, 0x1, audioData(50));
+    assert(scheduler.pendingBytes() == 150);
+
+    assert(scheduler.next(0, &msg));
+    assert(msg.begin);
+    assert(msg.guid == guid);
+    assert(msg.fourCC == fourCC);
+    assert(msg.channelIndex == 0);
+
+    assert(scheduler.next(0, &msg));
+    assert(!msg.begin);
+    assert(msg.data.size() == 100);
+    assert(msg.flags == 0);
+
+    assert(scheduler.next(0, &msg));
+    assert(msg.data.size() == 50);
+    assert(msg.flags == 0x1);
+
+    assert(!scheduler.next(0, &msg));
+    assert(scheduler.pendingBytes() == 0);
+    assert(scheduler.droppedBytes() == 0);
+}
+
+// Nothing is released while the budget is used up
+static void testBudget()
+{
+    UploadScheduler scheduler;
+    scheduler.setBudget(1000);
+    const QUuid guid = QUuid::createUuid();
+    UploadScheduler::Message msg;
+
+    scheduler.beginInterval(guid, 0, fourCC, 0);
+    scheduler.writeInterval(guid, 0x1, audioData(100));
+    assert(!scheduler.next(1000, &msg));
+    assert(scheduler.next(999, &msg));
+    assert(drain(&scheduler) == 1);
+}
+
+// Silent intervals have no audio data
+static void testSilence()
+{
+    UploadScheduler scheduler;
+    UploadScheduler::Message msg;
+
+    scheduler.beginInterval(QUuid(), 0, fourCC, 0);
+    assert(scheduler.next(0, &msg));
+    assert(msg.begin);
+    assert(msg.guid.isNull());
+    assert(!scheduler.next(0, &msg));
+}
+
+// Falling two intervals behind abandons the partially sent interval but keeps
+// the next one, which is only one interval late
+static void testFallBehind()
+{
+    UploadScheduler scheduler;
+    scheduler.setBudget(1000);
+    const QUuid first = QUuid::createUuid();
+    const QUuid second = QUuid::createUuid();
+    const QUuid third = QUuid::createUuid();
+    UploadScheduler::Message msg;
+
+    scheduler.beginInterval(first, 0, fourCC, 0);
+    scheduler.writeInterval(first, 0, audioData(300));
+    scheduler.writeInterval(first, 0x1, audioData(400));
+    assert(scheduler.next(0, &msg) && msg.begin);
+    assert(scheduler.next(0, &msg) && msg.data.size() == 300);
+
+    // Uplink stalls
+    scheduler.beginInterval(second, 0, fourCC, 0);
+    scheduler.writeInterval(second, 0x1, audioData(700));
+
+    // Another channel is not affected
+    const QUuid other = QUuid::createUuid();
+    scheduler.beginInterval(other, 0, fourCC, 1);
+
+    scheduler.beginInterval(third, 0, fourCC, 0);
+    assert(scheduler.droppedIntervals() == 1);
+    assert(scheduler.droppedBytes() == 400);
+    assert(scheduler.pendingBytes() == 700);
+
+    // The first interval is finished early
+    assert(scheduler.next(0, &msg));
+    assert(!msg.begin && msg.guid == first);
+    assert(msg.flags == 0x1 && msg.data.isEmpty());
+
+    // The second interval is sent in full
+    assert(scheduler.next(0, &msg));
+    assert(msg.begin && msg.guid == second);
+    assert(scheduler.next(0, &msg));
+    assert(!msg.begin && msg.guid == second);
+    assert(msg.flags == 0x1 && msg.data.size() == 700);
+
+    assert(scheduler.next(0, &msg));
+    assert(msg.begin && msg.guid == other);
+
+    assert(scheduler.next(0, &msg));
+    assert(msg.begin && msg.guid == third);
+
+    // Late data for abandoned intervals is dropped
+    scheduler.writeInterval(first, 0x1, audioData(10));
+    assert(scheduler.droppedBytes() == 410);
+
+    scheduler.writeInterval(third, 0x1, audioData(20));
+    assert(scheduler.next(0, &msg));
+    assert(msg.guid == third && msg.data.size() == 20);
+    assert(!scheduler.next(0, &msg));
+}
+
+// Being one interval late is fine
+static void testOneIntervalLate()
+{
+    UploadScheduler scheduler;
+    const QUuid first = QUuid::createUuid();
+    const QUuid second = QUuid::createUuid();
+
+    scheduler.beginInterval(first, 0, fourCC, 0);
+    scheduler.writeInterval(first, 0x1, audioData(100));
+    scheduler.beginInterval(second, 0, fourCC, 0);
+    scheduler.writeInterval(second, 0x1, audioData(100));
+    assert(scheduler.droppedIntervals() == 0);
+    assert(drain(&scheduler) == 4);
+
+    scheduler.clear();
+    assert(scheduler.pendingBytes() == 0);
+}
+
+int main(int argc, char **argv)
+{
+    testOrder();
+    testBudget();
+    testSilence();
+    testFallBehind();
+    testOneIntervalLate();
+
+    printf("ok\n");
+    return 0;
+}